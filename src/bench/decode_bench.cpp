@@ -0,0 +1,260 @@
+//! \file decode_bench.cpp
+//!
+//! Throughput benchmark for the FM and MFM decoders.
+//!
+
+#include "decode.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+
+
+// sizes match a Heath hard-sectored sector
+static const unsigned int sectorBytes_c    = 350;
+static const unsigned int sectorRawBytes_c = 700;
+
+static const unsigned int numSectors_c     = 64;
+
+
+static int usage(char *progName)
+{
+    fprintf(stderr,"Usage: %s [-n iterations]\n",progName);
+    return 1;
+}
+
+
+//! simple bit writer for generating encoded streams
+//!
+struct BitWriter
+{
+    std::vector<uint8_t> buf;
+    unsigned int         bits = 0;
+
+    void put(unsigned int bit)
+    {
+        if ((bits & 7) == 0)
+        {
+            buf.push_back(0);
+        }
+        if (bit)
+        {
+            buf.back() |= 0x80 >> (bits & 7);
+        }
+        bits++;
+    }
+};
+
+
+//! generate a clean FM stream, data bit in the high bit of each cell
+//!
+static void
+genFM(uint8_t *raw,
+      uint8_t *data,
+      unsigned int count)
+{
+    BitWriter writer;
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        for (int bit = 7; bit >= 0; bit--)
+        {
+            writer.put((data[i] >> bit) & 1);
+            writer.put(1);
+        }
+    }
+    memcpy(raw, writer.buf.data(), count * 2);
+}
+
+
+//! generate an MFM stream, starting with a sync mark
+//!
+static void
+genMFM(uint8_t *raw,
+       uint8_t *data,
+       unsigned int count)
+{
+    BitWriter    writer;
+    unsigned int lastData = 1;
+
+    for (int bit = 15; bit >= 0; bit--)
+    {
+        writer.put((Decode::mfmSyncMark_c >> bit) & 1);
+    }
+    data[0] = Decode::mfmSyncByte_c;
+
+    for (unsigned int i = 1; i < count; i++)
+    {
+        for (int bit = 7; bit >= 0; bit--)
+        {
+            unsigned int dataBit = (data[i] >> bit) & 1;
+
+            writer.put(!(dataBit | lastData));
+            writer.put(dataBit);
+            lastData = dataBit;
+        }
+    }
+    memcpy(raw, writer.buf.data(), count * 2);
+}
+
+
+//! time a decoder over all the sectors
+//!
+//! @return nanoseconds per sector
+//!
+template <typename Func>
+static double
+timeDecoder(unsigned int iterations,
+            Func         decoder)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    for (unsigned int i = 0; i < iterations; i++)
+    {
+        for (unsigned int sector = 0; sector < numSectors_c; sector++)
+        {
+            decoder(sector);
+        }
+    }
+
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    return elapsed.count() / ((double) iterations * numSectors_c);
+}
+
+
+static void
+report(const char *name,
+       double      nsPerSector)
+{
+    // throughput is measured in raw (encoded) bytes
+    printf("%-24s %10.1f ns/sector %10.2f MB/s\n", name, nsPerSector,
+           (sectorRawBytes_c * 1000.0) / nsPerSector);
+}
+
+
+int main(int argc, char *argv[])
+{
+    unsigned int iterations = 2000;
+    int          opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+
+    static uint8_t data[numSectors_c][sectorBytes_c];
+    static uint8_t fmRaw[numSectors_c][sectorRawBytes_c];
+    static uint8_t mfmRaw[numSectors_c][sectorRawBytes_c];
+    static uint8_t decoded[numSectors_c][sectorBytes_c];
+    static uint8_t reference[numSectors_c][sectorBytes_c];
+
+    srand(17);
+    for (unsigned int sector = 0; sector < numSectors_c; sector++)
+    {
+        for (unsigned int i = 0; i < sectorBytes_c; i++)
+        {
+            data[sector][i] = rand();
+        }
+        genFM(fmRaw[sector], data[sector], sectorBytes_c);
+        genMFM(mfmRaw[sector], data[sector], sectorBytes_c);
+    }
+
+    report("decodeFMReference", timeDecoder(iterations, [&](unsigned int sector) {
+        Decode::decodeFMReference(reference[sector], fmRaw[sector], sectorBytes_c);
+    }));
+
+    struct
+    {
+        Decode::FMKernel  kernel;
+        const char       *name;
+    } kernels[] = {
+        { Decode::kernel_Table, "decodeFM (table)" },
+        { Decode::kernel_SSE2,  "decodeFM (sse2)"  },
+        { Decode::kernel_AVX2,  "decodeFM (avx2)"  },
+    };
+
+    int status = 0;
+
+    for (auto &entry : kernels)
+    {
+        if (!Decode::setFMKernel(entry.kernel))
+        {
+            printf("%-24s not supported\n", entry.name);
+            continue;
+        }
+
+        report(entry.name, timeDecoder(iterations, [&](unsigned int sector) {
+            Decode::decodeFM(decoded[sector], fmRaw[sector], sectorBytes_c);
+        }));
+
+        if (memcmp(decoded, reference, sizeof(decoded)) != 0)
+        {
+            printf("%-24s does not match decodeFMReference\n", entry.name);
+            status = 1;
+        }
+    }
+
+    struct
+    {
+        Decode::FMKernel  kernel;
+        const char       *name;
+    } mfmKernels[] = {
+        { Decode::kernel_Table, "decodeMFM (table)" },
+        { Decode::kernel_SSE2,  "decodeMFM (sse2)"  },
+        { Decode::kernel_AVX2,  "decodeMFM (avx2)"  },
+    };
+
+    for (auto &entry : mfmKernels)
+    {
+        if (!Decode::setFMKernel(entry.kernel))
+        {
+            printf("%-24s not supported\n", entry.name);
+            continue;
+        }
+
+        report(entry.name, timeDecoder(iterations, [&](unsigned int sector) {
+            Decode::decodeMFM(decoded[sector], mfmRaw[sector], sectorBytes_c);
+        }));
+
+        if (memcmp(decoded, data, sizeof(decoded)) != 0)
+        {
+            printf("%-24s does not match the encoded data\n", entry.name);
+            status = 1;
+        }
+    }
+    Decode::setFMKernel(Decode::kernel_Auto);
+
+    // streaming, in pieces that don't line up with the byte boundaries
+    report("decodeMFM (streaming)", timeDecoder(iterations, [&](unsigned int sector) {
+        Decode::MFMState state;
+        unsigned int     length = 0;
+
+        for (unsigned int pos = 0; pos < sectorRawBytes_c; pos += 125)
+        {
+            unsigned int count = (sectorRawBytes_c - pos) < 125 ? sectorRawBytes_c - pos : 125;
+
+            length += Decode::decodeMFM(&decoded[sector][length], &mfmRaw[sector][pos], count,
+                                        state);
+        }
+        Decode::decodeMFM(&decoded[sector][length], nullptr, 0, state, true);
+    }));
+
+    if (memcmp(decoded, data, sizeof(decoded)) != 0)
+    {
+        printf("decodeMFM (streaming) does not match the encoded data\n");
+        status = 1;
+    }
+
+    return status;
+}
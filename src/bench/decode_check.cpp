@@ -0,0 +1,580 @@
+//! \file decode_check.cpp
+//!
+//! Checks the table driven FM decoder, with each kernel the cpu supports, against the
+//! bit at a time reference decoder.
+//!
+//! Raw input is random bytes, clean FM with flipped and dropped bits, and the raw
+//! sectors from the RawDataBlock of any h17disk files given on the command line. For
+//! each input, the decoded bytes, the zero and one error counts, the final phase, the
+//! error positions and the error map must all match. Exits non-zero on any mismatch.
+//!
+//! The MFM decoder is checked the same way, with each kernel against the state machine
+//! alone, on random bytes and on sync marks and data with flipped and dropped bits. Each
+//! input is decoded in one call and in pieces of random sizes.
+//!
+
+#include "decode.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+
+// sizes match a Heath hard-sectored sector
+static const unsigned int sectorBytes_c    = 350;
+static const unsigned int sectorRawBytes_c = 700;
+
+// h17disk block and sub-block IDs
+static const uint8_t rawDataBlock_c    = 0x30;
+static const uint8_t rawTrackDataId_c  = 0x31;
+static const uint8_t rawSectorDataId_c = 0x32;
+
+// most mismatches printed before only counting them
+static const unsigned int maxReported_c = 10;
+
+
+static int usage(char *progName)
+{
+    fprintf(stderr,"Usage: %s [-n count] [-r seed] [file.h17disk ...]\n", progName);
+    fprintf(stderr,"   -n number of random and of damaged FM inputs (default 2000)\n");
+    fprintf(stderr,"   -r random seed (default 17)\n");
+    return 1;
+}
+
+
+//! load the raw sectors from a h17disk file
+//!
+//! @param name     file name
+//! @param sectors  [in/out] raw sectors, sectorRawBytes_c each
+//!
+//! @return success
+//!
+static bool
+loadRawSectors(const char                        *name,
+               std::vector<std::vector<uint8_t>> &sectors)
+{
+    std::ifstream file(name, std::ios::binary);
+
+    if (!file.is_open())
+    {
+        fprintf(stderr, "Unable to open file: %s\n", name);
+        return false;
+    }
+
+    std::vector<uint8_t> buf((std::istreambuf_iterator<char>(file)),
+                             std::istreambuf_iterator<char>());
+
+    if ((buf.size() < 8) || (memcmp(buf.data(), "H17D", 4) != 0))
+    {
+        fprintf(stderr, "Not a h17disk file: %s\n", name);
+        return false;
+    }
+
+    // version 2 headers have an extra byte
+    unsigned int pos   = ((buf[4] == '2') && (buf[7] == 0xff)) ? 8 : 7;
+
+    while (pos + 6 <= buf.size())
+    {
+        uint8_t      blockId = buf[pos];
+        unsigned int size    = (buf[pos + 2] << 24) | (buf[pos + 3] << 16) |
+                               (buf[pos + 4] << 8)  | buf[pos + 5];
+        unsigned int end     = pos + 6 + size;
+
+        if (end > buf.size())
+        {
+            fprintf(stderr, "Truncated block 0x%02x: %s\n", blockId, name);
+            return false;
+        }
+
+        if (blockId == rawDataBlock_c)
+        {
+            unsigned int trackPos = pos + 6;
+
+            while ((trackPos + 7 <= end) && (buf[trackPos] == rawTrackDataId_c))
+            {
+                unsigned int trackEnd   = trackPos + 7 + ((buf[trackPos + 3] << 24) |
+                                          (buf[trackPos + 4] << 16) | (buf[trackPos + 5] << 8) |
+                                          buf[trackPos + 6]);
+                unsigned int sectorPos  = trackPos + 7;
+
+                // retries stored as deltas share the sub-block header, and are skipped
+                while (sectorPos + 4 <= trackEnd)
+                {
+                    unsigned int length = (buf[sectorPos + 2] << 8) | buf[sectorPos + 3];
+
+                    if ((buf[sectorPos] == rawSectorDataId_c) && (length == sectorRawBytes_c) &&
+                        (sectorPos + 4 + length <= end))
+                    {
+                        sectors.emplace_back(&buf[sectorPos + 4],
+                                             &buf[sectorPos + 4 + sectorRawBytes_c]);
+                    }
+                    sectorPos += 4 + length;
+                }
+                trackPos = trackEnd;
+            }
+        }
+        pos = end;
+    }
+
+    return true;
+}
+
+
+//! random event with an average number of occurrences over the given number of tries
+//!
+static bool
+randomEvent(double       average,
+            unsigned int tries)
+{
+    return (rand() / (RAND_MAX + 1.0)) < (average / tries);
+}
+
+
+//! generate clean FM for random data, then flip and drop raw bits
+//!
+//! Long clean runs between the damage go through the vector kernels, the damage itself
+//! through the table.
+//!
+//! @param raw      [out] raw sector
+//! @param jitter   average bits flipped
+//! @param dropped  average bits dropped
+//!
+static void
+genDamagedFM(std::vector<uint8_t> &raw,
+             double                jitter,
+             double                dropped)
+{
+    const unsigned int   rawBits = sectorRawBytes_c * 8;
+    std::vector<uint8_t> cells;
+
+    // data bit in the low bit of the cell half the time
+    if (rand() & 1)
+    {
+        cells.push_back(1);
+    }
+
+    for (unsigned int i = 0; i < sectorBytes_c; i++)
+    {
+        uint8_t value = rand();
+
+        for (int bit = 7; bit >= 0; bit--)
+        {
+            cells.push_back((value >> bit) & 1);
+            cells.push_back(1);
+        }
+    }
+
+    raw.assign(sectorRawBytes_c, 0);
+
+    unsigned int out = 0;
+
+    for (unsigned int in = 0; (in < cells.size()) && (out < rawBits); in++)
+    {
+        if (randomEvent(dropped, rawBits))
+        {
+            continue;
+        }
+
+        unsigned int bit = cells[in] ^ randomEvent(jitter, rawBits);
+
+        raw[out >> 3] |= bit << (7 - (out & 7));
+        out++;
+    }
+}
+
+
+//! generate MFM records, each a gap, sync marks and random data, starting at a random
+//! bit, then flip and drop raw bits
+//!
+//! @param raw      [out] raw data, twice the size of a sector
+//! @param jitter   average bits flipped
+//! @param dropped  average bits dropped
+//!
+static void
+genDamagedMFM(std::vector<uint8_t> &raw,
+              double                jitter,
+              double                dropped)
+{
+    const unsigned int   rawBits  = sectorRawBytes_c * 16;
+    std::vector<uint8_t> cells(rand() % 16);
+    unsigned int         lastData = 0;
+
+    auto putData = [&](uint8_t value)
+    {
+        for (int bit = 7; bit >= 0; bit--)
+        {
+            unsigned int data = (value >> bit) & 1;
+
+            cells.push_back(!(data | lastData));
+            cells.push_back(data);
+            lastData = data;
+        }
+    };
+
+    for (auto &cell : cells)
+    {
+        cell = rand() & 1;
+    }
+
+    while (cells.size() < rawBits + 64)
+    {
+        for (unsigned int i = rand() % 24; i; i--)
+        {
+            putData(0x4e);
+        }
+        for (unsigned int i = 0; i < 3; i++)
+        {
+            for (int bit = 15; bit >= 0; bit--)
+            {
+                cells.push_back((Decode::mfmSyncMark_c >> bit) & 1);
+            }
+            lastData = 1;
+        }
+        for (unsigned int i = rand() % 300; i; i--)
+        {
+            putData(rand());
+        }
+    }
+
+    raw.assign(rawBits / 8, 0);
+
+    unsigned int out = 0;
+
+    for (unsigned int in = 0; (in < cells.size()) && (out < rawBits); in++)
+    {
+        if (randomEvent(dropped, rawBits))
+        {
+            continue;
+        }
+
+        unsigned int bit = cells[in] ^ randomEvent(jitter, rawBits);
+
+        raw[out >> 3] |= bit << (7 - (out & 7));
+        out++;
+    }
+}
+
+
+//! decode one input with the reference and the table decoder, and compare the results
+//!
+//! @param name    kernel name for reporting
+//! @param input   description of the input for reporting
+//! @param raw     raw data, 2 bytes per decoded byte
+//! @param count   decoded bytes
+//!
+//! @return number of differences found
+//!
+static unsigned int
+checkDecode(const char  *name,
+            const char  *input,
+            uint8_t     *raw,
+            unsigned int count)
+{
+    std::vector<uint8_t> refDecoded(count);
+    std::vector<uint8_t> decoded(count);
+    std::vector<uint8_t> refMap((count + 7) / 8, 0xff);
+    std::vector<uint8_t> map((count + 7) / 8, 0xff);
+    DecodeContext        refContext;
+    DecodeContext        context;
+
+    refContext.errorMap = refMap.data();
+    context.errorMap    = map.data();
+
+    Decode::decodeFMReference(refDecoded.data(), raw, count, refContext);
+    Decode::decodeFM(decoded.data(), raw, count, context);
+
+    const char *field = nullptr;
+
+    if (decoded != refDecoded)
+    {
+        field = "decoded bytes";
+    }
+    else if (context.zeroErrors != refContext.zeroErrors)
+    {
+        field = "zero errors";
+    }
+    else if (context.oneErrors != refContext.oneErrors)
+    {
+        field = "one errors";
+    }
+    else if ((context.state != refContext.state) || (context.lastBit != refContext.lastBit))
+    {
+        field = "final state";
+    }
+    else if (map != refMap)
+    {
+        field = "error map";
+    }
+    else if ((context.errorPositionCount != refContext.errorPositionCount) ||
+             (memcmp(context.errorPositions, refContext.errorPositions,
+                     std::min(context.errorPositionCount, DecodeContext::maxErrorPositions_c) *
+                     sizeof(context.errorPositions[0])) != 0))
+    {
+        field = "error positions";
+    }
+
+    if (!field)
+    {
+        return 0;
+    }
+
+    static unsigned int reported = 0;
+
+    if (reported++ < maxReported_c)
+    {
+        printf("%-18s %-24s %s differ (zeros %u/%u, ones %u/%u)\n", name, input, field,
+               context.zeroErrors, refContext.zeroErrors,
+               context.oneErrors, refContext.oneErrors);
+    }
+
+    return 1;
+}
+
+
+//! decode MFM, in one call or in pieces of random sizes
+//!
+//! @param raw      raw data
+//! @param decoded  [out] decoded bytes
+//! @param state    [out] final decode state
+//! @param pieces   decode in pieces
+//!
+static void
+decodeMFM(std::vector<uint8_t> &raw,
+          std::vector<uint8_t> &decoded,
+          Decode::MFMState     &state,
+          bool                  pieces)
+{
+    unsigned int length = 0;
+    unsigned int pos    = 0;
+
+    decoded.assign(raw.size() / 2 + 16, 0);
+    state.reset();
+
+    while (pos < raw.size())
+    {
+        unsigned int count = pieces ? std::min((unsigned int) rand() % 200 + 1,
+                                               (unsigned int) raw.size() - pos) :
+                                      raw.size() - pos;
+
+        length += Decode::decodeMFM(&decoded[length], &raw[pos], count, state);
+        pos    += count;
+    }
+    length += Decode::decodeMFM(&decoded[length], nullptr, 0, state, true);
+
+    decoded.resize(length);
+}
+
+
+//! decode one MFM input with the state machine alone and with the current kernel, in
+//! one call and in pieces, and compare the results
+//!
+//! @param name    kernel name for reporting
+//! @param input   description of the input for reporting
+//! @param raw     raw data
+//!
+//! @return number of differences found
+//!
+static unsigned int
+checkDecodeMFM(const char           *name,
+               const char           *input,
+               std::vector<uint8_t> &raw)
+{
+    Decode::FMKernel     kernel = Decode::getFMKernel();
+    std::vector<uint8_t> refDecoded;
+    Decode::MFMState     refState;
+    unsigned int         failed = 0;
+
+    Decode::setFMKernel(Decode::kernel_Table);
+    decodeMFM(raw, refDecoded, refState, false);
+    Decode::setFMKernel(kernel);
+
+    for (bool pieces : { false, true })
+    {
+        std::vector<uint8_t> decoded;
+        Decode::MFMState     state;
+
+        decodeMFM(raw, decoded, state, pieces);
+
+        const char *field = nullptr;
+
+        if (decoded != refDecoded)
+        {
+            field = "decoded bytes";
+        }
+        else if ((state.zeroErrors != refState.zeroErrors) ||
+                 (state.oneErrors != refState.oneErrors))
+        {
+            field = "errors";
+        }
+        else if ((state.syncMarks != refState.syncMarks) || (state.resyncs != refState.resyncs))
+        {
+            field = "sync marks";
+        }
+        else if (state.lastData != refState.lastData)
+        {
+            field = "final state";
+        }
+
+        if (!field)
+        {
+            continue;
+        }
+
+        static unsigned int reported = 0;
+
+        if (reported++ < maxReported_c)
+        {
+            printf("%-18s %-24s %s differ%s (syncs %u/%u, zeros %u/%u, ones %u/%u)\n", name,
+                   input, field, pieces ? " in pieces" : "", state.syncMarks,
+                   refState.syncMarks, state.zeroErrors, refState.zeroErrors,
+                   state.oneErrors, refState.oneErrors);
+        }
+        failed++;
+    }
+
+    return failed;
+}
+
+
+int main(int argc, char *argv[])
+{
+    unsigned int count = 2000;
+    unsigned int seed  = 17;
+    int          opt;
+
+    while ((opt = getopt(argc, argv, "n:r:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'r':
+            seed = atoi(optarg);
+            break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+
+    std::vector<std::vector<uint8_t>> captured;
+
+    for (int i = optind; i < argc; i++)
+    {
+        if (!loadRawSectors(argv[i], captured))
+        {
+            return 1;
+        }
+    }
+
+    std::vector<std::vector<uint8_t>> random(count);
+    std::vector<std::vector<uint8_t>> damaged(count);
+    std::vector<std::vector<uint8_t>> mfm(count);
+    std::vector<std::vector<uint8_t>> damagedMFM(count);
+
+    srand(seed);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        random[i].resize(sectorRawBytes_c);
+        for (auto &byte : random[i])
+        {
+            byte = rand();
+        }
+        genDamagedFM(damaged[i], 2.0, 0.5);
+        genDamagedMFM(mfm[i], 0.0, 0.0);
+        genDamagedMFM(damagedMFM[i], 2.0, 0.5);
+    }
+
+    struct
+    {
+        Decode::FMKernel  kernel;
+        const char       *name;
+    } kernels[] = {
+        { Decode::kernel_Table, "decodeFM (table)" },
+        { Decode::kernel_SSE2,  "decodeFM (sse2)"  },
+        { Decode::kernel_AVX2,  "decodeFM (avx2)"  },
+    };
+
+    unsigned int failed = 0;
+
+    for (auto &entry : kernels)
+    {
+        if (!Decode::setFMKernel(entry.kernel))
+        {
+            printf("%-18s not supported\n", entry.name);
+            continue;
+        }
+
+        unsigned int kernelFailed = 0;
+        unsigned int checked      = 0;
+
+        for (auto &raw : random)
+        {
+            kernelFailed += checkDecode(entry.name, "random", raw.data(), sectorBytes_c);
+            checked++;
+        }
+
+        for (auto &raw : damaged)
+        {
+            kernelFailed += checkDecode(entry.name, "damaged FM", raw.data(), sectorBytes_c);
+
+            // odd lengths and starts, so the kernels end on partial chunks
+            unsigned int start = rand() % 64;
+            unsigned int bytes = rand() % (sectorBytes_c - start);
+
+            kernelFailed += checkDecode(entry.name, "damaged FM (partial)",
+                                        raw.data() + start * 2, bytes);
+            checked += 2;
+        }
+
+        for (auto &raw : captured)
+        {
+            kernelFailed += checkDecode(entry.name, "captured", raw.data(), sectorBytes_c);
+            checked++;
+        }
+
+        printf("%-18s %u inputs, %u mismatches\n", entry.name, checked, kernelFailed);
+        failed += kernelFailed;
+    }
+
+    struct
+    {
+        Decode::FMKernel  kernel;
+        const char       *name;
+    } mfmKernels[] = {
+        { Decode::kernel_Table, "decodeMFM (table)" },
+        { Decode::kernel_SSE2,  "decodeMFM (sse2)"  },
+        { Decode::kernel_AVX2,  "decodeMFM (avx2)"  },
+    };
+
+    for (auto &entry : mfmKernels)
+    {
+        if (!Decode::setFMKernel(entry.kernel))
+        {
+            printf("%-18s not supported\n", entry.name);
+            continue;
+        }
+
+        unsigned int kernelFailed = 0;
+        unsigned int checked      = 0;
+
+        for (unsigned int i = 0; i < count; i++)
+        {
+            kernelFailed += checkDecodeMFM(entry.name, "random", random[i]);
+            kernelFailed += checkDecodeMFM(entry.name, "clean MFM", mfm[i]);
+            kernelFailed += checkDecodeMFM(entry.name, "damaged MFM", damagedMFM[i]);
+            checked += 3;
+        }
+
+        printf("%-18s %u inputs, %u mismatches\n", entry.name, checked, kernelFailed);
+        failed += kernelFailed;
+    }
+    Decode::setFMKernel(Decode::kernel_Auto);
+
+    return failed ? 1 : 0;
+}
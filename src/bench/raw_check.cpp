@@ -0,0 +1,560 @@
+//! \file raw_check.cpp
+//!
+//! Checks the coders for the raw data: the LZ coder behind the compressed raw data block,
+//! and the deltas the later attempts of a raw sector are stored as.
+//!
+//! Generated FM is compressed and decompressed, then decompressed again truncated, which
+//! must fail, and with corrupted bytes, which must not write past the output. A compressed
+//! raw data block made from generated raw tracks must give back the same tracks, and must
+//! refuse the tracks with corrupt headers. Later attempts of generated raw sectors are
+//! stored as deltas, written and read back against their first attempt, which must rebuild
+//! them. Deltas with corrupt runs or sizes must be refused. Exits non-zero on any failure.
+//!
+//! With -o, an image with several attempts of each raw sector is also written, for
+//! make check to run through h17d_clone.
+//!
+
+#include "h17block.h"
+#include "h17disk.h"
+#include "disk_util.h"
+#include "lz.h"
+#include "raw_sector.h"
+#include "raw_track.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+// sizes match a Heath hard-sectored sector
+static const unsigned int sectorBytes_c    = 350;
+static const unsigned int sectorRawBytes_c = 700;
+
+static const unsigned int numSectors_c     = 10;
+static const unsigned int numTracks_c      = 8;
+
+// bytes after the decompressed data that must not be written
+static const unsigned int guardBytes_c     = 64;
+static const uint8_t      guardByte_c      = 0xa5;
+
+// most failures printed before only counting them
+static const unsigned int maxReported_c    = 10;
+
+
+static int usage(char *progName)
+{
+    fprintf(stderr,"Usage: %s [-n count] [-r seed] [-o file.h17disk]\n", progName);
+    fprintf(stderr,"   -n number of generated buffers and sectors (default 500)\n");
+    fprintf(stderr,"   -r random seed (default 17)\n");
+    fprintf(stderr,"   -o write a generated image with retries of each raw sector\n");
+    return 1;
+}
+
+
+//! count a failure, printing the first few
+//!
+//! @param failures  [in/out]
+//! @param message
+//! @param index     input the failure was found on
+//!
+static void
+fail(unsigned int &failures,
+     const char   *message,
+     unsigned int  index)
+{
+    if (failures++ < maxReported_c)
+    {
+        printf("  %s: input %u\n", message, index);
+    }
+}
+
+
+//! generate a raw sector, clean FM of a sector that is mostly a fill byte, as on a
+//! freshly formatted disk, so it compresses like a real one
+//!
+//! @param raw   [out] sectorRawBytes_c bytes
+//!
+static void
+genRawSector(std::vector<uint8_t> &raw)
+{
+    uint8_t fill = (rand() & 1) ? 0xe5 : 0x00;
+
+    raw.assign(sectorRawBytes_c, 0);
+
+    for (unsigned int i = 0; i < sectorBytes_c; i++)
+    {
+        uint8_t  data = ((rand() % 8) == 0) ? rand() : fill;
+        uint16_t cell = 0;
+
+        // data bit in the high bit of each cell, the clock bit always set
+        for (int bit = 7; bit >= 0; bit--)
+        {
+            cell = (cell << 2) | (((data >> bit) & 1) << 1) | 1;
+        }
+        raw[i * 2]     = cell >> 8;
+        raw[i * 2 + 1] = cell & 0xff;
+    }
+}
+
+
+//! generate a later attempt of a raw sector, it starts a few bits earlier or later and
+//! some bytes read differently
+//!
+//! @param first  first attempt
+//! @param raw    [out] later attempt
+//!
+static void
+genAttempt(const std::vector<uint8_t> &first,
+           std::vector<uint8_t>       &raw)
+{
+    int      shift   = (rand() % (2 * RawSector::maxShift_c + 1)) - RawSector::maxShift_c;
+    int      size    = first.size();
+    int      bytes   = ((shift < 0) ? -shift : shift) >> 3;
+    int      bits    = ((shift < 0) ? -shift : shift) & 7;
+    auto     at      = [&first, size](int pos) -> unsigned int
+    {
+        return ((pos >= 0) && (pos < size)) ? first[pos] : 0;
+    };
+
+    raw.resize(size);
+
+    for (int i = 0; i < size; i++)
+    {
+        raw[i] = (shift >= 0) ?
+                 (at(i - bytes) >> bits) | (at(i - bytes - 1) << (8 - bits)) :
+                 (at(i + bytes) << bits) | (at(i + bytes + 1) >> (8 - bits));
+    }
+
+    for (int flips = 1 + rand() % 8; flips; flips--)
+    {
+        raw[rand() % size] ^= 1 << (rand() % 8);
+    }
+}
+
+
+//! decompress into a buffer with guard bytes after it
+//!
+//! @param in
+//! @param size
+//! @param outSize   expected decompressed size
+//! @param out       [out] outSize bytes, then the guard bytes
+//! @param overrun   [out] if the guard bytes were written
+//!
+//! @return result of LZ::decompress()
+//!
+static bool
+decompress(const uint8_t        *in,
+           uint32_t              size,
+           uint32_t              outSize,
+           std::vector<uint8_t> &out,
+           bool                 &overrun)
+{
+    out.assign(outSize + guardBytes_c, guardByte_c);
+
+    bool status = LZ::decompress(in, size, out.data(), outSize);
+
+    overrun = false;
+    for (unsigned int i = outSize; i < out.size(); i++)
+    {
+        overrun |= (out[i] != guardByte_c);
+    }
+
+    return status;
+}
+
+
+//! compress generated raw sectors and decompress them whole, truncated and corrupted
+//!
+//! @param count  number of buffers
+//!
+//! @return number of failures
+//!
+static unsigned int
+checkLZ(unsigned int count)
+{
+    std::vector<uint8_t> in;
+    std::vector<uint8_t> sector;
+    std::vector<uint8_t> compressed;
+    std::vector<uint8_t> corrupt;
+    std::vector<uint8_t> out;
+    unsigned int         failures  = 0;
+    unsigned int         truncated = 0;
+    unsigned int         refused   = 0;
+    unsigned int         tries     = 0;
+    bool                 overrun;
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        // one or more attempts of a sector, like a raw track
+        genRawSector(sector);
+        in = sector;
+        for (int attempts = rand() % 4; attempts; attempts--)
+        {
+            genAttempt(sector, compressed);
+            in.insert(in.end(), compressed.begin(), compressed.end());
+        }
+
+        if (!LZ::compress(in.data(), in.size(), compressed))
+        {
+            fail(failures, "generated FM did not compress", i);
+            continue;
+        }
+
+        if (!decompress(compressed.data(), compressed.size(), in.size(), out, overrun) ||
+            overrun || (memcmp(out.data(), in.data(), in.size()) != 0))
+        {
+            fail(failures, "decompressed data does not match", i);
+            continue;
+        }
+
+        // every truncation leaves some of the data out
+        for (uint32_t size = 0; size < compressed.size(); size++)
+        {
+            truncated++;
+            if (decompress(compressed.data(), size, in.size(), out, overrun) || overrun)
+            {
+                fail(failures, overrun ? "truncated data written past the output" :
+                                         "truncated data accepted", i);
+                break;
+            }
+        }
+
+        // a corrupted literal can still decompress, but nothing may be written past out
+        for (unsigned int j = 0; j < 64; j++)
+        {
+            corrupt = compressed;
+            for (int bytes = 1 + rand() % 4; bytes; bytes--)
+            {
+                corrupt[rand() % corrupt.size()] = rand();
+            }
+
+            tries++;
+            refused += !decompress(corrupt.data(), corrupt.size(), in.size(), out, overrun);
+            if (overrun)
+            {
+                fail(failures, "corrupt data written past the output", i);
+                break;
+            }
+        }
+    }
+
+    printf("LZ            %u inputs, %u truncated, %u of %u corrupted refused, %u failures\n",
+           count, truncated, refused, tries, failures);
+
+    return failures;
+}
+
+
+//! generate a raw track sub-block, with several attempts of some of the sectors
+//!
+//! @param track
+//! @param data    [out] the raw track sub-block
+//! @param delta   store the later attempts as deltas
+//!
+static void
+genRawTrack(uint8_t               track,
+            std::vector<uint8_t> &data,
+            bool                  delta)
+{
+    RawTrack             rawTrack(0, track);
+    std::vector<uint8_t> first;
+    std::vector<uint8_t> raw;
+    std::ostringstream   out;
+
+    rawTrack.setDeltaEncoding(delta);
+
+    for (uint8_t sector = 0; sector < numSectors_c; sector++)
+    {
+        genRawSector(first);
+        rawTrack.addRawSector(new RawSector(0, track, sector, first.data(), first.size()));
+
+        for (int attempts = rand() % 3; attempts; attempts--)
+        {
+            genAttempt(first, raw);
+            rawTrack.addRawSector(new RawSector(0, track, sector, raw.data(), raw.size()));
+        }
+    }
+
+    rawTrack.writeToFile(out);
+
+    std::string buf = out.str();
+
+    data.assign(buf.begin(), buf.end());
+}
+
+
+//! make a compressed raw data block from generated tracks, and check the tracks come back
+//! the same, and that tracks with corrupt headers are refused
+//!
+//! @return number of failures
+//!
+static unsigned int
+checkCompressedBlock()
+{
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> track;
+    std::vector<uint8_t> decompressed;
+    unsigned int         failures = 0;
+
+    for (uint8_t i = 0; i < numTracks_c; i++)
+    {
+        genRawTrack(i, track, (i & 1) != 0);
+        data.insert(data.end(), track.begin(), track.end());
+    }
+
+    H17RawDataBlock           rawData(data.data(), data.size());
+    H17CompressedRawDataBlock compressed(rawData);
+
+    if ((compressed.getRawTrackCount() != numTracks_c) ||
+        (compressed.getDataSize() >= data.size()))
+    {
+        fail(failures, "raw tracks not compressed", 0);
+        return failures;
+    }
+
+    H17RawDataBlock *copy = compressed.createRawDataBlock();
+
+    if ((!copy) || (copy->getDataSize() != data.size()) ||
+        (memcmp(copy->getData(), data.data(), data.size()) != 0))
+    {
+        fail(failures, "compressed raw data block does not match", 0);
+    }
+    delete copy;
+
+    // the header of the first track is the codec, then the raw and compressed lengths
+    std::vector<uint8_t> corrupt;
+    uint8_t             *buf = compressed.getData();
+    uint32_t             size = compressed.getDataSize();
+    struct
+    {
+        unsigned int  pos;
+        uint8_t       value;
+        const char   *name;
+    } corruptions[] = {
+        { 3, 0x7f, "unknown codec accepted"          },
+        { 4, 0x7f, "huge raw track length accepted"  },
+        { 6, 0xff, "wrong raw track length accepted" },
+        { 7, 0x01, "wrong raw track length accepted" },
+    };
+
+    for (auto &corruption : corruptions)
+    {
+        corrupt.assign(buf, buf + size);
+        corrupt[corruption.pos] ^= corruption.value;
+
+        H17CompressedRawDataBlock block(corrupt.data(), corrupt.size());
+
+        if ((block.getRawTrackCount() != numTracks_c) ||
+            block.getRawTrackData(0, decompressed) || !block.getRawTrackData(1, decompressed))
+        {
+            fail(failures, corruption.name, corruption.pos);
+        }
+    }
+
+    printf("LZ block      %u tracks, %u to %u bytes, %u failures\n", numTracks_c,
+           (unsigned int) data.size(), size, failures);
+
+    return failures;
+}
+
+
+//! store later attempts of generated sectors as deltas, read them back, and check that
+//! corrupt deltas are refused
+//!
+//! @param count  number of sectors
+//!
+//! @return number of failures
+//!
+static unsigned int
+checkDelta(unsigned int count)
+{
+    std::vector<uint8_t> first;
+    std::vector<uint8_t> raw;
+    std::string          delta;
+    std::string          corrupt;
+    unsigned int         failures = 0;
+    unsigned int         bytes    = 0;
+    uint16_t             length;
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        uint8_t sector = i % numSectors_c;
+
+        genRawSector(first);
+        genAttempt(first, raw);
+
+        RawSector firstSector(0, 0, sector, first.data(), first.size());
+        RawSector attempt(0, 0, sector, raw.data(), raw.size());
+
+        if (!attempt.encodeDelta(&firstSector))
+        {
+            fail(failures, "attempt not stored as a delta", i);
+            continue;
+        }
+
+        std::ostringstream out;
+
+        attempt.writeToFile(out);
+        delta  = out.str();
+        bytes += delta.size();
+
+        RawSector loaded((uint8_t *) &delta[0], delta.size(), length, true, &firstSector);
+
+        if ((delta[0] != H17Disk::RawSectorDeltaId) || (length != delta.size()) ||
+            (!loaded.getBuf()) || (loaded.getBufSize() != raw.size()) ||
+            (memcmp(loaded.getBuf(), raw.data(), raw.size()) != 0) ||
+            (!loaded.expand()) || (loaded.isDelta()))
+        {
+            fail(failures, "delta does not rebuild the attempt", i);
+            continue;
+        }
+
+        // the corrupt deltas are each reported as they are refused, so only try them on
+        // a few of the sectors
+        if (i >= numSectors_c)
+        {
+            continue;
+        }
+
+        // the first run skips past the end of the sector
+        corrupt = delta;
+        corrupt[RawSector::headerSize_c + RawSector::deltaHeaderSize_c]     = 0xff;
+        corrupt[RawSector::headerSize_c + RawSector::deltaHeaderSize_c + 1] = 0xff;
+
+        RawSector skipped((uint8_t *) &corrupt[0], corrupt.size(), length, true,
+                          &firstSector);
+
+        // the last run is cut short
+        corrupt = delta;
+        corrupt.resize(corrupt.size() - 1);
+        corrupt[2] = ((corrupt.size() - RawSector::headerSize_c) >> 8) & 0xff;
+        corrupt[3] = (corrupt.size() - RawSector::headerSize_c) & 0xff;
+
+        RawSector cut((uint8_t *) &corrupt[0], corrupt.size(), length, true, &firstSector);
+
+        // a delta against a first attempt of another size
+        RawSector shorter(0, 0, sector, first.data(), first.size() - 1);
+        RawSector other((uint8_t *) &delta[0], delta.size(), length, true, &shorter);
+
+        if (skipped.getBuf() || skipped.expand() || !skipped.isDelta() ||
+            cut.getBuf() || cut.expand() || other.getBuf())
+        {
+            fail(failures, "corrupt delta accepted", i);
+        }
+    }
+
+    printf("delta         %u sectors, %u to %u bytes, %u failures\n", count,
+           count * (sectorRawBytes_c + RawSector::headerSize_c), bytes, failures);
+
+    return failures;
+}
+
+
+//! write an image with several attempts of each raw sector
+//!
+//! @param name  file name
+//!
+//! @return success
+//!
+static bool
+writeImage(const char *name)
+{
+    H17Disk              image;
+    std::vector<uint8_t> first;
+    std::vector<uint8_t> raw;
+    uint8_t              out[sectorBytes_c];
+
+    if (!image.openForWrite(name))
+    {
+        fprintf(stderr, "Unable to open file: %s\n", name);
+        return false;
+    }
+
+    // as heathcapture writes them
+    image.spillRaw();
+    image.writeHeader();
+    image.setSides(1);
+    image.setTracks(numTracks_c);
+    image.writeDiskFormatBlock();
+    image.startData();
+
+    for (uint8_t track = 0; track < numTracks_c; track++)
+    {
+        image.startTrack(0, track);
+
+        for (uint8_t sector = 0; sector < numSectors_c; sector++)
+        {
+            genRawSector(first);
+            image.addRawSector(sector, first.data(), first.size());
+
+            for (int attempts = rand() % 3; attempts; attempts--)
+            {
+                genAttempt(first, raw);
+                image.addRawSector(sector, raw.data(), raw.size());
+            }
+
+            int status = processRawSector(first.data(), out, sectorBytes_c, 0, track, sector,
+                                          true);
+
+            image.addSector(sector, status, out, sectorBytes_c);
+        }
+
+        image.endTrack();
+    }
+
+    image.endDataBlock();
+
+    bool written = image.writeRawDataBlock();
+
+    return image.closeFile() && written;
+}
+
+
+int main(int argc, char *argv[])
+{
+    unsigned int  count = 500;
+    unsigned int  seed  = 17;
+    const char   *image = nullptr;
+    int           opt;
+
+    while ((opt = getopt(argc, argv, "n:r:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'r':
+            seed = atoi(optarg);
+            break;
+        case 'o':
+            image = optarg;
+            break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+
+    if (optind != argc)
+    {
+        return usage(argv[0]);
+    }
+
+    srand(seed);
+
+    unsigned int failures = checkLZ(count);
+
+    failures += checkCompressedBlock();
+    failures += checkDelta(count);
+
+    if (image && !writeImage(image))
+    {
+        failures++;
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,403 @@
+//! \file sector_bench.cpp
+//!
+//! Benchmark for the per-sector processing, from the raw FM data to a verified sector.
+//!
+//! Raw sectors are either loaded from the RawDataBlock of h17disk files, or generated with
+//! injected jitter and dropped bits. Results are printed as CSV.
+//!
+
+#include "decode.h"
+#include "disk_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+
+// sizes match a Heath hard-sectored sector
+static const unsigned int sectorBytes_c    = 350;
+static const unsigned int sectorRawBytes_c = 700;
+
+static const unsigned int numErrorCodes_c  = Err_InvalidDataChecksum + 1;
+
+// h17disk block and sub-block IDs
+static const uint8_t diskFormatBlock_c = 0x00;
+static const uint8_t rawDataBlock_c    = 0x30;
+static const uint8_t rawTrackDataId_c  = 0x31;
+static const uint8_t rawSectorDataId_c = 0x32;
+
+
+//! raw sector to process, with the track expected in its header
+//!
+struct RawSector
+{
+    uint8_t raw[sectorRawBytes_c];
+    uint8_t track;
+};
+
+
+static int usage(char *progName)
+{
+    fprintf(stderr,"Usage: %s [-n iterations] [-s sectors] [-j jitter] [-d dropped] [file.h17disk ...]\n",
+            progName);
+    fprintf(stderr,"   -n iterations over all the sectors (default 200)\n");
+    fprintf(stderr,"   -s number of synthetic sectors, when no files are given (default 400)\n");
+    fprintf(stderr,"   -j average raw bits flipped per synthetic sector (default 0.5)\n");
+    fprintf(stderr,"   -d average raw bits dropped per synthetic sector (default 0.1)\n");
+    return 1;
+}
+
+
+//! load the raw sectors from a h17disk file
+//!
+//! @param name     file name
+//! @param sectors  [in/out] raw sectors
+//!
+//! @return success
+//!
+static bool
+loadRawSectors(const char             *name,
+               std::vector<RawSector> &sectors)
+{
+    std::ifstream file(name, std::ios::binary);
+
+    if (!file.is_open())
+    {
+        fprintf(stderr, "Unable to open file: %s\n", name);
+        return false;
+    }
+
+    std::vector<uint8_t> buf((std::istreambuf_iterator<char>(file)),
+                             std::istreambuf_iterator<char>());
+
+    if ((buf.size() < 8) || (memcmp(buf.data(), "H17D", 4) != 0))
+    {
+        fprintf(stderr, "Not a h17disk file: %s\n", name);
+        return false;
+    }
+
+    // version 2 headers have an extra byte
+    unsigned int pos   = ((buf[4] == '2') && (buf[7] == 0xff)) ? 8 : 7;
+    unsigned int sides = 1;
+
+    while (pos + 6 <= buf.size())
+    {
+        uint8_t      blockId = buf[pos];
+        unsigned int size    = (buf[pos + 2] << 24) | (buf[pos + 3] << 16) |
+                               (buf[pos + 4] << 8)  | buf[pos + 5];
+        unsigned int end     = pos + 6 + size;
+
+        if (end > buf.size())
+        {
+            fprintf(stderr, "Truncated block 0x%02x: %s\n", blockId, name);
+            return false;
+        }
+
+        if ((blockId == diskFormatBlock_c) && size)
+        {
+            sides = buf[pos + 6];
+        }
+        else if (blockId == rawDataBlock_c)
+        {
+            unsigned int trackPos = pos + 6;
+
+            while ((trackPos + 7 <= end) && (buf[trackPos] == rawTrackDataId_c))
+            {
+                uint8_t      side       = buf[trackPos + 1];
+                uint8_t      track      = buf[trackPos + 2];
+                unsigned int trackEnd   = trackPos + 7 + ((buf[trackPos + 3] << 24) |
+                                          (buf[trackPos + 4] << 16) | (buf[trackPos + 5] << 8) |
+                                          buf[trackPos + 6]);
+                unsigned int sectorPos  = trackPos + 7;
+
+                // retries stored as deltas share the sub-block header, and are skipped
+                while (sectorPos + 4 <= trackEnd)
+                {
+                    unsigned int length = (buf[sectorPos + 2] << 8) | buf[sectorPos + 3];
+
+                    if ((buf[sectorPos] == rawSectorDataId_c) && (length == sectorRawBytes_c) &&
+                        (sectorPos + 4 + length <= end))
+                    {
+                        RawSector sector;
+
+                        memcpy(sector.raw, &buf[sectorPos + 4], sectorRawBytes_c);
+                        sector.track = (sides == 2) ? ((track << 1) + side) : track;
+                        sectors.push_back(sector);
+                    }
+                    sectorPos += 4 + length;
+                }
+                trackPos = trackEnd;
+            }
+        }
+        pos = end;
+    }
+
+    return true;
+}
+
+
+//! random event with an average number of occurrences over the given number of tries
+//!
+static bool
+randomEvent(double       average,
+            unsigned int tries)
+{
+    return (rand() / (RAND_MAX + 1.0)) < (average / tries);
+}
+
+
+//! generate a Heath sector, FM encode it and damage it
+//!
+//! @param sector   [out] raw sector
+//! @param track    track number for the header
+//! @param number   sector number for the header
+//! @param jitter   average bits flipped
+//! @param dropped  average bits dropped
+//!
+static void
+genRawSector(RawSector &sector,
+             uint8_t    track,
+             uint8_t    number,
+             double     jitter,
+             double     dropped)
+{
+    uint8_t      data[sectorBytes_c + 8] = {};
+    unsigned int pos                     = 10 + rand() % 20;
+    uint8_t      checksum;
+
+    // header
+    data[pos++] = PrefixSyncChar_c;
+    data[pos++] = 0;
+    data[pos++] = track;
+    data[pos++] = number;
+    checksum    = updateChecksum(updateChecksum(updateChecksum(0, 0), track), number);
+    data[pos++] = checksum;
+
+    // data
+    pos += 10 + rand() % 5;
+    data[pos++] = PrefixSyncChar_c;
+    checksum = 0;
+    for (unsigned int i = 0; i < 256; i++)
+    {
+        data[pos] = rand();
+        checksum  = updateChecksum(checksum, data[pos++]);
+    }
+    data[pos++] = checksum;
+
+    // FM encode as one bit per entry, bytes are sent lsb first, starting at a random
+    // bit offset
+    std::vector<uint8_t> bits;
+    unsigned int         offset = rand() & 7;
+
+    for (unsigned int i = 0; i < offset; i++)
+    {
+        bits.push_back(0);
+        bits.push_back(1);
+    }
+    for (unsigned int i = 0; i < sizeof(data); i++)
+    {
+        for (unsigned int bit = 0; bit < 8; bit++)
+        {
+            bits.push_back((data[i] >> bit) & 1);
+            bits.push_back(1);
+        }
+    }
+
+    memset(sector.raw, 0, sizeof(sector.raw));
+
+    unsigned int out = 0;
+
+    for (unsigned int i = 0; (i < bits.size()) && (out < sectorRawBytes_c * 8); i++)
+    {
+        if (randomEvent(dropped, sectorRawBytes_c * 8))
+        {
+            continue;
+        }
+
+        unsigned int bit = bits[i] ^ randomEvent(jitter, sectorRawBytes_c * 8);
+
+        sector.raw[out >> 3] |= bit << (7 - (out & 7));
+        out++;
+    }
+
+    sector.track = track;
+}
+
+
+//! time a function over all the sectors
+//!
+//! @return nanoseconds per sector
+//!
+template <typename Func>
+static double
+timeSectors(unsigned int iterations,
+            unsigned int count,
+            Func         func)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    for (unsigned int i = 0; i < iterations; i++)
+    {
+        for (unsigned int sector = 0; sector < count; sector++)
+        {
+            func(sector);
+        }
+    }
+
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    return elapsed.count() / ((double) iterations * count);
+}
+
+
+static void
+report(FILE         *results,
+       const char   *name,
+       double        nsPerSector,
+       unsigned int  bytes,
+       unsigned int  count)
+{
+    fprintf(results, "%s,%.1f,%.2f,%u\n", name, nsPerSector, (bytes * 1000.0) / nsPerSector, count);
+}
+
+
+int main(int argc, char *argv[])
+{
+    unsigned int iterations = 200;
+    unsigned int count      = 400;
+    double       jitter     = 0.5;
+    double       dropped    = 0.1;
+    int          opt;
+
+    while ((opt = getopt(argc, argv, "n:s:j:d:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 's':
+            count = atoi(optarg);
+            break;
+        case 'j':
+            jitter = atof(optarg);
+            break;
+        case 'd':
+            dropped = atof(optarg);
+            break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+
+    std::vector<RawSector> sectors;
+
+    if (optind < argc)
+    {
+        for (int i = optind; i < argc; i++)
+        {
+            if (!loadRawSectors(argv[i], sectors))
+            {
+                return 1;
+            }
+        }
+    }
+    else
+    {
+        srand(17);
+        sectors.resize(count);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            genRawSector(sectors[i], (i / 10) % 40, i % 10, jitter, dropped);
+        }
+    }
+
+    count = sectors.size();
+    if (count == 0)
+    {
+        fprintf(stderr, "No raw sectors found\n");
+        return 1;
+    }
+
+    // the library prints a message for each bad sector, keep them out of the results
+    FILE *results = fdopen(dup(fileno(stdout)), "w");
+
+    if (!results || !freopen("/dev/null", "w", stdout))
+    {
+        fprintf(stderr, "Unable to redirect stdout\n");
+        return 1;
+    }
+
+    std::vector<uint8_t> decoded(count * sectorBytes_c);
+    std::vector<uint8_t> scratch(sectorBytes_c);
+    std::vector<uint8_t> out(sectorBytes_c);
+
+    // histograms, from one pass over the sectors
+    unsigned int statusCounts[numErrorCodes_c] = {};
+    unsigned int cleanSectors = 0;
+    unsigned int zeroSectors  = 0;
+    unsigned int oneSectors   = 0;
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        DecodeContext context;
+
+        Decode::decodeFM(&decoded[i * sectorBytes_c], sectors[i].raw, sectorBytes_c, context);
+
+        cleanSectors += (context.zeroErrors + context.oneErrors) == 0;
+        zeroSectors  += context.zeroErrors != 0;
+        oneSectors   += context.oneErrors != 0;
+
+        int status = processRawSector(sectors[i].raw, out.data(), sectorBytes_c, 0,
+                                      sectors[i].track, 0);
+        if ((status >= 0) && (status < (int) numErrorCodes_c))
+        {
+            statusCounts[status]++;
+        }
+    }
+
+    fprintf(results, "benchmark,ns_per_sector,mb_per_s,sectors\n");
+
+    report(results, "decodeFM", timeSectors(iterations, count, [&](unsigned int i) {
+        DecodeContext context;
+        Decode::decodeFM(scratch.data(), sectors[i].raw, sectorBytes_c, context);
+    }), sectorRawBytes_c, count);
+
+    report(results, "alignSector", timeSectors(iterations, count, [&](unsigned int i) {
+        alignSector(out.data(), &decoded[i * sectorBytes_c], sectorBytes_c);
+    }), sectorBytes_c, count);
+
+    // processSector overwrites its input, so it runs on a copy
+    report(results, "processSector", timeSectors(iterations, count, [&](unsigned int i) {
+        memcpy(scratch.data(), &decoded[i * sectorBytes_c], sectorBytes_c);
+        processSector(scratch.data(), out.data(), sectorBytes_c, 0, sectors[i].track, 0);
+    }), sectorBytes_c, count);
+
+    report(results, "decodeFM+processSector", timeSectors(iterations, count, [&](unsigned int i) {
+        DecodeContext context;
+        Decode::decodeFM(scratch.data(), sectors[i].raw, sectorBytes_c, context);
+        processSector(scratch.data(), out.data(), sectorBytes_c, 0, sectors[i].track, 0);
+    }), sectorRawBytes_c, count);
+
+    report(results, "processRawSector", timeSectors(iterations, count, [&](unsigned int i) {
+        processRawSector(sectors[i].raw, out.data(), sectorBytes_c, 0, sectors[i].track, 0);
+    }), sectorRawBytes_c, count);
+
+    fprintf(results, "\nhistogram,class,count\n");
+    for (unsigned int i = 0; i < numErrorCodes_c; i++)
+    {
+        fprintf(results, "status,%s,%u\n", sectorErrorStrings[i], statusCounts[i]);
+    }
+    fprintf(results, "clock,clean,%u\n", cleanSectors);
+    fprintf(results, "clock,missing_clock,%u\n", zeroSectors);
+    fprintf(results, "clock,extra_clock,%u\n", oneSectors);
+
+    fclose(results);
+
+    return 0;
+}
@@ -1,23 +1,58 @@
 
 #include "h17disk.h"
 
+#include <unistd.h>
 #include <stdio.h>
 
 
 static int usage(char *progName) {
-	fprintf(stderr,"Usage: %s old_h17disk_file new_h17disk_file\n",progName);
+	fprintf(stderr,"Usage: %s [-c | -u] [-d | -e] [-x] old_h17disk_file new_h17disk_file\n",progName);
+	fprintf(stderr,"   -c compress the raw data\n");
+	fprintf(stderr,"   -u uncompress the raw data\n");
+	fprintf(stderr,"   -d store raw sector retries as deltas\n");
+	fprintf(stderr,"   -e expand raw sector deltas\n");
+	fprintf(stderr,"   -x add a track index block\n");
 	return 1;
 }
 
 int main(int argc, char *argv[]) {
     H17Disk *image = new(H17Disk);
 
-    if (argc != 3)
+    int  opt;
+    bool compress   = false;
+    bool uncompress = false;
+    bool delta      = false;
+    bool expand     = false;
+    bool index      = false;
+
+    while ((opt = getopt(argc, argv, "cudex")) != -1) {
+        switch (opt) {
+        case 'c':
+            compress = true;
+            break;
+        case 'u':
+            uncompress = true;
+            break;
+        case 'd':
+            delta = true;
+            break;
+        case 'e':
+            expand = true;
+            break;
+        case 'x':
+            index = true;
+            break;
+        default: /* '?' */
+            return usage(argv[0]);
+        }
+    }
+
+    if ((argc - optind != 2) || (compress && uncompress) || (delta && expand))
     {
         usage(argv[0]);
         return 1;
     }
-    image->loadFile(argv[1]);
+    image->loadFile(argv[optind]);
 
     printf("------------------------\n");
     printf("  Read Complete\n");
@@ -26,8 +61,27 @@ int main(int argc, char *argv[]) {
 
     //image->analyze();
 
+    if (uncompress && !image->decompressRawData())
+    {
+        printf("No raw data to uncompress\n");
+    }
+
+    if ((delta || expand) && !image->deltaRawData(delta))
+    {
+        printf("No uncompressed raw data to change\n");
+    }
+
+    if (compress && !image->compressRawData())
+    {
+        printf("No raw data to compress\n");
+    }
+
+    if (index)
+    {
+        image->writeIndex();
+    }
 
-    image->saveFile(argv[2]);
+    image->saveFile(argv[optind + 1]);
     
     if (image)
     {
@@ -70,7 +70,7 @@ main(int argc, char *argv[])
     }
 
     H17Disk *image = new(H17Disk);
-    if (!image->loadFile(argv[1]))
+    if (!image->mapFile(argv[1]))
     {
         printf("Unable to open file: %s\n", argv[1]);
         return 1;
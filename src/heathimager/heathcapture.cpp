@@ -0,0 +1,324 @@
+//! \file heathcapture.cpp
+//!
+//! Images disks on several FC5025 drives at once, without the GUI.
+//!
+
+#include "capture.h"
+#include "drive.h"
+#include "fc5025_sim.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#define VERSION_STRING "1.2.0"
+
+#define PROG_NAME "HeathCapture"
+
+static volatile sig_atomic_t interrupted = 0;
+
+
+static int usage(char *progName) {
+    fprintf(stderr,"Usage: %s [options] file [file ...]\n",progName);
+    fprintf(stderr,"   each file is imaged on the next drive found, all at once. A file of -\n");
+    fprintf(stderr,"   writes that image to stdout, and the other output goes to stderr\n");
+    fprintf(stderr,"   -l           list the drives and exit\n");
+    fprintf(stderr,"   -s sides     sides of the disks, 1 or 2 (default 1)\n");
+    fprintf(stderr,"   -t tracks    tracks of the disks, 40 or 80 (default 40)\n");
+    fprintf(stderr,"   -r rpm       rpm of the drives, 300 or 360 (default 360)\n");
+    fprintf(stderr,"   -p tpi       tpi of the drives, 48 or 96 (default 96)\n");
+    fprintf(stderr,"   -w           read each track with one command first\n");
+    fprintf(stderr,"   -e           read sectors in even/odd order\n");
+    fprintf(stderr,"   -x           add a track index block, older readers can't load it\n");
+    fprintf(stderr,"   -c comment   comment stored in the files\n");
+    fprintf(stderr,"   -i imager    person imaging the disks\n");
+    fprintf(stderr,"   -S source    simulate a drive for each file, reading 'fm' for made up\n");
+    fprintf(stderr,"                tracks or the raw data of an h17disk file\n");
+    fprintf(stderr,"   -R rpm       speed of the simulated disks (default 360)\n");
+    fprintf(stderr,"   -D mSec      command latency of the simulated drives (default 1)\n");
+    fprintf(stderr,"   -E rate      chance of a simulated sector read error, 0.0 to 1.0\n");
+    fprintf(stderr,"   -B h:t:s     simulated sector that never reads, may be repeated\n");
+    fprintf(stderr,"   -Z seed      seed for the simulated read errors (default 1)\n");
+    return 1;
+}
+
+
+static void
+interrupt(int sig)
+{
+    interrupted = 1;
+}
+
+
+static const char *
+state_text(Capture::State state)
+{
+    switch (state)
+    {
+        case Capture::state_Waiting:
+            return "waiting";
+        case Capture::state_Running:
+            return "reading";
+        case Capture::state_Done:
+            return "done";
+        case Capture::state_Failed:
+            return "failed";
+        case Capture::state_Cancelled:
+            return "cancelled";
+    }
+    return "";
+}
+
+
+//! print a line for each drive
+//!
+//! @param engine
+//!
+static void
+print_progress(CaptureEngine *engine)
+{
+    for (unsigned int i = 0; i < engine->getCaptures(); i++)
+    {
+        Capture *capture = engine->getCapture(i);
+
+        fprintf(stderr, "[%u] %s %s: %-9s T: %2d H: %d  %3u/%u tracks  %u errors  %s\n",
+                i, capture->getDriveId(), capture->getFileName(),
+                state_text(capture->getState()), capture->getTrack(), capture->getSide(),
+                capture->getTracksDone(), capture->getTracksTotal(), capture->getErrors(),
+                capture->getMessage());
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    int         opt;
+    bool        list       = false;
+    uint8_t     sides      = 1;
+    uint8_t     tracks     = 40;
+    uint16_t    rpm        = 360;
+    uint8_t     tpi        = 96;
+    bool        wholeTrack = false;
+    bool        evenOdd    = false;
+    bool        writeIndex = false;
+    const char *comment    = "";
+    const char *imager     = "";
+    const char *simSource  = nullptr;
+    double      simRpm     = 360.0;
+    double      simLatency = 1.0;
+    double      simErrors  = 0.0;
+    uint32_t    simSeed    = 1;
+    std::vector<const char *> simBad;
+
+    while ((opt = getopt(argc, argv, "ls:t:r:p:wexc:i:S:R:D:E:B:Z:")) != -1) {
+        switch (opt) {
+        case 'l':
+            list = true;
+            break;
+        case 's':
+            sides = atoi(optarg);
+            break;
+        case 't':
+            tracks = atoi(optarg);
+            break;
+        case 'r':
+            rpm = atoi(optarg);
+            break;
+        case 'p':
+            tpi = atoi(optarg);
+            break;
+        case 'w':
+            wholeTrack = true;
+            break;
+        case 'e':
+            evenOdd = true;
+            break;
+        case 'x':
+            writeIndex = true;
+            break;
+        case 'c':
+            comment = optarg;
+            break;
+        case 'i':
+            imager = optarg;
+            break;
+        case 'S':
+            simSource = optarg;
+            break;
+        case 'R':
+            simRpm = atof(optarg);
+            break;
+        case 'D':
+            simLatency = atof(optarg);
+            break;
+        case 'E':
+            simErrors = atof(optarg);
+            break;
+        case 'B':
+            simBad.push_back(optarg);
+            break;
+        case 'Z':
+            simSeed = strtoul(optarg, nullptr, 0);
+            break;
+        default: /* '?' */
+            return usage(argv[0]);
+        }
+    }
+
+    if (((sides != 1) && (sides != 2)) || ((tracks != 40) && (tracks != 80)) ||
+        ((rpm != 300) && (rpm != 360)) || ((tpi != 48) && (tpi != 96)) ||
+        (!list && (optind == argc)))
+    {
+        return usage(argv[0]);
+    }
+
+    DriveInfo              *drives    = nullptr;
+    unsigned int            numDrives = 0;
+    FC5025Sim               sim(sides, tracks, tpi);
+    std::vector<DriveInfo>  simDrives;
+
+    if (simSource)
+    {
+        sim.setRpm(simRpm);
+        sim.setLatency(simLatency / 1000.0);
+        sim.setErrorRate(simErrors);
+        sim.setSeed(simSeed);
+
+        for (const char *bad : simBad)
+        {
+            unsigned int side, track, sector;
+
+            if ((sscanf(bad, "%u:%u:%u", &side, &track, &sector) != 3) ||
+                (side >= sides) || (track >= tracks) || (sector >= FC5025Sim::holes_c))
+            {
+                return usage(argv[0]);
+            }
+            sim.addBadSector(side, track, sector);
+        }
+
+        if ((strcmp(simSource, "fm") != 0) && !sim.loadImage(simSource))
+        {
+            fprintf(stderr, "No raw data to simulate in: %s\n", simSource);
+            return 1;
+        }
+
+        // a simulated drive for each file
+        simDrives.resize(list ? 1 : argc - optind);
+        for (unsigned int i = 0; i < simDrives.size(); i++)
+        {
+            snprintf(simDrives[i].id, sizeof(simDrives[i].id), "sim/%u", i);
+            snprintf(simDrives[i].desc, sizeof(simDrives[i].desc), "FC5025 simulator");
+            simDrives[i].usbdev = nullptr;
+            simDrives[i].sim    = &sim;
+        }
+        drives    = simDrives.data();
+        numDrives = simDrives.size();
+    }
+    else
+    {
+        drives = Drive::get_drive_list();
+
+        while (drives && drives[numDrives].usbdev)
+        {
+            numDrives++;
+        }
+    }
+
+    if (list)
+    {
+        for (unsigned int i = 0; i < numDrives; i++)
+        {
+            printf("[%u] %s %s\n", i, drives[i].id, drives[i].desc);
+        }
+        return 0;
+    }
+
+    if ((unsigned int) (argc - optind) > numDrives)
+    {
+        fprintf(stderr, "%d files but only %u drives found\n", argc - optind, numDrives);
+        return 1;
+    }
+
+    // the image written to stdout gets a copy of it, and stdout itself then goes to stderr,
+    // so nothing else printed ends up in the image
+    int stdoutFd = -1;
+
+    for (int i = optind; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-") != 0)
+        {
+            continue;
+        }
+        if (stdoutFd >= 0)
+        {
+            fprintf(stderr, "Only one file can be written to stdout\n");
+            return 1;
+        }
+        fflush(stdout);
+        stdoutFd = dup(STDOUT_FILENO);
+        if ((stdoutFd < 0) || (dup2(STDERR_FILENO, STDOUT_FILENO) < 0))
+        {
+            fprintf(stderr, "Unable to write to stdout\n");
+            return 1;
+        }
+    }
+
+    CaptureEngine engine;
+    std::string   program = PROG_NAME;
+
+    program += " ";
+    program += VERSION_STRING;
+
+    for (int i = optind; i < argc; i++)
+    {
+        Capture *capture = new Capture(&drives[i - optind], argv[i], sides, tracks, tpi, rpm);
+
+        capture->setWholeTrack(wholeTrack);
+        capture->setOrder(evenOdd ? ReadScheduler::order_EvenOdd :
+                                    ReadScheduler::order_Rotational);
+        capture->setWriteIndex(writeIndex);
+        capture->setComment(comment);
+        capture->setImager(imager);
+        capture->setProgram(program.c_str());
+        if (strcmp(argv[i], "-") == 0)
+        {
+            capture->setOutputFd(stdoutFd);
+        }
+        engine.addCapture(capture);
+    }
+
+    signal(SIGINT, interrupt);
+
+    engine.start();
+
+    while (!engine.isDone())
+    {
+        if (interrupted == 1)
+        {
+            engine.cancel();
+            interrupted = 2;
+        }
+        print_progress(&engine);
+        sleep(1);
+    }
+    engine.wait();
+    print_progress(&engine);
+
+    if (stdoutFd >= 0)
+    {
+        close(stdoutFd);
+    }
+
+    for (unsigned int i = 0; i < engine.getCaptures(); i++)
+    {
+        if (engine.getCapture(i)->getState() != Capture::state_Done)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
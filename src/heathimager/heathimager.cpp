@@ -4,13 +4,13 @@
 #include <unistd.h>
 #include <ctime>
 
-#include "disk.h"
-#include "heath_hs.h"
+#include <string>
+#include <thread>
+
+#include "capture.h"
 #include "drive.h"
 #include "fc5025.h"
-#include "h17disk.h"
-#include "disk_util.h"
-#include "raw_sector.h"
+#include "read_scheduler.h"
 
 #define VERSION_STRING "1.2.0"
 
@@ -30,9 +30,6 @@ static GtkWidget              *captureButton,
 GtkWidget                     *listbox,
                               *pop_button;
 
-static int                     errorCount;
-static float progress;
-
 static int                     selected_item_type;
 static char                   *selected_item_name;
 static int                     modal           = 0;
@@ -48,6 +45,8 @@ static uint8_t                 dist_status     = 0;
 static uint8_t                 drive_tpi       = 96;
 static uint16_t                drive_rpm       = 360;
 static uint8_t                 drive_sides     = 2;
+static bool                    whole_track     = false;
+static bool                    rotational      = true;
 
 static uint8_t                 disk_tracks     = 40;
 static uint8_t                 disk_sides      = 1;
@@ -59,115 +58,28 @@ static GtkTextBuffer          *textBufferImager;
 //using namespace std;
 
 
-bool fileExists(char *name)
-{
-    if (FILE *file = fopen(name, "r"))
-    {
-        fclose(file);
-        return true;
-    }
-    else
-    {
-        return false;
-    }
-}
-
-
-void
-addDateToFile(H17Disk *image)
-{
-    std::time_t time = std::time(nullptr);
-    struct tm *timeInfo;
-    char timeString[100];
-
-    timeInfo = gmtime(&time);
-
-    uint32_t length = strftime(timeString, 100, "%c", timeInfo);
-
-    if (length)
-    {
-        image->writeDate((unsigned char *) timeString, length + 1);
-    }
-}
-
-
-void
-addProgramToFile(H17Disk *image)
-{
-    std::string  programName;
-
-    programName = PROG_NAME;
-    programName +=  " ";
-    programName +=  VERSION_STRING;
-    uint32_t length = programName.length();
-
-    if (length)
-    {
-        image->writeProgram((unsigned char *) programName.c_str(), length + 1);
-    }
-}
-
-
-void
-addLabelToFile(H17Disk *image)
+//! get the text of a text buffer
+//!
+//! @param textBuffer
+//!
+//! @return text
+//!
+static std::string
+getBufferText(GtkTextBuffer *textBuffer)
 {
     GtkTextIter    start,
                    end;
-    size_t         length;
     gchar         *text;
 
-    gtk_text_buffer_get_bounds(textBufferLabel, &start, &end);
-
-    text = gtk_text_buffer_get_text (textBufferLabel, &start, &end, TRUE);
-    length = strlen(text);
-
-    if (length)
-    {
-        image->writeLabel((unsigned char *)text, (uint32_t) length + 1);
-    }
-    g_free(text);
-}
+    gtk_text_buffer_get_bounds(textBuffer, &start, &end);
 
+    text = gtk_text_buffer_get_text(textBuffer, &start, &end, TRUE);
 
-void
-addCommentToFile(H17Disk *image)
-{
-    GtkTextIter    start,
-                   end;
-    size_t         length;
-    gchar         *text;
+    std::string value = text;
 
-    gtk_text_buffer_get_bounds(textBufferComment, &start, &end);
-
-    text = gtk_text_buffer_get_text (textBufferComment, &start, &end, TRUE);
-    length = strlen(text);
-
-    if (length)
-    {
-        image->writeComment((unsigned char *)text, (uint32_t) length + 1);
-    }
     g_free(text);
-}
-
-
-void
-addImagerToFile(H17Disk *image)
-{
-    GtkTextIter    start,
-                   end;
-    size_t         length;
-    gchar         *text;
-
-    gtk_text_buffer_get_bounds(textBufferImager, &start, &end);
 
-    text = gtk_text_buffer_get_text (textBufferImager, &start, &end, TRUE);
-    length = strlen(text);
-
-    if (length > 1)
-    {
-        image->writeImager((unsigned char *)text, (uint32_t) length + 1);
-    }
-    g_free(text);
+    return value;
 }
 
 
@@ -234,148 +146,6 @@ destroy_filew(GtkWidget * widget, gpointer gdata)
 }
 
 
-static void
-read_one_sector(H17Disk       *image,
-                Disk          *disk,
-                int            track,
-                int            side,
-                int            sector,
-                GtkWidget     *error_label)
-{
-    const int      maxRetries_c = 6;
-    uint8_t        buf[HeathHSDisk::defaultSectorBytes()];
-    uint8_t        rawBuf[HeathHSDisk::defaultSectorRawBytes()];
-    char           errtext[80];
-    int            retVal;
-    int            retryCount = 0;
-
-    do
-    {
-        retVal = disk->readSector(buf, rawBuf, side, track, sector);
-        if (retVal != 0)
-        {
-            snprintf(errtext, sizeof(errtext), "Failed on attempt: %d: %d H: %d T: %d S:%d",
-                     retryCount, retVal, side, track, sector);
-            gtk_label_set_text(GTK_LABEL(error_label), errtext);
-            refresh_screen();
-        }
-
-        // If it was a read error, then raw bytes are not valid, otherwise store raw
-        if (retVal != Err_ReadError)
-        {
-            //printf("writing raw sector - side: %d track: %d sector: %d\n", side, track, sector);
-            image->addRawSector(sector, rawBuf, disk->sectorRawBytes(side, track, sector));
-        }
-    }
-    while ((retVal != 0) && (retryCount++ < maxRetries_c));
-
-    // even if there is an error, use the last processed sector for storage, unless
-    // it was an error of type - read error.
-    //
-    if (retVal == Err_ReadError)
-    {
-        //printf("read error writing empty raw sector -  side: %d track: %d sector: %d\n", side, track, sector);
-        image->addSector(sector, retVal, nullptr, 0);
-    }
-    else
-    {
-        //printf("writing good sector - side: %d track: %d sector: %d\n", side, track, sector);
-        image->addSector(sector, retVal, buf, disk->sectorBytes(side, track, sector));
-    }
-
-    if (retVal != 0)
-    {
-        errorCount++;
-        snprintf(errtext, sizeof(errtext), "Failed after %d attempts: %d H: %d T: %d S:%d",
-                 maxRetries_c, retVal, side, track, sector);
-        gtk_label_set_text(GTK_LABEL(error_label), errtext);
-        refresh_screen();
-    }
-    else
-    {
-        snprintf(errtext, sizeof(errtext), "Passed after %d attempts -  H: %d T: %d S:%d",
-                 retryCount, side, track, sector);
-        gtk_label_set_text(GTK_LABEL(error_label), errtext);
-        refresh_screen();
-    }
-}
-
-
-void
-increment_progressbar(GtkWidget * progressbar, float progress_per_halftrack)
-{
-    progress += progress_per_halftrack;
-    if (progress > 1.0)
-    {
-        progress = 1.0;
-    }
-    gtk_progress_set_percentage(GTK_PROGRESS(progressbar), progress);
-}
-
-
-int
-image_track(H17Disk    *image,
-            Disk       *disk,
-            int         track,
-            int         side,
-            GtkWidget  *status_label,
-            GtkWidget  *error_label,
-            GtkWidget  *progressbar,
-            float       progress_per_halftrack)
-{
-    SectorList              *sector_list,
-                            *sector_entry;
-    int                      num_sectors = disk->numSectors(track, side);
-    int                      halfway_mark = num_sectors >> 1;
-    std::vector<RawSector *> rawSectors;
-    std::vector<Sector *>    sectors;
-
-    if (FC5025::inst()->seek(disk->physicalTrack(track)) != 0)
-    {
-        gtk_label_set_text(GTK_LABEL(status_label), "Unable to seek to track! Giving up.");
-        return 1;
-    }
-    refresh_screen();
-
-    sector_list = (SectorList *) malloc(sizeof(SectorList) * num_sectors);
-    if (!sector_list)
-    {
-        gtk_label_set_text(GTK_LABEL(status_label), "Out of memory! Giving up.");
-        return 1;
-    }
-
-    disk->genBestReadOrder(sector_list, track, side);
-
-    sector_entry = sector_list;
-    image->startTrack(side, track);
-
-    while (num_sectors--)
-    {
-        //printf("%s: reading one sector: %d\n", __FUNCTION__, sector_entry->sector);
-        read_one_sector(image, disk, track, side, sector_entry->sector, error_label);
-        if (img_cancelled)
-        {
-            gtk_label_set_text(GTK_LABEL(status_label), "Cancelled.");
-            free(sector_list);
-            return 1;
-        }
-        if (num_sectors == halfway_mark)
-        {
-            increment_progressbar(progressbar, progress_per_halftrack);
-            refresh_screen();
-        }
-        sector_entry++;
-    }
-    free(sector_list);
-    increment_progressbar(progressbar, progress_per_halftrack);
-    refresh_screen();
-
-    image->endTrack();
-    refresh_screen();
-    return 0;
-}
-
-
 /// \todo make sure file does not already exist.
 void
 auto_increment_filename(void)
@@ -591,7 +361,7 @@ diskInfoPressed(GtkWidget * widget, gpointer gdata)
     }
     while (!diskinfoStop)
     {
-        if ((retVal = FC5025::inst()->driveStatus(&track, &speed, &sectorCount, &flags)) != 0)
+        if ((retVal = drive.getController()->driveStatus(&track, &speed, &sectorCount, &flags)) != 0)
         {
             gtk_label_set_text(GTK_LABEL(errorLabel), "Unable to get drive status");
             gtk_widget_set_sensitive(doneButton, 1);
@@ -659,7 +429,7 @@ testBoardPressed(GtkWidget * widget, gpointer gdata)
     while (!testBoardDone)
     {
     /*
-        if ((retVal = FC5025::inst()->driveStatus(&track, &speed, &sectorCount, &flags)) != 0)
+        if ((retVal = drive.getController()->driveStatus(&track, &speed, &sectorCount, &flags)) != 0)
         {
             gtk_label_set_text(GTK_LABEL(errorLabel), "Unable to get drive status");
             gtk_widget_set_sensitive(doneButton, 1);
@@ -685,6 +455,9 @@ testBoardPressed(GtkWidget * widget, gpointer gdata)
 }
 
 /// Start imaging a disk.
+///
+/// The capture runs on a thread of its own, the same as in heathcapture, and this polls
+/// its progress to update the dialog.
 void
 capturePressed(GtkWidget * widget, gpointer gdata)
 {
@@ -697,22 +470,18 @@ capturePressed(GtkWidget * widget, gpointer gdata)
     GtkWidget      *status_label = gtk_label_new("Preparing...");
     GtkWidget      *error_label  = gtk_label_new("");
     GtkWidget      *button_label = gtk_label_new("In progress...");
-    float           progress_per_halftrack;
-    Disk           *disk         = new HeathHSDisk(disk_sides, disk_tracks, drive_tpi, drive_rpm);
-    int             track,
-                    side;
     //char           *in_filename;
     char           *out_filename;
     gint            delete_signal;
-    H17Disk        *image;
-    Drive           drive(selected_drive);
+    std::string     program      = PROG_NAME;
+    bool            cancelSent   = false;
     // TODO have a way to restart a capture without starting from scratch, should read
     // in the existing image file, and determine which sectors are good/bad and re-read the
     // bad ones
     //bool            recovery;
 
-    progress = 0;
-    errorCount = 0;
+    program += " ";
+    program += VERSION_STRING;
 
     gtk_window_set_title(GTK_WINDOW(image_window), "Capturing Disk Image File...");
     delete_signal = gtk_signal_connect(GTK_OBJECT(image_window), "delete_event",
@@ -750,14 +519,6 @@ capturePressed(GtkWidget * widget, gpointer gdata)
     gtk_grab_add(image_window);
     refresh_screen();
 
-    if (drive.getStatus() != 0)
-    {
-        imgFailed(image_window, delete_signal, status_label, button_label,
-                  button, cancelButton, (char *) "Unable to open drive.");
-        return;
-    }
-    refresh_screen();
-
     // if (strlen(gtk_entry_get_text(GTK_ENTRY(in_fname_field))) != 0)
     // {
     //     recovery = true;
@@ -789,107 +550,76 @@ capturePressed(GtkWidget * widget, gpointer gdata)
     strcat(out_filename, DIRECTORY_SEPARATOR);
     strcat(out_filename, gtk_entry_get_text(GTK_ENTRY(fname_field)));
 
-    if (fileExists(out_filename))
-    {
-        imgFailed(image_window, delete_signal, status_label, button_label,
-                  button, cancelButton, (char *) "File already exists!");
-        return;
-    }
-    image = new H17Disk();
-    // if (recovery)
-    // {
-    //    image->openForRecovery(in_filename);
-    // }
-
-    if (!image->openForWrite(out_filename))
-    {
-        imgFailed(image_window, delete_signal, status_label, button_label,
-                  button, cancelButton, (char *) "File can not be opened!");
-        return;
-    }
-
-    if (FC5025::inst()->recalibrate() != 0)
-    {
-        image->closeFile();
-        imgFailed(image_window, delete_signal, status_label, button_label,
-                  button, cancelButton, (char *) "Unable to recalibrate drive.");
-        return;
-    }
-    refresh_screen();
+    Capture capture(selected_drive, out_filename, disk_sides, disk_tracks, drive_tpi, drive_rpm);
 
-    if (FC5025::inst()->setDensity(disk->density()) != 0)
-    {
-        image->closeFile();
-        imgFailed(image_window, delete_signal, status_label, button_label,
-                  button, cancelButton, (char *) "Unable to set density.");
-        return;
-    }
-    refresh_screen();
+    free(out_filename);
 
-    // print file header for this disk
-    //
-    image->writeHeader();
-    image->setSides(disk->numSides());
-    image->setTracks(disk->numTracks());
-    image->writeDiskFormatBlock();
-
-    image->setWPParameter(wpDisk);
-    image->setDistributionParameter(dist_status);
-    image->setTrackDataParameter(3);
-    image->writeParameters();
-    addLabelToFile(image);
-    addCommentToFile(image);
-    addDateToFile(image);
-    addImagerToFile(image);
-    addProgramToFile(image);
-    image->startData();
+    capture.setWholeTrack(whole_track);
+    capture.setOrder(rotational ? ReadScheduler::order_Rotational :
+                                  ReadScheduler::order_EvenOdd);
+    capture.setWriteProtect(wpDisk);
+    capture.setDistribution(dist_status);
+    capture.setLabel(getBufferText(textBufferLabel).c_str());
+    capture.setComment(getBufferText(textBufferComment).c_str());
+    capture.setImager(getBufferText(textBufferImager).c_str());
+    capture.setProgram(program.c_str());
 
     img_cancelled = 0;
     gtk_widget_set_sensitive(cancelButton, 1);
     refresh_screen();
 
-    progress_per_halftrack = (float) 1 / (float) (disk->numTracks() *
-                             disk->numSides() * 2);
+    std::thread captureThread(&Capture::run, &capture);
 
-    for (track = disk->minTrack(); track <= disk->maxTrack(); track++)
+    while ((capture.getState() == Capture::state_Waiting) ||
+           (capture.getState() == Capture::state_Running))
     {
-        for (side = disk->minSide(); side <= disk->maxSide(); side++)
+        if (img_cancelled && !cancelSent)
         {
-            if (disk->numSides() == 1)
-            {
-                snprintf(status_text, sizeof(status_text), "Reading track %d...\n", track);
-            }
-            else
-            {
-                snprintf(status_text, sizeof(status_text), "Reading track %d side %d...\n",
-                         track, side);
-            }
-            gtk_label_set_text(GTK_LABEL(status_label), status_text);
-            refresh_screen();
-
-            // image the track
-            if (image_track(image, disk, track, side, status_label, error_label, progressbar,
-                            progress_per_halftrack) != 0)
-            {
-                image->endDataBlock();
-                image->writeRawDataBlock();
-                image->closeFile();
-                imgFailed(image_window, delete_signal, status_label, button_label,
-                          button, cancelButton, NULL);
-                return;
-            }
+            capture.cancel();
+            cancelSent = true;
         }
-    }
-    image->endDataBlock();
-    image->writeRawDataBlock();
 
-    image->closeFile();
+        if (disk_sides == 1)
+        {
+            snprintf(status_text, sizeof(status_text), "Reading track %d...\n",
+                     capture.getTrack());
+        }
+        else
+        {
+            snprintf(status_text, sizeof(status_text), "Reading track %d side %d...\n",
+                     capture.getTrack(), capture.getSide());
+        }
+        gtk_label_set_text(GTK_LABEL(status_label), status_text);
+
+        if (capture.getErrors())
+        {
+            char errtext[80];
+
+            snprintf(errtext, sizeof(errtext), "Sectors with errors: %u", capture.getErrors());
+            gtk_label_set_text(GTK_LABEL(error_label), errtext);
+        }
+
+        gtk_progress_set_percentage(GTK_PROGRESS(progressbar),
+                                    (float) capture.getTracksDone() / capture.getTracksTotal());
+        refresh_screen();
+        usleep(50000);
+    }
+    captureThread.join();
 
     // commenting this out for now, when the head is left at a
     // high sector, it's easier to clean head with q-tip. 
-    //FC5025::inst()->seek(0);
+    //drive.getController()->seek(0);
 
-    if (!errorCount)
+    if (capture.getState() != Capture::state_Done)
+    {
+        imgFailed(image_window, delete_signal, status_label, button_label,
+                  button, cancelButton, (char *) capture.getMessage());
+        return;
+    }
+
+    gtk_progress_set_percentage(GTK_PROGRESS(progressbar), 1.0);
+
+    if (!capture.getErrors())
     {
         gtk_label_set_text(GTK_LABEL(status_label), "Successfully read disk.");
         gtk_label_set_text(GTK_LABEL(button_label), "Yay!");
@@ -897,7 +627,8 @@ capturePressed(GtkWidget * widget, gpointer gdata)
     else
     {
         char statusText[60];
-        snprintf(statusText, sizeof(statusText), "Total of %d sectors had errors\n", errorCount);
+        snprintf(statusText, sizeof(statusText), "Total of %u sectors had errors\n",
+                 capture.getErrors());
 
         gtk_label_set_text(GTK_LABEL(status_label), statusText);
         gtk_label_set_text(GTK_LABEL(button_label), "Bummer.");
@@ -1034,6 +765,62 @@ add_drive_sides(GtkWidget *menu)
     gtk_menu_set_active(GTK_MENU(menu), 1);
 }
 
+void
+sector_order_changed(GtkWidget *widget, gpointer data)
+{
+    rotational = *(bool *) data;
+}
+
+
+void
+add_sector_order(GtkWidget *menu)
+{
+    GtkWidget       *mitem;
+    static bool      value[2] = {false, true};
+
+    mitem = gtk_menu_item_new_with_label("Even then odd");
+    gtk_menu_append(GTK_MENU(menu), mitem);
+    gtk_widget_show(mitem);
+    gtk_signal_connect(GTK_OBJECT(mitem), "activate",
+                       GTK_SIGNAL_FUNC(sector_order_changed), &value[0]);
+
+    mitem = gtk_menu_item_new_with_label("Rotational");
+    gtk_menu_append(GTK_MENU(menu), mitem);
+    gtk_widget_show(mitem);
+    gtk_signal_connect(GTK_OBJECT(mitem), "activate",
+                       GTK_SIGNAL_FUNC(sector_order_changed), &value[1]);
+
+    gtk_menu_set_active(GTK_MENU(menu), 1);
+}
+
+
+void
+read_mode_changed(GtkWidget *widget, gpointer data)
+{
+    whole_track = *(bool *) data;
+}
+
+
+void
+add_read_mode(GtkWidget *menu)
+{
+    GtkWidget       *mitem;
+    static bool      value[2] = {false, true};
+
+    mitem = gtk_menu_item_new_with_label("Sector at a time");
+    gtk_menu_append(GTK_MENU(menu), mitem);
+    gtk_widget_show(mitem);
+    gtk_signal_connect(GTK_OBJECT(mitem), "activate",
+                       GTK_SIGNAL_FUNC(read_mode_changed), &value[0]);
+
+    mitem = gtk_menu_item_new_with_label("Whole track");
+    gtk_menu_append(GTK_MENU(menu), mitem);
+    gtk_widget_show(mitem);
+    gtk_signal_connect(GTK_OBJECT(mitem), "activate",
+                       GTK_SIGNAL_FUNC(read_mode_changed), &value[1]);
+}
+
+
 void
 drive_tpi_changed(GtkWidget *widget, gpointer data)
 {
@@ -1206,6 +993,10 @@ main(int argc, char *argv[])
                    *driveSidesDrop_Menu,
                    *driveTpiDrop,
                    *driveTpiDrop_Menu,
+                   *readModeDrop,
+                   *readModeDrop_Menu,
+                   *sectorOrderDrop,
+                   *sectorOrderDrop_Menu,
                    *distdrop,
                    *distdrop_menu,
                    *wpDrop,
@@ -1369,6 +1160,30 @@ main(int argc, char *argv[])
     gtk_container_add(GTK_CONTAINER(subFrame), driveTpiDrop);
     gtk_widget_show(driveTpiDrop);
 
+    // Read mode
+    subFrame = gtk_frame_new("Read Mode");
+    gtk_box_pack_start(GTK_BOX(optionBox), subFrame, FALSE, FALSE, 5);
+    gtk_widget_show(subFrame);
+
+    readModeDrop = gtk_option_menu_new();
+    readModeDrop_Menu = gtk_menu_new();
+    add_read_mode(readModeDrop_Menu);
+    gtk_option_menu_set_menu(GTK_OPTION_MENU(readModeDrop), readModeDrop_Menu);
+    gtk_container_add(GTK_CONTAINER(subFrame), readModeDrop);
+    gtk_widget_show(readModeDrop);
+
+    // Sector order
+    subFrame = gtk_frame_new("Sector Order");
+    gtk_box_pack_start(GTK_BOX(optionBox), subFrame, FALSE, FALSE, 5);
+    gtk_widget_show(subFrame);
+
+    sectorOrderDrop = gtk_option_menu_new();
+    sectorOrderDrop_Menu = gtk_menu_new();
+    add_sector_order(sectorOrderDrop_Menu);
+    gtk_option_menu_set_menu(GTK_OPTION_MENU(sectorOrderDrop), sectorOrderDrop_Menu);
+    gtk_container_add(GTK_CONTAINER(subFrame), sectorOrderDrop);
+    gtk_widget_show(sectorOrderDrop);
+
 
     gtk_widget_show(optionBox);
 
@@ -0,0 +1,356 @@
+//! \file async_writer.cpp
+//!
+//! Stream buffer that writes to a file from a background thread.
+//!
+
+#include "async_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+
+//! constructor
+//!
+//! @param maxChunks   number of chunks that can be waiting to be written
+//! @param chunkSize   size of a chunk, a flush() can hand over a smaller one
+//!
+AsyncWriter::AsyncWriter(unsigned int maxChunks,
+                         unsigned int chunkSize): fd_m(-1),
+                                                  ownFd_m(false),
+                                                  maxChunks_m(maxChunks ? maxChunks : 1),
+                                                  chunkSize_m(chunkSize ? chunkSize : 1),
+                                                  buf_m(chunkSize_m),
+                                                  bufPos_m(0),
+                                                  done_m(false),
+                                                  error_m(false)
+{
+    setp(buf_m.data(), buf_m.data() + chunkSize_m);
+}
+
+
+//! destructor
+//!
+AsyncWriter::~AsyncWriter()
+{
+    if (isOpen())
+    {
+        close();
+    }
+}
+
+
+//! open a file and start the I/O thread
+//!
+//! @param name       file name
+//!
+//! @return success
+//!
+bool
+AsyncWriter::open(const char *name)
+{
+    if (isOpen())
+    {
+        return false;
+    }
+
+    fd_m = ::open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd_m < 0)
+    {
+        return false;
+    }
+
+    ownFd_m = true;
+    start(0);
+
+    return true;
+}
+
+
+//! start writing to an open file descriptor, such as a pipe, it is left open by close()
+//!
+//! The chunks are written in order, so the stream can't seek, and its position counts
+//! the bytes written since it was opened.
+//!
+//! @param fd         file descriptor
+//!
+//! @return success
+//!
+bool
+AsyncWriter::open(int fd)
+{
+    if (isOpen() || (fd < 0))
+    {
+        return false;
+    }
+
+    fd_m    = fd;
+    ownFd_m = false;
+    start(0);
+
+    return true;
+}
+
+
+//! start the I/O thread
+//!
+//! @param pos        position of the first byte written
+//!
+void
+AsyncWriter::start(off_t pos)
+{
+    bufPos_m = pos;
+    done_m   = false;
+    error_m  = false;
+    setp(buf_m.data(), buf_m.data() + chunkSize_m);
+
+    thread_m = std::thread(&AsyncWriter::run, this);
+}
+
+
+//! write out everything queued, then sync it to the disk and close the file if it was
+//! opened by name
+//!
+//! @return success, false if any write failed
+//!
+bool
+AsyncWriter::close()
+{
+    if (!isOpen())
+    {
+        return false;
+    }
+
+    queueChunk();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_m);
+
+        done_m = true;
+    }
+    notEmpty_m.notify_one();
+
+    thread_m.join();
+
+    bool status = !error_m;
+
+    if (ownFd_m)
+    {
+        if (fsync(fd_m) != 0)
+        {
+            printf("%s - fsync failed: %s\n", __FUNCTION__, strerror(errno));
+            status = false;
+        }
+
+        if (::close(fd_m) != 0)
+        {
+            status = false;
+        }
+    }
+
+    fd_m    = -1;
+    ownFd_m = false;
+
+    return status;
+}
+
+
+//! check if a file is open
+//!
+//! @return if open
+//!
+bool
+AsyncWriter::isOpen()
+{
+    return fd_m >= 0;
+}
+
+
+//! hand the current chunk to the I/O thread, waiting if the queue is full
+//!
+void
+AsyncWriter::queueChunk()
+{
+    std::ptrdiff_t size = pptr() - pbase();
+
+    if (size == 0)
+    {
+        return;
+    }
+
+    Chunk chunk = { bufPos_m, std::vector<char>(pbase(), pptr()) };
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_m);
+
+        notFull_m.wait(lock, [this] { return queue_m.size() < maxChunks_m; });
+        queue_m.push_back(std::move(chunk));
+    }
+    notEmpty_m.notify_one();
+
+    bufPos_m += size;
+    setp(buf_m.data(), buf_m.data() + chunkSize_m);
+}
+
+
+//! I/O thread, writes the chunks in the order they were queued
+//!
+void
+AsyncWriter::run()
+{
+    while (true)
+    {
+        std::unique_lock<std::mutex> lock(mutex_m);
+
+        notEmpty_m.wait(lock, [this] { return !queue_m.empty() || done_m; });
+
+        if (queue_m.empty())
+        {
+            break;
+        }
+
+        Chunk chunk = std::move(queue_m.front());
+
+        queue_m.pop_front();
+        lock.unlock();
+        notFull_m.notify_one();
+
+        // after an error keep draining the queue, so the writer doesn't block
+        if (error_m)
+        {
+            continue;
+        }
+
+        size_t written = 0;
+
+        while (written < chunk.data.size())
+        {
+            ssize_t count = ownFd_m ? pwrite(fd_m, &chunk.data[written],
+                                             chunk.data.size() - written,
+                                             chunk.pos + written) :
+                                      write(fd_m, &chunk.data[written],
+                                            chunk.data.size() - written);
+
+            if (count < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                printf("%s - write failed: %s\n", __FUNCTION__, strerror(errno));
+
+                std::lock_guard<std::mutex> guard(mutex_m);
+
+                error_m = true;
+                break;
+            }
+            written += count;
+        }
+    }
+}
+
+
+//! chunk is full, queue it and start a new one
+//!
+//! @param ch   character that didn't fit
+//!
+//! @return ch, or eof on failure
+//!
+AsyncWriter::int_type
+AsyncWriter::overflow(int_type ch)
+{
+    if (!isOpen())
+    {
+        return traits_type::eof();
+    }
+
+    queueChunk();
+
+    if (!traits_type::eq_int_type(ch, traits_type::eof()))
+    {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+
+    return traits_type::not_eof(ch);
+}
+
+
+//! queue the current chunk, called by flush()
+//!
+//! @return 0 on success, -1 if the file is not open or a write failed
+//!
+int
+AsyncWriter::sync()
+{
+    if (!isOpen())
+    {
+        return -1;
+    }
+
+    queueChunk();
+
+    std::lock_guard<std::mutex> lock(mutex_m);
+
+    return error_m ? -1 : 0;
+}
+
+
+//! seek relative to the start or the current position, used by tellp() and seekp()
+//!
+//! @param off
+//! @param dir
+//! @param which
+//!
+//! @return new position, -1 on failure
+//!
+AsyncWriter::pos_type
+AsyncWriter::seekoff(off_type                off,
+                     std::ios_base::seekdir  dir,
+                     std::ios_base::openmode which)
+{
+    off_type cur = bufPos_m + (pptr() - pbase());
+
+    if (dir == std::ios_base::cur)
+    {
+        if (off == 0)
+        {
+            return pos_type(cur);
+        }
+        return seekpos(pos_type(cur + off), which);
+    }
+
+    if (dir == std::ios_base::beg)
+    {
+        return seekpos(pos_type(off), which);
+    }
+
+    // the end of the file is not tracked
+    return pos_type(off_type(-1));
+}
+
+
+//! seek to a position, the following writes go to a new chunk
+//!
+//! @param pos
+//! @param which
+//!
+//! @return new position, -1 on failure or if the file can't seek
+//!
+AsyncWriter::pos_type
+AsyncWriter::seekpos(pos_type                pos,
+                     std::ios_base::openmode which)
+{
+    if (!(which & std::ios_base::out) || (off_type(pos) < 0) || !ownFd_m)
+    {
+        return pos_type(off_type(-1));
+    }
+
+    queueChunk();
+    bufPos_m = off_type(pos);
+
+    return pos;
+}
@@ -0,0 +1,89 @@
+//! \file async_writer.h
+//!
+//! Stream buffer that writes to a file from a background thread.
+//!
+
+#ifndef __ASYNC_WRITER_H__
+#define __ASYNC_WRITER_H__
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+
+
+//! Output stream buffer for a file, the data is handed to an I/O thread in chunks, so
+//! the writing thread only waits when the queue of chunks is full.
+//!
+//! Each chunk is written at the position it was produced at, so seeking back to
+//! update an earlier field works as it does with a std::ofstream. Calling flush()
+//! on the stream hands the current chunk to the I/O thread.
+//!
+//! An open file descriptor, such as a pipe, can be written instead of a named file.
+//! Its chunks are written in order, and only the position can be read.
+//!
+class AsyncWriter: public std::streambuf
+{
+public:
+
+    AsyncWriter(unsigned int maxChunks = defaultMaxChunks_c,
+                unsigned int chunkSize = defaultChunkSize_c);
+    virtual ~AsyncWriter();
+
+    bool open(const char *name);
+    bool open(int fd);
+    bool close();
+    bool isOpen();
+
+    static const unsigned int defaultMaxChunks_c = 32;
+    static const unsigned int defaultChunkSize_c = 64 * 1024;
+
+protected:
+
+    virtual int_type        overflow(int_type ch);
+    virtual int             sync();
+    virtual pos_type        seekoff(off_type                off,
+                                    std::ios_base::seekdir  dir,
+                                    std::ios_base::openmode which);
+    virtual pos_type        seekpos(pos_type                pos,
+                                    std::ios_base::openmode which);
+
+private:
+
+    struct Chunk
+    {
+        off_t             pos;
+        std::vector<char> data;
+    };
+
+    void start(off_t pos);
+    void queueChunk();
+    void run();
+
+    int                     fd_m;
+
+    // the file was opened by name, it is written at the chunk positions and closed by
+    // close(). Otherwise the chunks are written in order and the file is left open.
+    bool                    ownFd_m;
+    unsigned int            maxChunks_m;
+    unsigned int            chunkSize_m;
+
+    // chunk being filled, and the file position of its first byte
+    std::vector<char>       buf_m;
+    off_t                   bufPos_m;
+
+    std::deque<Chunk>       queue_m;
+    std::mutex              mutex_m;
+    std::condition_variable notEmpty_m;
+    std::condition_variable notFull_m;
+    bool                    done_m;
+    bool                    error_m;
+
+    std::thread             thread_m;
+};
+
+#endif
@@ -0,0 +1,788 @@
+//! \file capture.cpp
+//!
+//! Images hard-sectored disks into h17disk files, on several drives at once.
+//!
+
+#include "capture.h"
+#include "async_writer.h"
+#include "disk_util.h"
+#include "fc5025.h"
+#include "h17disk.h"
+#include "heath_hs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctime>
+#include <ostream>
+
+
+//! constructor
+//!
+//! @param driveInfo   drive to image on, copied so the drive list can be changed
+//! @param fileName    h17disk file to create
+//! @param sides       number of sides of the disk
+//! @param tracks      number of tracks of the disk
+//! @param driveTpi    tpi of the drive
+//! @param driveRpm    rpm of the drive
+//!
+Capture::Capture(const DriveInfo *driveInfo,
+                 const char      *fileName,
+                 uint8_t          sides,
+                 uint8_t          tracks,
+                 uint8_t          driveTpi,
+                 uint16_t         driveRpm): driveInfo_m(*driveInfo),
+                                             fileName_m(fileName),
+                                             disk_m(new HeathHSDisk(sides, tracks, driveTpi,
+                                                                    driveRpm)),
+                                             drive_m(nullptr),
+                                             wholeTrack_m(false),
+                                             order_m(ReadScheduler::order_Rotational),
+                                             wp_m(false),
+                                             writeIndex_m(false),
+                                             distribution_m(0),
+                                             outputFd_m(-1),
+                                             state_m(state_Waiting),
+                                             message_m(""),
+                                             track_m(0),
+                                             side_m(0),
+                                             tracksDone_m(0),
+                                             errors_m(0),
+                                             cancelled_m(false)
+{
+
+}
+
+
+//! destructor
+//!
+Capture::~Capture()
+{
+    delete drive_m;
+    delete disk_m;
+}
+
+
+//! read each track with one command before retrying sectors one at a time
+//!
+//! @param wholeTrack
+//!
+void
+Capture::setWholeTrack(bool wholeTrack)
+{
+    wholeTrack_m = wholeTrack;
+}
+
+
+//! set the order to read the sectors of a track in
+//!
+//! @param order
+//!
+void
+Capture::setOrder(ReadScheduler::Order order)
+{
+    order_m = order;
+}
+
+
+//! set if the disk is write protected
+//!
+//! @param wp
+//!
+void
+Capture::setWriteProtect(bool wp)
+{
+    wp_m = wp;
+}
+
+
+//! add a track index block to the file, older readers can't load files with one
+//!
+//! @param writeIndex
+//!
+void
+Capture::setWriteIndex(bool writeIndex)
+{
+    writeIndex_m = writeIndex;
+}
+
+
+//! set the distribution status of the disk
+//!
+//! @param distribution
+//!
+void
+Capture::setDistribution(uint8_t distribution)
+{
+    distribution_m = distribution;
+}
+
+
+//! set the label stored in the file
+//!
+//! @param label
+//!
+void
+Capture::setLabel(const char *label)
+{
+    label_m = label;
+}
+
+
+//! set the comment stored in the file
+//!
+//! @param comment
+//!
+void
+Capture::setComment(const char *comment)
+{
+    comment_m = comment;
+}
+
+
+//! set the person imaging the disk, stored in the file
+//!
+//! @param imager
+//!
+void
+Capture::setImager(const char *imager)
+{
+    imager_m = imager;
+}
+
+
+//! set the program name stored in the file
+//!
+//! @param program
+//!
+void
+Capture::setProgram(const char *program)
+{
+    program_m = program;
+}
+
+
+//! write the image to an open file descriptor, such as stdout into a pipe, instead of
+//! creating the file. The file name is then only used for the progress.
+//!
+//! @param fd    file descriptor, left open when the capture is done
+//!
+void
+Capture::setOutputFd(int fd)
+{
+    outputFd_m = fd;
+}
+
+
+//! image the disk
+//!
+//! @return success
+//!
+bool
+Capture::run()
+{
+    uint8_t   driveTrack;
+    uint16_t  driveSpeed;
+    uint8_t   driveSectors;
+    uint8_t   driveFlags;
+
+    state_m = state_Running;
+
+    if (outputFd_m < 0)
+    {
+        if (FILE *file = fopen(fileName_m.c_str(), "r"))
+        {
+            fclose(file);
+            return fail("File already exists!");
+        }
+    }
+
+    drive_m = new Drive(&driveInfo_m);
+
+    if (drive_m->getStatus() != 0)
+    {
+        return fail("Unable to open drive.");
+    }
+
+    FC5025        *controller = drive_m->getController();
+    ReadScheduler  scheduler(disk_m->numSectors(0, 0),
+                             (double) HeathHSDisk::defaultSectorRawBytes() /
+                             HeathHSDisk::defaultHoleRawBytes(),
+                             disk_m->driveRpm());
+
+    disk_m->setController(controller);
+
+    if (controller->recalibrate() != 0)
+    {
+        return fail("Unable to recalibrate drive.");
+    }
+
+    if (controller->setDensity(disk_m->density()) != 0)
+    {
+        return fail("Unable to set density.");
+    }
+
+    // the speed the drive measures, and how long a command takes to get to the drive
+    if (controller->driveStatus(&driveTrack, &driveSpeed, &driveSectors, &driveFlags) == 0)
+    {
+        scheduler.setRpm(driveSpeed / 100.0);
+    }
+    scheduler.setTurnaround(controller->measureTurnaround());
+    scheduler.setOrder(order_m);
+
+    H17Disk      *image = new H17Disk();
+    AsyncWriter   streamWriter;
+    std::ostream  stream(&streamWriter);
+
+    // raw sectors of completed tracks are kept in a temporary file, not in memory
+    image->spillRaw();
+
+    if (writeIndex_m)
+    {
+        image->writeIndex();
+    }
+
+    // a stream can't seek back, so the image is written in order as it is streamed
+    bool opened = (outputFd_m >= 0) ? (streamWriter.open(outputFd_m) &&
+                                       image->openForStream(stream)) :
+                                      image->openForAsyncWrite(fileName_m.c_str());
+
+    if (!opened)
+    {
+        delete image;
+        return fail("File can not be opened!");
+    }
+
+    image->writeHeader();
+    image->setSides(disk_m->numSides());
+    image->setTracks(disk_m->numTracks());
+    image->writeDiskFormatBlock();
+
+    image->setWPParameter(wp_m);
+    image->setDistributionParameter(distribution_m);
+    image->setTrackDataParameter(3);
+    image->writeParameters();
+    writeInfo(image);
+    image->startData();
+
+    bool imaged = true;
+
+    for (uint8_t track = disk_m->minTrack(); imaged && (track <= disk_m->maxTrack()); track++)
+    {
+        for (uint8_t side = disk_m->minSide(); imaged && (side <= disk_m->maxSide()); side++)
+        {
+            track_m = track;
+            side_m  = side;
+
+            imaged = imageTrack(image, &scheduler, track, side);
+            if (imaged)
+            {
+                tracksDone_m++;
+            }
+        }
+    }
+
+    image->endDataBlock();
+
+    bool written = image->writeRawDataBlock();
+
+    written = image->closeFile() && written;
+
+    if (outputFd_m >= 0)
+    {
+        written = streamWriter.close() && written;
+    }
+    delete image;
+
+    if (scheduler.getTracks())
+    {
+        printf("%s: revolutions per track: %.2f  missed holes: %u\n", driveInfo_m.id,
+               scheduler.getTotalRevolutions() / scheduler.getTracks(),
+               scheduler.getMisses());
+    }
+
+    if (!written)
+    {
+        return fail("Unable to write the file!");
+    }
+
+    if (!imaged)
+    {
+        if (cancelled_m)
+        {
+            message_m = "Cancelled.";
+            state_m   = state_Cancelled;
+            return false;
+        }
+        return fail("Unable to seek to track! Giving up.");
+    }
+
+    message_m = errors_m ? "Sectors had errors." : "Successfully read disk.";
+    state_m   = state_Done;
+
+    return true;
+}
+
+
+//! stop the capture at the next sector, the file is kept with the tracks read so far
+//!
+void
+Capture::cancel()
+{
+    cancelled_m = true;
+}
+
+
+//! get the id of the drive
+//!
+//! @return id
+//!
+const char *
+Capture::getDriveId()
+{
+    return driveInfo_m.id;
+}
+
+
+//! get the name of the file being written
+//!
+//! @return file name
+//!
+const char *
+Capture::getFileName()
+{
+    return fileName_m.c_str();
+}
+
+
+//! get the state of the capture
+//!
+//! @return state
+//!
+Capture::State
+Capture::getState()
+{
+    return (State) state_m.load();
+}
+
+
+//! get a message for the state of the capture
+//!
+//! @return message
+//!
+const char *
+Capture::getMessage()
+{
+    return message_m;
+}
+
+
+//! get the track being read
+//!
+//! @return track
+//!
+uint8_t
+Capture::getTrack()
+{
+    return track_m;
+}
+
+
+//! get the side being read
+//!
+//! @return side
+//!
+uint8_t
+Capture::getSide()
+{
+    return side_m;
+}
+
+
+//! get the number of tracks read, counting each side
+//!
+//! @return tracks
+//!
+unsigned int
+Capture::getTracksDone()
+{
+    return tracksDone_m;
+}
+
+
+//! get the number of tracks to read, counting each side
+//!
+//! @return tracks
+//!
+unsigned int
+Capture::getTracksTotal()
+{
+    return disk_m->numTracks() * disk_m->numSides();
+}
+
+
+//! get the number of sectors that had errors after all their retries
+//!
+//! @return sectors
+//!
+unsigned int
+Capture::getErrors()
+{
+    return errors_m;
+}
+
+
+//! end the capture with a failure
+//!
+//! @param message
+//!
+//! @return false
+//!
+bool
+Capture::fail(const char *message)
+{
+    printf("%s: %s\n", driveInfo_m.id, message);
+
+    message_m = message;
+    state_m   = state_Failed;
+
+    return false;
+}
+
+
+//! write the information blocks about the disk and the capture
+//!
+//! @param image
+//!
+void
+Capture::writeInfo(H17Disk *image)
+{
+    std::time_t time  = std::time(nullptr);
+    const char *epoch = getenv("SOURCE_DATE_EPOCH");
+    struct tm   timeInfo;
+    char        timeString[100];
+
+    // a fixed date for captures that must be repeatable
+    if (epoch)
+    {
+        time = strtoll(epoch, nullptr, 10);
+    }
+
+    if (!label_m.empty())
+    {
+        image->writeLabel((unsigned char *) label_m.c_str(), label_m.length() + 1);
+    }
+    if (!comment_m.empty())
+    {
+        image->writeComment((unsigned char *) comment_m.c_str(), comment_m.length() + 1);
+    }
+
+    // gmtime() isn't safe with other captures running
+    uint32_t length = strftime(timeString, sizeof(timeString), "%c",
+                               gmtime_r(&time, &timeInfo));
+
+    if (length)
+    {
+        image->writeDate((unsigned char *) timeString, length + 1);
+    }
+    if (!imager_m.empty())
+    {
+        image->writeImager((unsigned char *) imager_m.c_str(), imager_m.length() + 1);
+    }
+    if (!program_m.empty())
+    {
+        image->writeProgram((unsigned char *) program_m.c_str(), program_m.length() + 1);
+    }
+}
+
+
+//! image a track, the first pass reads every sector, later passes retry the ones
+//! that failed
+//!
+//! @param image
+//! @param scheduler
+//! @param track
+//! @param side
+//!
+//! @return false if the seek failed or the capture was cancelled
+//!
+bool
+Capture::imageTrack(H17Disk       *image,
+                    ReadScheduler *scheduler,
+                    uint8_t        track,
+                    uint8_t        side)
+{
+    uint8_t sector;
+
+    if (drive_m->getController()->seek(disk_m->physicalTrack(track)) != 0)
+    {
+        return false;
+    }
+
+    scheduler->startTrack(disk_m->minSector(track, side), disk_m->maxSector(track, side));
+    image->startTrack(side, track);
+
+    if (wholeTrack_m)
+    {
+        readWholeTrack(image, scheduler, track, side);
+    }
+
+    while (scheduler->nextSector(sector))
+    {
+        readSector(image, scheduler, track, side, sector);
+        if (cancelled_m)
+        {
+            return false;
+        }
+    }
+
+    scheduler->endTrack();
+    printf("%s: side: %d t: %d reads: %u revolutions: %.2f\n", driveInfo_m.id, side, track,
+           scheduler->getTrackReads(), scheduler->getTrackRevolutions());
+
+    image->endTrack();
+
+    return true;
+}
+
+
+//! read all the sectors of a track with one command, the ones with errors stay pending
+//! in the scheduler to be retried a sector at a time
+//!
+//! @param image
+//! @param scheduler
+//! @param track
+//! @param side
+//!
+//! @return number of sectors that passed
+//!
+int
+Capture::readWholeTrack(H17Disk       *image,
+                        ReadScheduler *scheduler,
+                        uint8_t        track,
+                        uint8_t        side)
+{
+    int                  numSectors  = disk_m->numSectors(track, side);
+    uint8_t              first       = disk_m->minSector(track, side);
+    uint16_t             sectorBytes = disk_m->sectorBytes(side, track, first);
+    uint16_t             rawBytes    = disk_m->sectorRawBytes(side, track, first);
+    std::vector<uint8_t> buf(numSectors * sectorBytes);
+    std::vector<uint8_t> rawBuf(numSectors * rawBytes);
+    std::vector<int>     status(numSectors);
+    int                  retVal;
+    int                  passed = 0;
+
+    retVal = disk_m->readTrack(buf.data(), rawBuf.data(), status.data(), side, track);
+
+    for (int i = 0; i < numSectors; i++)
+    {
+        int sector = first + i;
+
+        // If it was a read error, then raw bytes are not valid
+        if (retVal == 0)
+        {
+            image->addRawSector(sector, &rawBuf[i * rawBytes], rawBytes);
+        }
+
+        printf("%s: side: %d t: %d sect: %d status: %d\n", driveInfo_m.id, side, track,
+               sector, status[i]);
+
+        if (status[i] == 0)
+        {
+            image->addSector(sector, status[i], &buf[i * sectorBytes], sectorBytes);
+            passed++;
+        }
+
+        scheduler->markRead(sector, status[i] != 0);
+    }
+
+    return passed;
+}
+
+
+//! read a sector once, and store it when it passed or has used up its retries
+//!
+//! The status of each read is printed here, prefixed with the drive, as the disk
+//! doesn't print on the capture threads.
+//!
+//! @param image
+//! @param scheduler
+//! @param track
+//! @param side
+//! @param sector
+//!
+//! @return true if the sector is done
+//!
+bool
+Capture::readSector(H17Disk       *image,
+                    ReadScheduler *scheduler,
+                    uint8_t        track,
+                    uint8_t        side,
+                    uint8_t        sector)
+{
+    uint8_t        buf[HeathHSDisk::defaultSectorBytes()];
+    uint8_t        rawBuf[HeathHSDisk::defaultSectorRawBytes()];
+    int            retVal;
+    int            retryCount = scheduler->getAttempts(sector);
+    bool           done;
+
+    scheduler->startRead(sector);
+    retVal = disk_m->readSector(buf, rawBuf, side, track, sector);
+    done   = (retVal == 0) || (retryCount >= maxRetries_c);
+    scheduler->endRead(!done);
+
+    printf("%s: side: %d t: %d sect: %d status: %d\n", driveInfo_m.id, side, track, sector,
+           retVal);
+
+    // If it was a read error, then raw bytes are not valid, otherwise store raw
+    if (retVal != Err_ReadError)
+    {
+        image->addRawSector(sector, rawBuf, disk_m->sectorRawBytes(side, track, sector));
+    }
+
+    if (!done)
+    {
+        return false;
+    }
+
+    // even if there is an error, use the last processed sector, unless it was a read error
+    if (retVal == Err_ReadError)
+    {
+        image->addSector(sector, retVal, nullptr, 0);
+    }
+    else
+    {
+        image->addSector(sector, retVal, buf, disk_m->sectorBytes(side, track, sector));
+    }
+
+    if (retVal != 0)
+    {
+        errors_m++;
+        printf("%s: failed after %d attempts: %d H: %d T: %d S:%d\n", driveInfo_m.id,
+               maxRetries_c, retVal, side, track, sector);
+    }
+
+    return true;
+}
+
+
+//! constructor
+//!
+CaptureEngine::CaptureEngine()
+{
+
+}
+
+
+//! destructor, waits for the captures to finish
+//!
+CaptureEngine::~CaptureEngine()
+{
+    wait();
+
+    for (Capture *capture : captures_m)
+    {
+        delete capture;
+    }
+}
+
+
+//! add a capture to run, the engine deletes it
+//!
+//! @param capture
+//!
+void
+CaptureEngine::addCapture(Capture *capture)
+{
+    captures_m.push_back(capture);
+}
+
+
+//! get the number of captures
+//!
+//! @return captures
+//!
+unsigned int
+CaptureEngine::getCaptures()
+{
+    return captures_m.size();
+}
+
+
+//! get a capture
+//!
+//! @param index
+//!
+//! @return capture, nullptr if index is out of range
+//!
+Capture *
+CaptureEngine::getCapture(unsigned int index)
+{
+    if (index >= captures_m.size())
+    {
+        return nullptr;
+    }
+
+    return captures_m[index];
+}
+
+
+//! start a thread for each capture
+//!
+void
+CaptureEngine::start()
+{
+    for (Capture *capture : captures_m)
+    {
+        threads_m.emplace_back(&Capture::run, capture);
+    }
+}
+
+
+//! check if all the captures have finished
+//!
+//! @return true when none are waiting or running
+//!
+bool
+CaptureEngine::isDone()
+{
+    for (Capture *capture : captures_m)
+    {
+        Capture::State state = capture->getState();
+
+        if ((state == Capture::state_Waiting) || (state == Capture::state_Running))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+//! wait for the threads of the captures to finish
+//!
+void
+CaptureEngine::wait()
+{
+    for (std::thread &thread : threads_m)
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+    threads_m.clear();
+}
+
+
+//! cancel all the captures
+//!
+void
+CaptureEngine::cancel()
+{
+    for (Capture *capture : captures_m)
+    {
+        capture->cancel();
+    }
+}
@@ -0,0 +1,144 @@
+//! \file capture.h
+//!
+//! Images hard-sectored disks into h17disk files, on several drives at once.
+//!
+
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include "drive.h"
+#include "read_scheduler.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+class HeathHSDisk;
+class H17Disk;
+
+
+//! Images one disk on one drive into one file. run() does the whole capture and is
+//! meant to be called from a thread of its own, the progress can be read from other
+//! threads while it runs.
+//!
+class Capture
+{
+public:
+
+    enum State
+    {
+        state_Waiting,
+        state_Running,
+        state_Done,
+        state_Failed,
+        state_Cancelled
+    };
+
+    Capture(const DriveInfo *driveInfo,
+            const char      *fileName,
+            uint8_t          sides,
+            uint8_t          tracks,
+            uint8_t          driveTpi,
+            uint16_t         driveRpm);
+    virtual ~Capture();
+
+    void         setWholeTrack(bool                 wholeTrack);
+    void         setOrder(ReadScheduler::Order      order);
+    void         setWriteProtect(bool               wp);
+    void         setWriteIndex(bool                 writeIndex);
+    void         setDistribution(uint8_t            distribution);
+    void         setLabel(const char               *label);
+    void         setComment(const char             *comment);
+    void         setImager(const char              *imager);
+    void         setProgram(const char             *program);
+    void         setOutputFd(int                    fd);
+
+    bool         run();
+    void         cancel();
+
+    const char  *getDriveId();
+    const char  *getFileName();
+
+    State        getState();
+    const char  *getMessage();
+    uint8_t      getTrack();
+    uint8_t      getSide();
+    unsigned int getTracksDone();
+    unsigned int getTracksTotal();
+    unsigned int getErrors();
+
+    static const int maxRetries_c = 6;
+
+private:
+
+    bool         fail(const char *message);
+    void         writeInfo(H17Disk *image);
+    bool         imageTrack(H17Disk       *image,
+                            ReadScheduler *scheduler,
+                            uint8_t        track,
+                            uint8_t        side);
+    int          readWholeTrack(H17Disk       *image,
+                                ReadScheduler *scheduler,
+                                uint8_t        track,
+                                uint8_t        side);
+    bool         readSector(H17Disk       *image,
+                            ReadScheduler *scheduler,
+                            uint8_t        track,
+                            uint8_t        side,
+                            uint8_t        sector);
+
+    DriveInfo                  driveInfo_m;
+    std::string                fileName_m;
+    HeathHSDisk               *disk_m;
+    Drive                     *drive_m;
+
+    // settings
+    bool                       wholeTrack_m;
+    ReadScheduler::Order       order_m;
+    bool                       wp_m;
+    bool                       writeIndex_m;
+    uint8_t                    distribution_m;
+    std::string                label_m;
+    std::string                comment_m;
+    std::string                imager_m;
+    std::string                program_m;
+    int                        outputFd_m;
+
+    // progress
+    std::atomic<int>           state_m;
+    std::atomic<const char *>  message_m;
+    std::atomic<uint8_t>       track_m;
+    std::atomic<uint8_t>       side_m;
+    std::atomic<unsigned int>  tracksDone_m;
+    std::atomic<unsigned int>  errors_m;
+    std::atomic<bool>          cancelled_m;
+};
+
+
+//! Runs a set of captures, each on a thread of its own, so the drives all read at once.
+//!
+class CaptureEngine
+{
+public:
+
+    CaptureEngine();
+    virtual ~CaptureEngine();
+
+    void         addCapture(Capture *capture);
+    unsigned int getCaptures();
+    Capture     *getCapture(unsigned int index);
+
+    void         start();
+    bool         isDone();
+    void         wait();
+    void         cancel();
+
+private:
+
+    std::vector<Capture *>    captures_m;
+    std::vector<std::thread>  threads_m;
+};
+
+#endif
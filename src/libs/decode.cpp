@@ -8,38 +8,581 @@
 #include "decode.h"
 
 #include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DECODE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
 
 
+Decode::FMKernel Decode::fmKernel_m = Decode::kernel_Auto;
+
 int Decode::lastZeroErrors = 0;
 int Decode::lastOneErrors = 0;
 
+// Layout of a decode table entry
+//
+//   b3-b0   - decoded bits (4 data bits per raw byte)
+//   b6-b4   - next table state ((State << 1) | last bit)
+//   b9-b7   - unexpected zeros
+//   b12-b10 - unexpected ones
+//   b16-b13 - cells with an error, first cell in b16
+//
+static const unsigned int fmNextStateShift_c  = 4;
+static const unsigned int fmZerosShift_c      = 7;
+static const unsigned int fmOnesShift_c       = 10;
+static const unsigned int fmErrorCellsShift_c = 13;
+static const uint32_t     fmErrorsMask_c      = 0x3f << fmZerosShift_c;
+
+
+//!  genFMTable()
+//!
+//!  Generate the FM decode table at compile time. Each entry is the result of running
+//!  the decodeFMReference() state machine over one raw byte (4 bit cells), starting
+//!  from the given state and last bit value.
+//!
+//!  @return decode table
+//!
+constexpr std::array<uint32_t, Decode::fmTableStates_c * 256>
+Decode::genFMTable()
+{
+    std::array<uint32_t, fmTableStates_c * 256> table = {};
+
+    for (unsigned int tableState = 0; tableState < fmTableStates_c; tableState++)
+    {
+        for (unsigned int raw = 0; raw < 256; raw++)
+        {
+            State         state       = (State) (tableState >> 1);
+            unsigned int  lastBit     = tableState & 1;
+            unsigned int  errorsZeros = 0;
+            unsigned int  errorsOnes  = 0;
+            unsigned int  bits        = 0;
+            unsigned int  errorCells  = 0;
+
+            for (int shift = 6; shift >= 0; shift -= 2)
+            {
+                unsigned int errors = errorsZeros + errorsOnes;
+
+                switch ((raw >> shift) & 0x3)
+                {
+                    case 0:
+                        errorsZeros++;
+                        lastBit = 0;
+                        break;
+                    case 1:
+                        if (state == lo)
+                        {
+                            if (lastBit == 0)
+                            {
+                                errorsZeros++;
+                            }
+                            else
+                            {
+                                errorsOnes++;
+                            }
+                        }
+                        state = hi;
+                        lastBit = 0;
+                        break;
+                    case 2:
+                        if (state == hi)
+                        {
+                            errorsOnes++;
+                        }
+                        state = lo;
+                        lastBit = 0;
+                        break;
+                    case 3:
+                        lastBit = 1;
+                        break;
+                }
+
+                bits       = (bits << 1) | lastBit;
+                errorCells = (errorCells << 1) | (errors != errorsZeros + errorsOnes);
+            }
+
+            table[(tableState << 8) | raw] = bits |
+                                             ((((state << 1) | lastBit)) << fmNextStateShift_c) |
+                                             (errorsZeros << fmZerosShift_c) |
+                                             (errorsOnes  << fmOnesShift_c) |
+                                             (errorCells  << fmErrorCellsShift_c);
+        }
+    }
+
+    return table;
+}
+
+const std::array<uint32_t, Decode::fmTableStates_c * 256> Decode::fmTable_m = Decode::genFMTable();
+
+
+//! add the errors from one decode table entry to the context
+//!
+//! @param context  decode results
+//! @param entry    decode table entry
+//! @param cell     bit cell of the first cell of the raw byte
+//!
+static void
+addFMErrors(DecodeContext &context,
+            uint32_t       entry,
+            unsigned int   cell)
+{
+    if (!(entry & fmErrorsMask_c))
+    {
+        return;
+    }
+
+    context.zeroErrors += (entry >> fmZerosShift_c) & 0x7;
+    context.oneErrors  += (entry >> fmOnesShift_c)  & 0x7;
+
+    if (context.errorMap)
+    {
+        context.errorMap[cell >> 6] |= 1 << ((cell >> 3) & 7);
+    }
+
+    for (int pos = 3; pos >= 0; pos--, cell++)
+    {
+        if ((entry >> (fmErrorCellsShift_c + pos)) & 1)
+        {
+            context.addErrorPosition(cell);
+        }
+    }
+}
+
+
+//!  decodeFMTable()
+//!
+//!  Table driven FM decode, each raw byte produces 4 decoded bits.
+//!
+//!  @param decoded       pointer to processed buffer
+//!  @param fmEncoded     pointer to raw buffer
+//!  @param count         number of bytes in the processed buffer
+//!  @param tableState    [in/out] decoder state, (State << 1) | last bit
+//!  @param context       [in/out] error counts and positions
+//!  @param cell          bit cell of the first raw byte, from the start of the sector
+//!
+//!  @return 0
+//!
+int
+Decode::decodeFMTable(uint8_t       *decoded,
+                      uint8_t       *fmEncoded,
+                      unsigned int   count,
+                      unsigned int  &tableState,
+                      DecodeContext &context,
+                      unsigned int   cell)
+{
+    unsigned int state  = tableState;
+
+    while (count--)
+    {
+        uint32_t high = fmTable_m[(state << 8) | *fmEncoded++];
+        state = (high >> fmNextStateShift_c) & 0x7;
+
+        uint32_t low  = fmTable_m[(state << 8) | *fmEncoded++];
+        state = (low >> fmNextStateShift_c) & 0x7;
+
+        *decoded++ = ((high & 0xf) << 4) | (low & 0xf);
+
+        if ((high | low) & fmErrorsMask_c)
+        {
+            addFMErrors(context, high, cell);
+            addFMErrors(context, low, cell + 4);
+        }
+        cell += 8;
+    }
+
+    tableState  = state;
+
+    return 0;
+}
+
+
+//! clean FM kernel
+//!
+//! Decodes whole chunks of raw data as long as every clock bit for the given phase is
+//! set. On a clean stream no errors are possible and the phase can't change, so the
+//! data bits can be gathered without running the state machine.
+//!
+//! @param decoded     pointer to processed buffer
+//! @param fmEncoded   pointer to raw buffer
+//! @param count       number of bytes left in the processed buffer
+//! @param phaseHi     data bits are in the high bit of each cell
+//! @param dirty       [out] decoded bytes, from the return position, that must go through
+//!                    the state machine to get past the clock violation, 0 if the kernel
+//!                    stopped due to running out of full chunks.
+//!
+//! @return number of decoded bytes written
+//!
+typedef unsigned int (*FMCleanKernel)(uint8_t       *decoded,
+                                      const uint8_t *fmEncoded,
+                                      unsigned int   count,
+                                      bool           phaseHi,
+                                      unsigned int  &dirty);
+
+#ifdef DECODE_X86_KERNELS
+
+//! SSE2 clean FM kernel - 16 raw bytes to 8 decoded bytes per iteration
+//!
+static unsigned int
+decodeFMCleanSSE2(uint8_t       *decoded,
+                  const uint8_t *fmEncoded,
+                  unsigned int   count,
+                  bool           phaseHi,
+                  unsigned int  &dirty)
+{
+    const __m128i clock   = _mm_set1_epi8(phaseHi ? 0x55 : 0xaa);
+    const __m128i mask1   = _mm_set1_epi16(0x5555);
+    const __m128i mask2   = _mm_set1_epi16(0x3333);
+    const __m128i mask4   = _mm_set1_epi16(0x0f0f);
+    const __m128i mask8   = _mm_set1_epi16(0x00ff);
+    unsigned int  decodedCount = 0;
+
+    dirty = 0;
+
+    while (count - decodedCount >= 8)
+    {
+        __m128i raw = _mm_loadu_si128((const __m128i *) fmEncoded);
+
+        unsigned int clean = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(raw, clock), clock));
+        if (clean != 0xffff)
+        {
+            dirty = (__builtin_ctz(~clean) >> 1) + 1;
+            break;
+        }
+
+        // first raw byte of each pair is the high byte of the cell stream
+        __m128i bits = _mm_or_si128(_mm_slli_epi16(raw, 8), _mm_srli_epi16(raw, 8));
+        if (phaseHi)
+        {
+            bits = _mm_srli_epi16(bits, 1);
+        }
+
+        // gather the even bits
+        bits = _mm_and_si128(bits, mask1);
+        bits = _mm_and_si128(_mm_or_si128(bits, _mm_srli_epi16(bits, 1)), mask2);
+        bits = _mm_and_si128(_mm_or_si128(bits, _mm_srli_epi16(bits, 2)), mask4);
+        bits = _mm_and_si128(_mm_or_si128(bits, _mm_srli_epi16(bits, 4)), mask8);
+
+        _mm_storel_epi64((__m128i *) decoded, _mm_packus_epi16(bits, bits));
+
+        fmEncoded    += 16;
+        decoded      += 8;
+        decodedCount += 8;
+    }
+
+    return decodedCount;
+}
+
+
+//! AVX2 clean FM kernel - 32 raw bytes to 16 decoded bytes per iteration
+//!
+__attribute__((target("avx2")))
+static unsigned int
+decodeFMCleanAVX2(uint8_t       *decoded,
+                  const uint8_t *fmEncoded,
+                  unsigned int   count,
+                  bool           phaseHi,
+                  unsigned int  &dirty)
+{
+    const __m256i clock   = _mm256_set1_epi8(phaseHi ? 0x55 : 0xaa);
+    const __m256i mask1   = _mm256_set1_epi16(0x5555);
+    const __m256i mask2   = _mm256_set1_epi16(0x3333);
+    const __m256i mask4   = _mm256_set1_epi16(0x0f0f);
+    const __m256i mask8   = _mm256_set1_epi16(0x00ff);
+    unsigned int  decodedCount = 0;
+
+    dirty = 0;
+
+    while (count - decodedCount >= 16)
+    {
+        __m256i raw = _mm256_loadu_si256((const __m256i *) fmEncoded);
+
+        unsigned int clean = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(raw, clock),
+                                                                    clock));
+        if (clean != 0xffffffff)
+        {
+            dirty = (__builtin_ctz(~clean) >> 1) + 1;
+            break;
+        }
+
+        __m256i bits = _mm256_or_si256(_mm256_slli_epi16(raw, 8), _mm256_srli_epi16(raw, 8));
+        if (phaseHi)
+        {
+            bits = _mm256_srli_epi16(bits, 1);
+        }
+
+        bits = _mm256_and_si256(bits, mask1);
+        bits = _mm256_and_si256(_mm256_or_si256(bits, _mm256_srli_epi16(bits, 1)), mask2);
+        bits = _mm256_and_si256(_mm256_or_si256(bits, _mm256_srli_epi16(bits, 2)), mask4);
+        bits = _mm256_and_si256(_mm256_or_si256(bits, _mm256_srli_epi16(bits, 4)), mask8);
+
+        // pack works within each 128-bit lane, gather the low quad-word of both lanes
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(bits, bits), 0x08);
+
+        _mm_storeu_si128((__m128i *) decoded, _mm256_castsi256_si128(packed));
+
+        fmEncoded    += 32;
+        decoded      += 16;
+        decodedCount += 16;
+    }
+
+    return decodedCount;
+}
+
+#endif
+
+
+//! get kernel for the requested kernel type
+//!
+//! @param kernel   requested kernel
+//!
+//! @return kernel function, nullptr for table only decoding.
+//!
+static FMCleanKernel
+getCleanKernel(Decode::FMKernel kernel)
+{
+#ifdef DECODE_X86_KERNELS
+    switch (kernel)
+    {
+        case Decode::kernel_Auto:
+            if (__builtin_cpu_supports("avx2"))
+            {
+                return decodeFMCleanAVX2;
+            }
+            if (__builtin_cpu_supports("sse2"))
+            {
+                return decodeFMCleanSSE2;
+            }
+            break;
+        case Decode::kernel_SSE2:
+            return decodeFMCleanSSE2;
+        case Decode::kernel_AVX2:
+            return decodeFMCleanAVX2;
+        case Decode::kernel_Table:
+            break;
+    }
+#endif
+
+    return nullptr;
+}
+
+
+//!  setFMKernel()
+//!
+//!  select the kernel used for clean FM and MFM data, should be set before any decoding
+//!  starts.
+//!
+//!  @param kernel    kernel to use
+//!
+//!  @return if the kernel is supported on this cpu
+//!
+bool
+Decode::setFMKernel(FMKernel kernel)
+{
+    bool supported = true;
+
+#ifdef DECODE_X86_KERNELS
+    if (kernel == kernel_SSE2)
+    {
+        supported = __builtin_cpu_supports("sse2");
+    }
+    else if (kernel == kernel_AVX2)
+    {
+        supported = __builtin_cpu_supports("avx2");
+    }
+#else
+    supported = (kernel == kernel_Auto) || (kernel == kernel_Table);
+#endif
+
+    if (supported)
+    {
+        fmKernel_m = kernel;
+    }
+
+    return supported;
+}
+
+
+//!  getFMKernel()
+//!
+//!  @return currently selected kernel
+//!
+Decode::FMKernel
+Decode::getFMKernel()
+{
+    return fmKernel_m;
+}
+
+
 //!  decodeFM()
 //!
+//!  Decode into the shared last error counts, kept for existing callers. Not safe to
+//!  call from more than one thread, use the DecodeContext version for that.
+//!
 //!  @param decode        pointer to processed buffer
 //!  @param fmEncoded     pointer to raw buffer
 //!  @param count         number of bytes in the final processed file
 //!
 //!  @return number of errors (currently returns zero)
 //!
-//!  \todo change count from bytes in decoded buffer to bytes in raw buffer.
-//!
 int
 Decode::decodeFM(uint8_t      *decoded,
                  uint8_t      *fmEncoded,
                  unsigned int  count)
+{
+    DecodeContext context;
+    int           status = decodeFM(decoded, fmEncoded, count, context);
+
+    lastZeroErrors = context.zeroErrors;
+    lastOneErrors  = context.oneErrors;
+
+    return status;
+}
+
+
+//!  decodeFM()
+//!
+//!  Table driven decode, gives identical results to decodeFMReference(). Runs of clean
+//!  FM are handled by a vector kernel, selected at runtime, with the table decode only
+//!  used where there is a clock violation. All results go into the context, so this
+//!  is re-entrant.
+//!
+//!  @param decode        pointer to processed buffer
+//!  @param fmEncoded     pointer to raw buffer
+//!  @param count         number of bytes in the final processed file
+//!  @param context       [out] error counts, error positions and final phase
+//!
+//!  @return number of errors (currently returns zero)
+//!
+//!  \todo change count from bytes in decoded buffer to bytes in raw buffer.
+//!
+int
+Decode::decodeFM(uint8_t       *decoded,
+                 uint8_t       *fmEncoded,
+                 unsigned int   count,
+                 DecodeContext &context)
+{
+    // start with no state, last bit set to match decodeFMReference()
+    unsigned int  tableState  = (none << 1) | 1;
+    unsigned int  cell        = 0;
+    FMCleanKernel kernel      = getCleanKernel(fmKernel_m);
+
+    context.reset();
+
+    if (context.errorMap)
+    {
+        memset(context.errorMap, 0, (count + 7) >> 3);
+    }
+
+    // until the phase is known, every byte has to go through the state machine.
+    while (count && ((tableState >> 1) == none))
+    {
+        decodeFMTable(decoded++, fmEncoded, 1, tableState, context, cell);
+        fmEncoded += 2;
+        cell      += 8;
+        count--;
+    }
+
+    while (kernel && count)
+    {
+        unsigned int dirty;
+        unsigned int clean = kernel(decoded, fmEncoded, count, (tableState >> 1) == hi, dirty);
+
+        if (clean)
+        {
+            decoded    += clean;
+            fmEncoded  += clean << 1;
+            cell       += clean << 3;
+            count      -= clean;
+
+            // phase is unchanged, just the last bit needs to be updated
+            tableState  = (tableState & ~1u) | (decoded[-1] & 1);
+        }
+
+        if (!dirty)
+        {
+            break;
+        }
+
+        // only the part with the clock violation goes through the state machine
+        decodeFMTable(decoded, fmEncoded, dirty, tableState, context, cell);
+        decoded    += dirty;
+        fmEncoded  += dirty << 1;
+        cell       += dirty << 3;
+        count      -= dirty;
+    }
+
+    // remainder that doesn't fill a kernel chunk
+    decodeFMTable(decoded, fmEncoded, count, tableState, context, cell);
+
+    context.state   = (State) (tableState >> 1);
+    context.lastBit = tableState & 1;
+
+    return 0;
+}
+
+
+//!  decodeFMReference()
+//!
+//!  Decode into the shared last error counts, kept for existing callers.
+//!
+//!  @param decode        pointer to processed buffer
+//!  @param fmEncoded     pointer to raw buffer
+//!  @param count         number of bytes in the final processed file
+//!
+//!  @return number of errors (currently returns zero)
+//!
+int
+Decode::decodeFMReference(uint8_t      *decoded,
+                          uint8_t      *fmEncoded,
+                          unsigned int  count)
+{
+    DecodeContext context;
+    int           status = decodeFMReference(decoded, fmEncoded, count, context);
+
+    lastZeroErrors = context.zeroErrors;
+    lastOneErrors  = context.oneErrors;
+
+    return status;
+}
+
+
+//!  decodeFMReference()
+//!
+//!  Bit at a time decode, kept as the reference for the table driven decodeFM(). Fills
+//!  in the context the same way decodeFM() does, so the two can be compared.
+//!
+//!  @param decode        pointer to processed buffer
+//!  @param fmEncoded     pointer to raw buffer
+//!  @param count         number of bytes in the final processed file
+//!  @param context       [out] error counts, error positions and final phase
+//!
+//!  @return number of errors (currently returns zero)
+//!
+int
+Decode::decodeFMReference(uint8_t       *decoded,
+                          uint8_t       *fmEncoded,
+                          unsigned int   count,
+                          DecodeContext &context)
 {
     State  state = none;
 
-    lastZeroErrors = lastOneErrors = 0;
+    context.reset();
+
+    if (context.errorMap)
+    {
+        memset(context.errorMap, 0, (count + 7) >> 3);
+    }
 
     unsigned int errorsZeros = 0;
     unsigned int errorsOnes  = 0;
     unsigned int lastBit     = 1;  // set to avoid warning of potentially uninitialized
+    unsigned int cell        = 0;
     unsigned int decodedValue;
     unsigned int encodedValue;
 
 
-    while (count--)
+    for (unsigned int pos = 0; pos < count; pos++)
     {
         // initialize to zero
         decodedValue = 0;
@@ -48,8 +591,9 @@ Decode::decodeFM(uint8_t      *decoded,
         encodedValue |= *fmEncoded++;
 
         // need to process 2 raw bytes to get a processed byte
-        for (int shift = 14; shift >= 0; shift -= 2)
+        for (int shift = 14; shift >= 0; shift -= 2, cell++)
         {
+            unsigned int errors = errorsZeros + errorsOnes;
 
             // save the 2 bits
             unsigned int  val = (encodedValue >> shift) & 0x3;
@@ -118,6 +662,16 @@ Decode::decodeFM(uint8_t      *decoded,
                     break;
             }
 
+            if (errors != errorsZeros + errorsOnes)
+            {
+                context.addErrorPosition(cell);
+
+                if (context.errorMap)
+                {
+                    context.errorMap[pos >> 3] |= 1 << (pos & 7);
+                }
+            }
+
             // shift to provide room for the new bit
             decodedValue <<= 1;
             decodedValue |=  lastBit;
@@ -127,57 +681,839 @@ Decode::decodeFM(uint8_t      *decoded,
         *decoded++ = decodedValue;
     }
 
-    lastZeroErrors = errorsZeros;
-    lastOneErrors = errorsOnes;
-    /*
-    if (errorsZeros)
-    {
-         printf("Unexpected Zeros: %d\n", errorsZeros);
-    }
-    if (errorsOnes)
-    {
-         printf("Unexpected Ones: %d\n", errorsOnes);
-    }
-    */
+    context.zeroErrors = errorsZeros;
+    context.oneErrors  = errorsOnes;
+    context.state      = state;
+    context.lastBit    = lastBit;
 
     return 0;
 }
 
 
-//!  decodeMFM()
-//!
-//!  @param decode        pointer to processed buffer
-//!  @param mfmEncoded    pointer to raw buffer
-//!  @param count         number of bytes in the final processed file
-//!
-//!  @return number of errors (currently returns zero)
-//!
-//!  \todo change count from bytes in decoded buffer to bytes in raw buffer.
-//!  \todo implement
+//! MFMState constructor
 //!
-int
-Decode::decodeMFM(uint8_t       *decoded,
-                  uint8_t       *mfmEncoded,
-                  unsigned int   count)
+Decode::MFMState::MFMState()
 {
-#if 0
-    uint8_t *mfmData;
-    int   bitNum;
-    int   onePending;
-    int   zeroPending;
-    int   lastBit;
-    uint8_t  mfmByte;
+    reset();
+}
 
-    mfmData    = mfmEncoded;
-    bitNum     = 0;
-    onePending = 0;
-    mfmByte    = *mfmData++;
 
-    while(count--)
+//! reset the MFM state, to start decoding a new stream
+//!
+void
+Decode::MFMState::reset()
+{
+    window     = 0;
+    pending    = 0;
+    lastData   = 0;
+    syncMarks  = 0;
+    resyncs    = 0;
+    zeroErrors = 0;
+    oneErrors  = 0;
+}
+
+
+//! decode 16 MFM cells, clock bit first, into a data byte and check the clocks
+//!
+//! @param cells       raw cells, first cell in b15-b14
+//! @param lastData    [in/out] last decoded data bit
+//! @param zeroErrors  [in/out] count of missing clock bits
+//! @param oneErrors   [in/out] count of unexpected clock bits
+//!
+//! @return decoded byte
+//!
+static inline uint8_t
+decodeMFMCells(unsigned int  cells,
+               unsigned int &lastData,
+               unsigned int &zeroErrors,
+               unsigned int &oneErrors)
+{
+    unsigned int data     = cells & 0x5555;
+    unsigned int clocks   = (cells >> 1) & 0x5555;
+
+    // clock is only set when both the previous and current data bits are zero
+    unsigned int prevData = (data >> 2) | (lastData << 14);
+    unsigned int expected = ~(data | prevData) & 0x5555;
+
+    if (clocks != expected)
     {
-        *decoded++ = getDecodedByte();
+        zeroErrors += __builtin_popcount(expected & ~clocks);
+        oneErrors  += __builtin_popcount(clocks & ~expected);
     }
+    lastData = data & 1;
+
+    // gather the data bits
+    data = (data | (data >> 1)) & 0x3333;
+    data = (data | (data >> 2)) & 0x0f0f;
+    data = (data | (data >> 4)) & 0x00ff;
+
+    return data;
+}
+
+
+//! generate the table of sync mark end positions to check
+//!
+//! A sync mark ending in any of the 8 bit positions of the newest raw byte always covers
+//! the whole previous raw byte and at least the top bit of the newest byte. The table is
+//! indexed by the previous byte and the high nibble of the newest byte, so only the
+//! positions that match those bits need a full compare.
+//!
+//! @return table, bit n is set if a sync mark could end at bit n of the newest byte
+//!
+static constexpr std::array<uint8_t, 4096>
+genMFMSyncTable()
+{
+    std::array<uint8_t, 4096> table = {};
+
+    for (unsigned int index = 0; index < 4096; index++)
+    {
+        unsigned int prevByte = index >> 4;
+        unsigned int newByte  = (index & 0xf) << 4;
+
+        for (unsigned int pos = 0; pos < 8; pos++)
+        {
+            unsigned int mask = 0xf0 & (0xff << pos);
+
+            if ((prevByte == ((Decode::mfmSyncMark_c >> (8 - pos)) & 0xff)) &&
+                (((newByte ^ (Decode::mfmSyncMark_c << pos)) & mask) == 0))
+            {
+                table[index] |= 1 << pos;
+            }
+        }
+    }
+
+    return table;
+}
+
+static const std::array<uint8_t, 4096> mfmSyncTable = genMFMSyncTable();
+
+
+//! MFM clean kernel - decodes raw data with no clock violations
+//!
+//! A sync mark always has a clock violation, whichever phase it is read in, so cells
+//! with none can't hold one and are decoded without looking for it. Each chunk is only
+//! decoded once it and the chunk after it have been checked, as a sync mark starting in
+//! the cells of a chunk can run into the next one, and the pending bits after the last
+//! decoded chunk are consumed without the state machine ever looking at them.
+//!
+//! @param decoded     pointer to decoded buffer
+//! @param mfmEncoded  next raw byte, at least mfmKernelBefore_c raw bytes before it must
+//!                    be from the same buffer
+//! @param rawCount    raw bytes left
+//! @param pending     raw bits before mfmEncoded not yet decoded, 16 to 31
+//!
+//! @return number of raw bytes consumed, the decoded bytes are half of that
+//!
+typedef unsigned int (*MFMCleanKernel)(uint8_t       *decoded,
+                                       const uint8_t *mfmEncoded,
+                                       unsigned int   rawCount,
+                                       unsigned int   pending);
+
+//! raw bytes the cells not yet decoded can start back from the next raw byte
+static const unsigned int mfmKernelBefore_c = 4;
+
+//! raw bytes decoded by the state machine after a kernel stops, to get past the violation
+static const unsigned int mfmKernelSkip_c   = 8;
+
+
+//! find the raw bytes holding the cells not yet decoded
+//!
+//! The data cell before the first one is always in the first raw byte, so the kernels
+//! can check the first clock cell without the decoded data.
+//!
+//! @param mfmEncoded  next raw byte
+//! @param pending     raw bits before mfmEncoded not yet decoded
+//! @param shift       [out] bits to shift the raw bytes left by, 1 to 8
+//!
+//! @return first raw byte
+//!
+static inline const uint8_t *
+findMFMCells(const uint8_t *mfmEncoded,
+             unsigned int   pending,
+             unsigned int  &shift)
+{
+    // cell before the first one not yet decoded, in bits from 4 bytes back
+    unsigned int before = 31 - pending;
+
+    shift = (before & 7) + 1;
+
+    return mfmEncoded - 4 + (before >> 3);
+}
+
+
+//! load 8 raw bytes, first byte in the high bits
+//!
+static inline uint64_t
+loadMFM64(const uint8_t *raw)
+{
+    uint64_t value;
+
+    memcpy(&value, raw, sizeof(value));
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    value = __builtin_bswap64(value);
 #endif
 
-    return 1;
+    return value;
+}
+
+
+//! check the cells of 4 bytes for clock violations
+//!
+//! @param cells      cells, first cell in b63
+//! @param before     data cell before them
+//!
+//! @return true if every clock cell is set only when both data cells around it are clear
+//!
+static inline bool
+isCleanMFM64(uint64_t     cells,
+             unsigned int before)
+{
+    uint64_t around = (cells >> 1) | ((uint64_t) before << 63) | (cells << 1);
+
+    // a clock cell must differ from the OR of its data cells
+    return (~(cells ^ around) & 0xaaaaaaaaaaaaaaaaull) == 0;
+}
+
+
+//! gather the data cells of 4 bytes
+//!
+//! @param decoded    pointer to decoded buffer
+//! @param cells      cells, first cell in b63
+//!
+static inline void
+storeMFM64(uint8_t  *decoded,
+           uint64_t  cells)
+{
+    uint64_t bits = cells & 0x5555555555555555ull;
+
+    bits = (bits | (bits >> 1)) & 0x3333333333333333ull;
+    bits = (bits | (bits >> 2)) & 0x0f0f0f0f0f0f0f0full;
+    bits = (bits | (bits >> 4)) & 0x00ff00ff00ff00ffull;
+
+    decoded[0] = bits >> 48;
+    decoded[1] = bits >> 32;
+    decoded[2] = bits >> 16;
+    decoded[3] = bits;
+}
+
+
+//! 64-bit clean MFM kernel - 8 raw bytes to 4 decoded bytes per iteration
+//!
+//! Used on its own without vector support, and by the vector kernels for what is left
+//! after their last full chunk.
+//!
+static unsigned int
+decodeMFMClean64(uint8_t       *decoded,
+                 const uint8_t *mfmEncoded,
+                 unsigned int   rawCount,
+                 unsigned int   pending)
+{
+    unsigned int        shift;
+    const uint8_t      *raw      = findMFMCells(mfmEncoded, pending, shift);
+    unsigned int        consumed = 0;
+
+    if (rawCount < 8)
+    {
+        return 0;
+    }
+
+    // 16 cells for each byte, shifted out of the raw bytes and the byte after them
+    uint64_t cells = (loadMFM64(raw) << shift) | (raw[8] >> (8 - shift));
+
+    if (!isCleanMFM64(cells, (raw[0] >> (8 - shift)) & 1))
+    {
+        return 0;
+    }
+
+    while (rawCount - consumed >= 16)
+    {
+        uint64_t next = (loadMFM64(raw + consumed + 8) << shift) |
+                        (raw[consumed + 16] >> (8 - shift));
+
+        if (!isCleanMFM64(next, cells & 1))
+        {
+            break;
+        }
+
+        storeMFM64(decoded + (consumed >> 1), cells);
+
+        cells     = next;
+        consumed += 8;
+    }
+
+    // with too few raw bytes for a full chunk after the last one, the 32 cells after it
+    // are enough to cover the pending bits and a sync mark starting in it
+    if ((rawCount - consumed >= 10) && (rawCount - consumed < 16))
+    {
+        const uint8_t *after  = raw + consumed + 8;
+        uint32_t       next   = (((uint64_t) after[0] << 32) | ((uint64_t) after[1] << 24) |
+                                 (after[2] << 16) | (after[3] << 8) | after[4]) >> (8 - shift);
+        uint32_t       around = (next >> 1) | ((uint32_t) (cells & 1) << 31) | (next << 1);
+
+        if ((~(next ^ around) & 0xaaaaaaaa) == 0)
+        {
+            storeMFM64(decoded + (consumed >> 1), cells);
+
+            consumed += 8;
+        }
+    }
+
+    return consumed;
+}
+
+#ifdef DECODE_X86_KERNELS
+
+//! load the cells of 8 bytes, each in a 16-bit lane with the first cell in b15
+//!
+//! @param raw      first raw byte
+//! @param shift    bits to shift the raw bytes left by
+//! @param before   [out] data cell before each byte, in b15
+//!
+//! @return cells
+//!
+static inline __m128i
+loadMFMCellsSSE2(const uint8_t *raw,
+                 unsigned int   shift,
+                 __m128i       &before)
+{
+    __m128i hi = _mm_loadu_si128((const __m128i *) raw);
+    __m128i lo = _mm_loadu_si128((const __m128i *) (raw + 1));
+
+    // each raw byte pair, and the high bits of the byte after it
+    hi = _mm_or_si128(_mm_slli_epi16(hi, 8), _mm_srli_epi16(hi, 8));
+    lo = _mm_srli_epi16(lo, 8);
+
+    before = _mm_slli_epi16(_mm_srl_epi16(hi, _mm_cvtsi32_si128(16 - shift)), 15);
+
+    return _mm_or_si128(_mm_sll_epi16(hi, _mm_cvtsi32_si128(shift)),
+                        _mm_srl_epi16(lo, _mm_cvtsi32_si128(8 - shift)));
+}
+
+
+//! check the cells of 8 bytes for clock violations
+//!
+//! @param cells    cells to check
+//! @param before   data cell before each byte, in b15
+//!
+//! @return true if every clock cell is set only when both data cells around it are clear
+//!
+static inline bool
+isCleanMFMSSE2(__m128i cells,
+               __m128i before)
+{
+    const __m128i clocks = _mm_set1_epi16(0xaaaa);
+
+    __m128i around = _mm_or_si128(_mm_or_si128(_mm_srli_epi16(cells, 1),
+                                               _mm_slli_epi16(cells, 1)), before);
+
+    // a clock cell must differ from the OR of its data cells
+    __m128i differ = _mm_and_si128(_mm_xor_si128(cells, around), clocks);
+
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(differ, clocks)) == 0xffff;
+}
+
+
+//! gather the data cells of 8 bytes
+//!
+//! @param cells    cells, each byte in a 16-bit lane with the first cell in b15
+//!
+//! @return decoded bytes, one in the low byte of each 16-bit lane
+//!
+static inline __m128i
+gatherMFMSSE2(__m128i cells)
+{
+    __m128i bits = _mm_and_si128(cells, _mm_set1_epi16(0x5555));
+
+    bits = _mm_and_si128(_mm_or_si128(bits, _mm_srli_epi16(bits, 1)), _mm_set1_epi16(0x3333));
+    bits = _mm_and_si128(_mm_or_si128(bits, _mm_srli_epi16(bits, 2)), _mm_set1_epi16(0x0f0f));
+
+    return _mm_and_si128(_mm_or_si128(bits, _mm_srli_epi16(bits, 4)), _mm_set1_epi16(0x00ff));
+}
+
+
+//! SSE2 clean MFM kernel - 32 raw bytes to 16 decoded bytes per iteration
+//!
+static unsigned int
+decodeMFMCleanSSE2(uint8_t       *decoded,
+                   const uint8_t *mfmEncoded,
+                   unsigned int   rawCount,
+                   unsigned int   pending)
+{
+    unsigned int        shift;
+    const uint8_t      *raw      = findMFMCells(mfmEncoded, pending, shift);
+    unsigned int        consumed = 0;
+
+    if (rawCount >= 48)
+    {
+        __m128i before;
+        __m128i cells = loadMFMCellsSSE2(raw, shift, before);
+
+        if (isCleanMFMSSE2(cells, before))
+        {
+            while (rawCount - consumed >= 48)
+            {
+                __m128i nextBefore;
+                __m128i afterBefore;
+                __m128i next  = loadMFMCellsSSE2(raw + consumed + 16, shift, nextBefore);
+                __m128i after = loadMFMCellsSSE2(raw + consumed + 32, shift, afterBefore);
+
+                if (!isCleanMFMSSE2(next, nextBefore) || !isCleanMFMSSE2(after, afterBefore))
+                {
+                    break;
+                }
+
+                _mm_storeu_si128((__m128i *) (decoded + (consumed >> 1)),
+                                 _mm_packus_epi16(gatherMFMSSE2(cells), gatherMFMSSE2(next)));
+
+                cells     = after;
+                consumed += 32;
+            }
+        }
+    }
+
+    return consumed + decodeMFMClean64(decoded + (consumed >> 1), mfmEncoded + consumed,
+                                       rawCount - consumed, pending);
+}
+
+
+//! load the cells of 16 bytes, each in a 16-bit lane with the first cell in b15
+//!
+//! @param raw      first raw byte
+//! @param shift    bits to shift the raw bytes left by
+//! @param before   [out] data cell before each byte, in b15
+//!
+//! @return cells
+//!
+__attribute__((target("avx2")))
+static inline __m256i
+loadMFMCellsAVX2(const uint8_t *raw,
+                 unsigned int   shift,
+                 __m256i       &before)
+{
+    const __m256i swap = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                          1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+
+    __m256i hi = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *) raw), swap);
+    __m256i lo = _mm256_srli_epi16(_mm256_loadu_si256((const __m256i *) (raw + 1)), 8);
+
+    before = _mm256_slli_epi16(_mm256_srl_epi16(hi, _mm_cvtsi32_si128(16 - shift)), 15);
+
+    return _mm256_or_si256(_mm256_sll_epi16(hi, _mm_cvtsi32_si128(shift)),
+                           _mm256_srl_epi16(lo, _mm_cvtsi32_si128(8 - shift)));
+}
+
+
+//! check the cells of 16 bytes for clock violations
+//!
+//! @param cells    cells to check
+//! @param before   data cell before each byte, in b15
+//!
+//! @return true if every clock cell is set only when both data cells around it are clear
+//!
+__attribute__((target("avx2")))
+static inline bool
+isCleanMFMAVX2(__m256i cells,
+               __m256i before)
+{
+    __m256i around = _mm256_or_si256(_mm256_or_si256(_mm256_srli_epi16(cells, 1),
+                                                     _mm256_slli_epi16(cells, 1)), before);
+
+    // a clock cell must differ from the OR of its data cells
+    return _mm256_testc_si256(_mm256_xor_si256(cells, around), _mm256_set1_epi16(0xaaaa));
+}
+
+
+//! gather the data cells of 16 bytes
+//!
+//! @param cells    cells, each byte in a 16-bit lane with the first cell in b15
+//!
+//! @return decoded bytes, one in the low byte of each 16-bit lane
+//!
+__attribute__((target("avx2")))
+static inline __m256i
+gatherMFMAVX2(__m256i cells)
+{
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+
+    // data cells of each nibble, for the low and the high nibble of a byte
+    const __m256i dataLo = _mm256_setr_epi8(0, 1, 0, 1, 2, 3, 2, 3, 0, 1, 0, 1, 2, 3, 2, 3,
+                                            0, 1, 0, 1, 2, 3, 2, 3, 0, 1, 0, 1, 2, 3, 2, 3);
+    const __m256i dataHi = _mm256_slli_epi16(dataLo, 2);
+
+    __m256i half = _mm256_or_si256(_mm256_shuffle_epi8(dataLo, _mm256_and_si256(cells, nibble)),
+                                   _mm256_shuffle_epi8(dataHi,
+                                                       _mm256_and_si256(_mm256_srli_epi16(cells, 4),
+                                                                        nibble)));
+
+    // first byte of cells to the high nibble
+    return _mm256_maddubs_epi16(half, _mm256_set1_epi16(0x1001));
+}
+
+
+//! AVX2 clean MFM kernel - 64 raw bytes to 32 decoded bytes per iteration
+//!
+__attribute__((target("avx2")))
+static unsigned int
+decodeMFMCleanAVX2(uint8_t       *decoded,
+                   const uint8_t *mfmEncoded,
+                   unsigned int   rawCount,
+                   unsigned int   pending)
+{
+    unsigned int        shift;
+    const uint8_t      *raw      = findMFMCells(mfmEncoded, pending, shift);
+    unsigned int        consumed = 0;
+
+    if (rawCount >= 96)
+    {
+        __m256i before;
+        __m256i cells = loadMFMCellsAVX2(raw, shift, before);
+
+        if (isCleanMFMAVX2(cells, before))
+        {
+            while (rawCount - consumed >= 96)
+            {
+                __m256i nextBefore;
+                __m256i afterBefore;
+                __m256i next  = loadMFMCellsAVX2(raw + consumed + 32, shift, nextBefore);
+                __m256i after = loadMFMCellsAVX2(raw + consumed + 64, shift, afterBefore);
+
+                if (!isCleanMFMAVX2(next, nextBefore) || !isCleanMFMAVX2(after, afterBefore))
+                {
+                    break;
+                }
+
+                // pack works within each 128-bit lane, put the quad-words back in order
+                __m256i packed = _mm256_packus_epi16(gatherMFMAVX2(cells), gatherMFMAVX2(next));
+
+                _mm256_storeu_si256((__m256i *) (decoded + (consumed >> 1)),
+                                    _mm256_permute4x64_epi64(packed, 0xd8));
+
+                cells     = after;
+                consumed += 64;
+            }
+        }
+    }
+
+    // the SSE2 kernel for the rest isn't VEX encoded, clear the upper halves first
+    _mm256_zeroupper();
+
+    return consumed + decodeMFMCleanSSE2(decoded + (consumed >> 1), mfmEncoded + consumed,
+                                         rawCount - consumed, pending);
+}
+
+#endif
+
+
+//! get the clean MFM kernel for the requested kernel type
+//!
+//! @param kernel   requested kernel
+//!
+//! @return kernel function, nullptr for state machine only decoding with kernel_Table.
+//!
+static MFMCleanKernel
+getMFMCleanKernel(Decode::FMKernel kernel)
+{
+#ifdef DECODE_X86_KERNELS
+    switch (kernel)
+    {
+        case Decode::kernel_Auto:
+            if (__builtin_cpu_supports("avx2"))
+            {
+                return decodeMFMCleanAVX2;
+            }
+            if (__builtin_cpu_supports("sse2"))
+            {
+                return decodeMFMCleanSSE2;
+            }
+            return decodeMFMClean64;
+        case Decode::kernel_SSE2:
+            return decodeMFMCleanSSE2;
+        case Decode::kernel_AVX2:
+            return decodeMFMCleanAVX2;
+        case Decode::kernel_Table:
+            return nullptr;
+    }
+#endif
+
+    return (kernel == Decode::kernel_Table) ? nullptr : decodeMFMClean64;
+}
+
+
+//!  decodeMFM()
+//!
+//!  Streaming MFM decode. Raw data can be passed in pieces of any size, the state
+//!  carries the partial bits from one call to the next. The stream is assumed to be
+//!  byte aligned from the start, and is realigned each time an A1 sync mark (0x4489,
+//!  with the missing clock) is found.
+//!
+//!  Bytes are only produced once it is known that a sync mark can't start inside of
+//!  them, so one decoded byte can be held back until the next call or a flush.
+//!
+//!  Runs with no clock violations are decoded by the vector kernel picked with
+//!  setFMKernel(), everything else goes through the state machine.
+//!
+//!  @param decoded       pointer to processed buffer, must hold (rawCount / 2) + 2 bytes
+//!  @param mfmEncoded    pointer to raw buffer
+//!  @param rawCount      number of bytes in the raw buffer
+//!  @param state         decode state
+//!  @param flush         end of the stream, decode any held back bytes
+//!
+//!  @return number of bytes written to decoded
+//!
+unsigned int
+Decode::decodeMFM(uint8_t      *decoded,
+                  uint8_t      *mfmEncoded,
+                  unsigned int  rawCount,
+                  MFMState     &state,
+                  bool          flush)
+{
+    uint8_t        *out        = decoded;
+    uint64_t        window     = state.window;
+    unsigned int    pending    = state.pending;
+    unsigned int    lastData   = state.lastData;
+    unsigned int    zeroErrors = state.zeroErrors;
+    unsigned int    oneErrors  = state.oneErrors;
+    const uint8_t  *begin      = mfmEncoded;
+    MFMCleanKernel  kernel     = getMFMCleanKernel(fmKernel_m);
+    unsigned int    kernelFrom = mfmKernelBefore_c;
+
+    while (rawCount)
+    {
+        // runs with no clock violations can't hold a sync mark, and go through the kernel
+        if (kernel && ((unsigned int) (mfmEncoded - begin) >= kernelFrom) &&
+            (pending >= 16) && (pending < 32))
+        {
+            unsigned int used = kernel(out, mfmEncoded, rawCount, pending);
+
+            if (used)
+            {
+                out        += used >> 1;
+                mfmEncoded += used;
+                rawCount   -= used;
+                lastData    = out[-1] & 1;
+                window      = loadMFM64(mfmEncoded - 8);
+            }
+
+            // the state machine gets past the violation before the kernel is tried again
+            kernelFrom = (mfmEncoded - begin) + mfmKernelSkip_c;
+            continue;
+        }
+
+        // common case, no sync mark can end in the next four raw bytes and there are
+        // exactly two bytes to decode, leaving the same number of pending bits.
+        if ((rawCount >= 4) && (pending >= 16) && (pending < 32))
+        {
+            uint64_t next = (window << 32) |
+                            ((uint32_t) mfmEncoded[0] << 24) | ((uint32_t) mfmEncoded[1] << 16) |
+                            ((uint32_t) mfmEncoded[2] <<  8) |  (uint32_t) mfmEncoded[3];
+
+            if ((mfmSyncTable[(next >> 28) & 0xfff] | mfmSyncTable[(next >> 20) & 0xfff] |
+                 mfmSyncTable[(next >> 12) & 0xfff] | mfmSyncTable[(next >>  4) & 0xfff]) == 0)
+            {
+                window      = next;
+                mfmEncoded += 4;
+                rawCount   -= 4;
+
+                *out++ = decodeMFMCells(window >> (pending + 16), lastData, zeroErrors, oneErrors);
+                *out++ = decodeMFMCells(window >> pending, lastData, zeroErrors, oneErrors);
+                continue;
+            }
+        }
+
+        window   = (window << 8) | *mfmEncoded++;
+        pending += 8;
+        rawCount--;
+
+        // check each position a sync mark could end in the new bits, oldest first
+        unsigned int candidates = mfmSyncTable[(window >> 4) & 0xfff];
+
+        for (int pos = 7; candidates && (pos >= 0); pos--)
+        {
+            if ((candidates & (1 << pos)) &&
+                ((pending - pos) >= 16) &&
+                (((window >> pos) & 0xffff) == mfmSyncMark_c))
+            {
+                unsigned int before = pending - pos - 16;
+
+                // complete bytes ahead of the mark
+                while (before >= 16)
+                {
+                    *out++   = decodeMFMCells(window >> (pending - 16), lastData, zeroErrors,
+                                              oneErrors);
+                    pending -= 16;
+                    before  -= 16;
+                }
+
+                // partial byte ahead of the mark is dropped
+                if (before)
+                {
+                    state.resyncs++;
+                }
+
+                *out++   = mfmSyncByte_c;
+                lastData = mfmSyncByte_c & 1;
+                state.syncMarks++;
+
+                pending = pos;
+            }
+        }
+
+        // a sync mark starting in the low 16 bits could still realign them
+        while (pending >= 32)
+        {
+            *out++   = decodeMFMCells(window >> (pending - 16), lastData, zeroErrors, oneErrors);
+            pending -= 16;
+        }
+    }
+
+    if (flush)
+    {
+        while (pending >= 16)
+        {
+            *out++   = decodeMFMCells(window >> (pending - 16), lastData, zeroErrors, oneErrors);
+            pending -= 16;
+        }
+
+        // partial byte at the end of the stream
+        pending = 0;
+    }
+
+    state.lastData   = lastData;
+    state.zeroErrors = zeroErrors;
+    state.oneErrors  = oneErrors;
+    state.window  = window;
+    state.pending = pending;
+
+    return out - decoded;
+}
+
+
+//!  decodeMFM()
+//!
+//!  Decode into the shared last error counts, kept for existing callers. Not safe to
+//!  call from more than one thread, use the DecodeContext version for that.
+//!
+//!  @param decode        pointer to processed buffer
+//!  @param mfmEncoded    pointer to raw buffer
+//!  @param count         number of bytes in the final processed file
+//!
+//!  @return number of errors (currently returns zero)
+//!
+int
+Decode::decodeMFM(uint8_t       *decoded,
+                  uint8_t       *mfmEncoded,
+                  unsigned int   count)
+{
+    DecodeContext context;
+    int           status = decodeMFM(decoded, mfmEncoded, count, context);
+
+    lastZeroErrors = context.zeroErrors;
+    lastOneErrors  = context.oneErrors;
+
+    return status;
+}
+
+
+//!  decodeMFM()
+//!
+//!  One shot decode of a whole buffer. Only the error counts are returned in the
+//!  context, MFM errors don't record positions and there is no FM phase.
+//!
+//!  @param decode        pointer to processed buffer
+//!  @param mfmEncoded    pointer to raw buffer
+//!  @param count         number of bytes in the final processed file
+//!  @param context       [out] error counts
+//!
+//!  @return number of errors (currently returns zero)
+//!
+//!  \todo change count from bytes in decoded buffer to bytes in raw buffer.
+//!
+int
+Decode::decodeMFM(uint8_t       *decoded,
+                  uint8_t       *mfmEncoded,
+                  unsigned int   count,
+                  DecodeContext &context)
+{
+    MFMState     state;
+    unsigned int length = decodeMFM(decoded, mfmEncoded, count << 1, state, true);
+
+    // bits dropped while resyncing leave the end of the buffer short
+    while (length < count)
+    {
+        decoded[length++] = 0;
+    }
+
+    context.reset();
+    context.zeroErrors = state.zeroErrors;
+    context.oneErrors  = state.oneErrors;
+    context.lastBit    = state.lastData;
+
+    return 0;
+}
+
+
+//! DecodeContext constructor
+//!
+DecodeContext::DecodeContext(): errorMap(nullptr)
+{
+    reset();
+}
+
+
+//! reset the results, done at the start of each decode
+//!
+void
+DecodeContext::reset()
+{
+    zeroErrors         = 0;
+    oneErrors          = 0;
+    state              = Decode::none;
+    lastBit            = 0;
+    errorPositionCount = 0;
+}
+
+
+//! record the position of a clock error
+//!
+//! @param cell  bit cell of the error, from the start of the raw buffer. This is also
+//!              the bit offset of the error in the decoded buffer.
+//!
+void
+DecodeContext::addErrorPosition(unsigned int cell)
+{
+    if (errorPositionCount < maxErrorPositions_c)
+    {
+        errorPositions[errorPositionCount] = cell;
+    }
+    errorPositionCount++;
+}
+
+
+//! check the error map for clock errors in a range of decoded bytes
+//!
+//! @param offset  first decoded byte
+//! @param length  number of decoded bytes
+//!
+//! @return true if any byte in the range had a clock error, or no error map was given
+//!         and the decode had an error
+//!
+bool
+DecodeContext::hasErrors(unsigned int offset,
+                         unsigned int length) const
+{
+    if (!errorMap)
+    {
+        return (zeroErrors + oneErrors) != 0;
+    }
+
+    for (unsigned int pos = offset; pos < offset + length; pos++)
+    {
+        if (errorMap[pos >> 3] & (1 << (pos & 7)))
+        {
+            return true;
+        }
+    }
+
+    return false;
 }
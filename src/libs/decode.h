@@ -7,31 +7,140 @@
 #define __DECODE_H__
 
 #include <stdint.h>
+#include <array>
+
+struct DecodeContext;
 
 class Decode
 {
 public:
 
+    //! current state of the decoding
+    enum State { 
+       none,  // Haven't yet determined the position of the data bit
+       hi,    // Expect data bit to be in the high bit
+       lo     // Expect data bit to be in the low bit
+    };
+
+    //! kernel used to strip the clocks from clean FM and MFM data
+    enum FMKernel
+    {
+        kernel_Auto,    // pick the best kernel the cpu supports
+        kernel_Table,   // table driven scalar decode only
+        kernel_SSE2,
+        kernel_AVX2
+    };
+
+    static bool     setFMKernel(FMKernel kernel);
+    static FMKernel getFMKernel();
+
     static int decodeFM(uint8_t      *decoded,
                         uint8_t      *fmEncoded, 
                         unsigned int  count);
 
+    static int decodeFM(uint8_t       *decoded,
+                        uint8_t       *fmEncoded,
+                        unsigned int   count,
+                        DecodeContext &context);
+
+    static int decodeFMReference(uint8_t      *decoded,
+                                 uint8_t      *fmEncoded,
+                                 unsigned int  count);
+
+    static int decodeFMReference(uint8_t       *decoded,
+                                 uint8_t       *fmEncoded,
+                                 unsigned int   count,
+                                 DecodeContext &context);
+
+    //! state carried between calls to the streaming MFM decoder
+    struct MFMState
+    {
+        MFMState();
+
+        void         reset();
+
+        uint64_t     window;       // raw bits not yet decoded, newest bit in b0
+        unsigned int pending;      // number of valid bits in window
+        unsigned int lastData;     // last decoded data bit, needed to check the next clock
+        unsigned int syncMarks;    // A1 sync marks found
+        unsigned int resyncs;      // sync marks that changed the byte alignment
+        unsigned int zeroErrors;   // clock bits missing
+        unsigned int oneErrors;    // clock bits present when they should not be
+    };
+
     static int decodeMFM(uint8_t      *decoded,
                          uint8_t      *mfmEncoded,
                          unsigned int  count);
 
+    static int decodeMFM(uint8_t       *decoded,
+                         uint8_t       *mfmEncoded,
+                         unsigned int   count,
+                         DecodeContext &context);
+
+    static unsigned int decodeMFM(uint8_t      *decoded,
+                                  uint8_t      *mfmEncoded,
+                                  unsigned int  rawCount,
+                                  MFMState     &state,
+                                  bool          flush = false);
+
+    //! raw cells of the A1 sync mark, with the missing clock
+    static const uint16_t mfmSyncMark_c = 0x4489;
+    static const uint8_t  mfmSyncByte_c = 0xa1;
+
 private:
 
-    //! current state of the decoding
-    enum State { 
-       none,  // Haven't yet determined the position of the data bit
-       hi,    // Expect data bit to be in the high bit
-       lo     // Expect data bit to be in the low bit
-    };
+    //! number of table states - each State combined with the last decoded bit
+    static const unsigned int fmTableStates_c = 6;
 
+    static constexpr std::array<uint32_t, fmTableStates_c * 256> genFMTable();
+
+    static int decodeFMTable(uint8_t       *decoded,
+                             uint8_t       *fmEncoded,
+                             unsigned int   count,
+                             unsigned int  &tableState,
+                             DecodeContext &context,
+                             unsigned int   cell);
+
+    //! decode table, indexed by (state, last bit, raw byte)
+    static const std::array<uint32_t, fmTableStates_c * 256> fmTable_m;
+
+    static FMKernel fmKernel_m;
+
+    //! only updated by the calls without a DecodeContext
     static int lastZeroErrors;
     static int lastOneErrors;
 
 };
 
+
+//! results of one decode call
+//!
+//! Each caller owns its own context, so decodes can run on several threads at once.
+//!
+struct DecodeContext
+{
+    DecodeContext();
+
+    void          reset();
+    void          addErrorPosition(unsigned int cell);
+    bool          hasErrors(unsigned int offset,
+                            unsigned int length) const;
+
+    //! most error positions kept, errorPositionCount keeps counting past this
+    static const unsigned int maxErrorPositions_c = 64;
+
+    unsigned int  zeroErrors;          // clock bits missing
+    unsigned int  oneErrors;           // clock bits present when they should not be
+    Decode::State state;               // final phase of the FM decoder
+    unsigned int  lastBit;             // last decoded data bit
+
+    unsigned int  errorPositionCount;  // number of errors with a recorded position
+    uint32_t      errorPositions[maxErrorPositions_c]; // bit cell of each error, FM only
+
+    //! optional, set by the caller before the decode. One bit per decoded byte, set if
+    //! the byte had a clock error, byte n is bit (n & 7) of errorMap[n >> 3]. Must hold
+    //! (count + 7) / 8 bytes. Not changed by reset().
+    uint8_t      *errorMap;
+};
+
 #endif
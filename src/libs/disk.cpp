@@ -41,44 +41,39 @@ Disk::numSectors(uint8_t track,
 }
 
 
-//! return an array of half the sectors to read in
+//! read all the sectors of a track, one sector at a time
 //!
-//! @param out
-//! @param track
+//! @param buffer     buffer for the processed sectors, in sector order
+//! @param rawBuffer  buffer for the raw sectors, in sector order
+//! @param status     [out] status of each sector
 //! @param side
-//! @param which_half
+//! @param track
+//!
+//! @return status of the read, the sectors can still have errors
 //!
-void
-Disk::halfTheSectors(SectorList **out,
-                     uint8_t      track,
-                     uint8_t      side,
-                     uint8_t      start)
+int
+Disk::readTrack(uint8_t *buffer,
+                uint8_t *rawBuffer,
+                int     *status,
+                uint8_t  side,
+                uint8_t  track)
 {
-    uint8_t first = minSector(track, side) + start;
+    uint8_t first = minSector(track, side);
     uint8_t last  = maxSector(track, side);
 
-    for (uint8_t sector = first; sector <= last; sector += 2)
+    for (uint8_t sector = first; sector <= last; sector++)
     {
-        (*out)->sector = sector;
-        (*out)++;
-    }
-}
-
+        status[sector - first] = readSector(buffer, rawBuffer, side, track, sector);
 
-//! get the best read order for the given track and side
-//!
-//! @param out
-//! @param track
-//! @param side
-//!
-void
-Disk::genBestReadOrder(SectorList *out,
-                       uint8_t     track,
-                       uint8_t     side)
-{
-    // even 0, 2, 4, ...
-    halfTheSectors(&out, track, side, 0);
+        if (buffer)
+        {
+            buffer += sectorBytes(side, track, sector);
+        }
+        if (rawBuffer)
+        {
+            rawBuffer += sectorRawBytes(side, track, sector);
+        }
+    }
 
-    // odd 1, 3, 5, ...
-    halfTheSectors(&out, track, side, 1);
+    return 0;
 }
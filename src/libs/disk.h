@@ -7,12 +7,6 @@
 
 #include <stdint.h>
 
-struct SectorList
-{
-    uint8_t  sector;
-};
-
-
 class Disk
 {
 public:
@@ -64,15 +58,12 @@ public:
                            uint8_t track,
                            uint8_t sector) = 0;
 
-    virtual void genBestReadOrder(SectorList *out,
-                                  uint8_t        track,
-                                  uint8_t        side);
-
-private:
-    virtual void halfTheSectors(SectorList **out,
-                                uint8_t         track,
-                                uint8_t         side,
-                                uint8_t         which_half); 
+    // read all the sectors of a track, in sector order
+    virtual int readTrack(uint8_t *buffer,
+                          uint8_t *rawBuffer,
+                          int     *status,
+                          uint8_t  side,
+                          uint8_t  track);
 
 };
 
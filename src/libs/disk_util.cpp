@@ -4,11 +4,13 @@
 //!
 
 #include "disk_util.h"
+#include "decode.h"
 
 #include <stdio.h>
 #include <cstring>
 #include <cctype> 
 #include <stdint.h>
+#include <vector>
 
 //! sector error codes converted to human text
 //!
@@ -45,6 +47,57 @@ updateChecksum(uint8_t checksum,
 }
 
 
+//! Update checksum with a block of data bytes
+//!
+//! Unrolling the XOR then rotate gives
+//!
+//!   checksum(n) = rotl(checksum(0), n) ^ rotl(val[1], n) ^ rotl(val[2], n - 1) ^ ... ^ rotl(val[n], 1)
+//!
+//! and the rotations repeat every 8 bytes. So bytes 8 apart can just be XORed together,
+//! a word at a time, and only the 8 byte lanes of the result need to be rotated.
+//!
+//! @param checksum  - existing checksum
+//! @param buf       - data bytes
+//! @param length    - number of data bytes
+//!
+//! @return updated checksum
+uint8_t
+blockChecksum(uint8_t        checksum,
+              const uint8_t *buf,
+              unsigned int   length)
+{
+    unsigned int  words = length >> 3;
+    uint64_t      fold  = 0;
+    uint8_t       lanes[8];
+
+    for (unsigned int i = 0; i < words; i++)
+    {
+        uint64_t word;
+
+        memcpy(&word, &buf[i << 3], sizeof(word));
+        fold ^= word;
+    }
+
+    memcpy(lanes, &fold, sizeof(lanes));
+
+    // a multiple of 8 rotations leaves the starting checksum unchanged, lane k is
+    // rotated by (8 - k) bits.
+    for (unsigned int k = 0; k < 8; k++)
+    {
+        unsigned int rotate = (8 - k) & 7;
+
+        checksum ^= (uint8_t) ((lanes[k] << rotate) | (lanes[k] >> ((8 - rotate) & 7)));
+    }
+
+    for (unsigned int i = words << 3; i < length; i++)
+    {
+        checksum = updateChecksum(checksum, buf[i]);
+    }
+
+    return checksum;
+}
+
+
 void
 writeOutput(uint8_t  *out,
             uint16_t &pos,
@@ -57,25 +110,141 @@ writeOutput(uint8_t  *out,
     }
 }
 
+//! find the first sync byte in a bit stream
+//!
+//! Gives the same result as calling shiftByte() for each bit offset from 0 to maxShift
+//! at each byte position from pos to end, stopping at the first match. Instead the raw
+//! stream is compared against the bit reversed sync byte, 57 bit alignments at a time
+//! from a 64-bit window. Near the end of the buffer it falls back to shiftByte().
+//!
+//! @param in        - buffer of unaligned data
+//! @param length    - size of buffer
+//! @param pos       - [in/out] first byte position to check, set to the position of the
+//!                    sync or end if not found
+//! @param end       - byte position to stop checking at
+//! @param bitOffset - [out] bit offset of the sync, maxShift + 1 if not found
+//! @param maxShift  - highest bit offset to check at each position, 7 or 8
+//! @param syncByte  - byte to look for
+//!
+//! @return true if the sync byte was found
+//!
+static bool
+findSync(uint8_t       *in,
+         uint16_t       length,
+         unsigned int  &pos,
+         unsigned int   end,
+         unsigned char &bitOffset,
+         unsigned char  maxShift,
+         uint8_t        syncByte)
+{
+    if (pos >= end)
+    {
+        return false;
+    }
+
+    uint8_t       pattern = reverseChar(syncByte);
+    unsigned int  start   = pos;
+    unsigned int  bit     = pos * 8;
+    unsigned int  last    = (end - 1) * 8 + maxShift;
+
+    while ((bit <= last) && ((bit >> 3) + 8 <= length))
+    {
+        unsigned int base   = bit & ~7u;
+        uint64_t     window = 0;
+
+        for (int i = 0; i < 8; i++)
+        {
+            window = (window << 8) | in[(base >> 3) + i];
+        }
+
+        // bit (63 - i) is set if the pattern starts at bit i of the window, i <= 56
+        uint64_t match = ~0ull << 7;
+
+        for (int j = 0; j < 8; j++)
+        {
+            match &= ((pattern >> (7 - j)) & 1) ? (window << j) : ~(window << j);
+        }
+
+        match &= ~0ull >> (bit - base);
+
+        if (last - base < 56)
+        {
+            match &= ~0ull << (63 - (last - base));
+        }
+
+        if (match)
+        {
+            bit = base + __builtin_clzll(match);
+
+            // a byte boundary is found as the end of the previous position first
+            if ((maxShift == 8) && ((bit & 7) == 0) && ((bit >> 3) > start))
+            {
+                pos       = (bit >> 3) - 1;
+                bitOffset = 8;
+            }
+            else
+            {
+                pos       = bit >> 3;
+                bitOffset = bit & 7;
+            }
+
+            return true;
+        }
+
+        bit = base + 57;
+    }
+
+    for (pos = bit >> 3; pos < end; pos++)
+    {
+        for (bitOffset = (pos == (bit >> 3)) ? (bit & 7) : 0; bitOffset <= maxShift; bitOffset++)
+        {
+            if (shiftByte(in[pos], in[pos + 1], bitOffset) == syncByte)
+            {
+                return true;
+            }
+        }
+    }
+
+    pos       = end;
+    bitOffset = maxShift + 1;
+
+    return false;
+}
+
+
+//! where alignSectorSyncs() found the syncs, and the checksums of the aligned fields
+//!
+struct SectorSyncs
+{
+    bool          headerFound;
+    unsigned int  headerPos;       // input position of the header sync
+    bool          dataFound;
+    unsigned int  dataPos;         // input position of the data sync
+    uint8_t       headerChecksum;  // volume, track and sector
+    uint8_t       dataChecksum;    // 256 data bytes
+};
+
+
 //! Align sector data to the sync byte
 //!
 //! @param out      - buffer to store aligned data
 //! @param in       - buffer of unaligned data
 //! @param length   - size of buffer
 //! @param syncByte - byte to sync buffer
+//! @param syncs    - [out] sync positions, checksums are only set if verify is true
 //!
 //! @return result
 //!
-int
-alignSector(uint8_t  *out,
-            uint8_t  *in,
-            uint16_t  length,
-            uint8_t   syncByte)
+template <bool verify>
+static int
+alignSectorSyncs(uint8_t     *out,
+                 uint8_t     *in,
+                 uint16_t     length,
+                 uint8_t      syncByte,
+                 SectorSyncs &syncs)
 {
-    bool          foundHeadSync = false;
-    bool          foundDataSync = false;
-
     unsigned int  pos = 0;
+    unsigned int  start;
     uint16_t      outPos = 0;
     unsigned char bitOffset = 0;
     unsigned char bitOffset2 = 0;
@@ -91,82 +260,88 @@ alignSector(uint8_t  *out,
     // 350 - (256 + 2 + 5)
     //! \todo - change to just 320 and try to get more out even if 
     //! it is not complete.
-    for ( ; pos < 87; pos++)
-    {
-        for (bitOffset = 0; bitOffset < 8; bitOffset++)
-        {
-            unsigned val = shiftByte(in[pos], in[pos + 1], bitOffset);
-
-            //printf("in[%d] = 0x%02x  val = 0x%02x bo = %d\n", pos, in[pos], val, bitOffset);
-            if (val == syncByte)
-            {
-                foundHeadSync = true;  // needed to get out of the pos loop
-                break;
-            }
-        }
-        if (foundHeadSync)
-        {
-            //printf("foundHeadSync: pos - %d  bitOffset - %d\n",pos, bitOffset);
-            break;
-        }
+    start = pos;
+    syncs.headerFound = findSync(in, length, pos, 87, bitOffset, 7, syncByte);
+    syncs.headerPos   = pos;
 
-        // either set everything to zero, or just copy out the in, or could even come back
-        // and align this based on sync byte found
-        // \todo determine which to do.
-        //  out[pos] = 0;
-        //  out[pos] = in[pos];
-        //
-        // Depends on what point you want the emulation to work on, if it's
-        // on the bit level, then it should probably not be processed to
-        // be aligned. The S2350 USART will be in sync mode and only present 
-        // data once the pattern is found, so there is no harm in making
-        // these zero
-        //out[outPos++] = 0;
+    // either set everything to zero, or just copy out the in, or could even come back
+    // and align this based on sync byte found
+    // \todo determine which to do.
+    //
+    // Depends on what point you want the emulation to work on, if it's
+    // on the bit level, then it should probably not be processed to
+    // be aligned. The S2350 USART will be in sync mode and only present 
+    // data once the pattern is found, so there is no harm in making
+    // these zero
+    for (unsigned int i = start; i < pos; i++)
+    {
         writeOutput(out, outPos, 0, length);
     }
 
     // Copy out the header
+    uint8_t checksum = 0;
+
     for (int i = 0; i < 5; i++)
     {
+        uint8_t val = shiftByte(in[pos], in[pos + 1], bitOffset);
+
         //out[outPos++] = shiftByte(in[pos], in[pos + 1], bitOffset);
-        writeOutput(out, outPos, shiftByte(in[pos], in[pos + 1], bitOffset), length);
+        writeOutput(out, outPos, val, length);
+
+        if (verify && (i >= 1) && (i <= 3))
+        {
+            checksum = updateChecksum(checksum, val);
+        }
 
         pos++;
     }
+    syncs.headerChecksum = checksum;
 
     // \todo should skip past the partial byte
     // out[pos++] = 0;
 
     // now find data block
-    for ( ; pos < 92;  pos++)
+    start = pos;
+    syncs.dataFound = findSync(in, length, pos, 92, bitOffset, 7, syncByte);
+    syncs.dataPos   = pos;
+
+    // same as above.
+    for (unsigned int i = start; i < pos; i++)
     {
-        for(bitOffset = 0; bitOffset < 8; bitOffset++)
-        {
-            uint8_t val = shiftByte(in[pos], in[pos + 1], bitOffset);
+        writeOutput(out, outPos, 0, length);
+    }
 
-            if (val == syncByte)
-            {
-                foundDataSync = true;  // needed to get out of the pos loop
-                break;
-            }
-        }
-        if (foundDataSync)
+    // copy data sector as aligned
+    if (outPos + 258 <= length)
+    {
+        shiftReverseBlock(&out[outPos], &in[pos], 258, bitOffset);
+
+        if (verify)
         {
-            //printf("foundDataSync: pos - %d  bitOffset - %d\n",pos, bitOffset);
-            break;
+            syncs.dataChecksum = blockChecksum(0, &out[outPos + 1], 256);
         }
 
-        // same as above.
-        //out[outPos++] = 0;
-        writeOutput(out, outPos, 0, length);
+        outPos += 258;
+        pos    += 258;
     }
-
-    // copy data sector as aligned
-    for (int i = 0; i < 258; i++)
+    else
     {
-        //out[outPos++] = shiftByte(in[pos], in[pos + 1], bitOffset);
-        writeOutput(out, outPos, shiftByte(in[pos], in[pos + 1], bitOffset), length);
-        pos++;
+        checksum = 0;
+
+        for (int i = 0; i < 258; i++)
+        {
+            uint8_t val = shiftByte(in[pos], in[pos + 1], bitOffset);
+
+            //out[outPos++] = shiftByte(in[pos], in[pos + 1], bitOffset);
+            writeOutput(out, outPos, val, length);
+
+            if (verify && (i >= 1) && (i <= 256))
+            {
+                checksum = updateChecksum(checksum, val);
+            }
+            pos++;
+        }
+        syncs.dataChecksum = checksum;
     }
 
     // \todo should skip past the partial byte
@@ -174,40 +349,35 @@ alignSector(uint8_t  *out,
 
     // find next header sync, this will allow the full track to have the correct number of
     // bytes between sectors.
-    foundHeadSync = false;
-    for (; pos < length; pos++)
+    start = pos;
+    bool foundHeadSync = findSync(in, length, pos, length, bitOffset2, 8, syncByte);
+
+    // the end of the track is not where it would be
+    // doing a sync, so until the next one, copy everything out
+    // with current bit offset
+    if (outPos + (pos - start) <= length)
     {
-        for(bitOffset2 = 0; bitOffset2 <= 8; bitOffset2++)
+        shiftReverseBlock(&out[outPos], &in[start], pos - start, bitOffset);
+        outPos += pos - start;
+    }
+    else
+    {
+        for (unsigned int i = start; i < pos; i++)
         {
-            uint8_t val = shiftByte(in[pos], in[pos + 1], bitOffset2);
-
-            if (val == syncByte)
-            {
-                // check to see if next byte is the sync, if so, add the zero
-                // and set offset to 0
-                if (bitOffset2 == 8) 
-                {
-                   //out[pos++] = 0;
-                   // writeOutput(out, outPos, 0, bitOffset), length);
-                   bitOffset2 = 0;
-                }
-
-                writeOutput(out, outPos, 0, length);
-
-                foundHeadSync = true;  // needed to get out of the pos loop
-                break;
-            }
+            writeOutput(out, outPos, shiftByte(in[i], in[i + 1], bitOffset), length);
         }
-        if (foundHeadSync)
+    }
+
+    if (foundHeadSync)
+    {
+        // check to see if next byte is the sync, if so, add the zero
+        // and set offset to 0
+        if (bitOffset2 == 8) 
         {
-            //printf("foundDataSync: pos - %d  bitOffset - %d\n",pos, bitOffset);
-            break;
+            bitOffset2 = 0;
         }
-        // the end of the track is not where it would be
-        // doing a sync, so until the next one, copy everything out
-        // with current bit offset
-        //out[pos] = shiftByte(in[pos], in[pos + 1], bitOffset);
-        writeOutput(out, outPos, shiftByte(in[pos], in[pos + 1], bitOffset), length);
+
+        writeOutput(out, outPos, 0, length);
     }
 
     for (; pos < (unsigned int) length - 1; pos++)
@@ -230,61 +400,105 @@ alignSector(uint8_t  *out,
     return No_Error;
 }
 
-//! Pre-calculated array to reverse all the bits in a byte.
-//
-static const uint8_t BitReverseTable[] = 
-{
-  0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0, 0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0, 
-  0x08, 0x88, 0x48, 0xC8, 0x28, 0xA8, 0x68, 0xE8, 0x18, 0x98, 0x58, 0xD8, 0x38, 0xB8, 0x78, 0xF8, 
-  0x04, 0x84, 0x44, 0xC4, 0x24, 0xA4, 0x64, 0xE4, 0x14, 0x94, 0x54, 0xD4, 0x34, 0xB4, 0x74, 0xF4, 
-  0x0C, 0x8C, 0x4C, 0xCC, 0x2C, 0xAC, 0x6C, 0xEC, 0x1C, 0x9C, 0x5C, 0xDC, 0x3C, 0xBC, 0x7C, 0xFC, 
-  0x02, 0x82, 0x42, 0xC2, 0x22, 0xA2, 0x62, 0xE2, 0x12, 0x92, 0x52, 0xD2, 0x32, 0xB2, 0x72, 0xF2, 
-  0x0A, 0x8A, 0x4A, 0xCA, 0x2A, 0xAA, 0x6A, 0xEA, 0x1A, 0x9A, 0x5A, 0xDA, 0x3A, 0xBA, 0x7A, 0xFA,
-  0x06, 0x86, 0x46, 0xC6, 0x26, 0xA6, 0x66, 0xE6, 0x16, 0x96, 0x56, 0xD6, 0x36, 0xB6, 0x76, 0xF6, 
-  0x0E, 0x8E, 0x4E, 0xCE, 0x2E, 0xAE, 0x6E, 0xEE, 0x1E, 0x9E, 0x5E, 0xDE, 0x3E, 0xBE, 0x7E, 0xFE,
-  0x01, 0x81, 0x41, 0xC1, 0x21, 0xA1, 0x61, 0xE1, 0x11, 0x91, 0x51, 0xD1, 0x31, 0xB1, 0x71, 0xF1,
-  0x09, 0x89, 0x49, 0xC9, 0x29, 0xA9, 0x69, 0xE9, 0x19, 0x99, 0x59, 0xD9, 0x39, 0xB9, 0x79, 0xF9, 
-  0x05, 0x85, 0x45, 0xC5, 0x25, 0xA5, 0x65, 0xE5, 0x15, 0x95, 0x55, 0xD5, 0x35, 0xB5, 0x75, 0xF5,
-  0x0D, 0x8D, 0x4D, 0xCD, 0x2D, 0xAD, 0x6D, 0xED, 0x1D, 0x9D, 0x5D, 0xDD, 0x3D, 0xBD, 0x7D, 0xFD,
-  0x03, 0x83, 0x43, 0xC3, 0x23, 0xA3, 0x63, 0xE3, 0x13, 0x93, 0x53, 0xD3, 0x33, 0xB3, 0x73, 0xF3, 
-  0x0B, 0x8B, 0x4B, 0xCB, 0x2B, 0xAB, 0x6B, 0xEB, 0x1B, 0x9B, 0x5B, 0xDB, 0x3B, 0xBB, 0x7B, 0xFB,
-  0x07, 0x87, 0x47, 0xC7, 0x27, 0xA7, 0x67, 0xE7, 0x17, 0x97, 0x57, 0xD7, 0x37, 0xB7, 0x77, 0xF7, 
-  0x0F, 0x8F, 0x4F, 0xCF, 0x2F, 0xAF, 0x6F, 0xEF, 0x1F, 0x9F, 0x5F, 0xDF, 0x3F, 0xBF, 0x7F, 0xFF
-};
 
-//! reverse the bits in a byte
+//! Align sector data to the sync byte
 //!
-//! @param val - value to reverse.
+//! @param out      - buffer to store aligned data
+//! @param in       - buffer of unaligned data
+//! @param length   - size of buffer
+//! @param syncByte - byte to sync buffer
 //!
-//! @return the reversed byte.
+//! @return result
 //!
-uint8_t
-reverseChar(uint8_t val)
+int
+alignSector(uint8_t  *out,
+            uint8_t  *in,
+            uint16_t  length,
+            uint8_t   syncByte)
 {
-    return BitReverseTable[val];    
-}
+    SectorSyncs syncs;
 
+    return alignSectorSyncs<false>(out, in, length, syncByte, syncs);
+}
 
-//! return a byte from 2 original bytes, shifted by the shift value
-//! and reverse bits
+//! shift and reverse a buffer, 8 bytes at a time
 //!
-//! @param first  - first data byte
-//! @param second - second data byte
-//! @param shift  - shift value
+//! @param out     output buffer
+//! @param in      input buffer, length + 1 bytes are read
+//! @param length  number of bytes to write
 //!
-//! @return shift byte
-//!
-uint8_t
-shiftByte(uint8_t first,
-          uint8_t second,
-          uint8_t shift)
+template <unsigned int shift>
+static void
+shiftReverseBlock(uint8_t       *out,
+                  const uint8_t *in,
+                  unsigned int   length)
 {
-    unsigned int val = (((unsigned int) first) << 8) |  second;
+    unsigned int pos = 0;
+
+    for ( ; pos + 8 <= length; pos += 8)
+    {
+        uint64_t val;
 
-    val >>= (8-shift);
-    val &= 0xff;
+        memcpy(&val, &in[pos], sizeof(val));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        val = __builtin_bswap64(val);
+#endif
 
-    return reverseChar(val);
+        if (shift)
+        {
+            val = (val << shift) | (in[pos + 8] >> (8 - shift));
+        }
+
+        // reverse the bits in each byte
+        val = ((val >> 1) & 0x5555555555555555ull) | ((val & 0x5555555555555555ull) << 1);
+        val = ((val >> 2) & 0x3333333333333333ull) | ((val & 0x3333333333333333ull) << 2);
+        val = ((val >> 4) & 0x0f0f0f0f0f0f0f0full) | ((val & 0x0f0f0f0f0f0f0f0full) << 4);
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        val = __builtin_bswap64(val);
+#endif
+        memcpy(&out[pos], &val, sizeof(val));
+    }
+
+    for ( ; pos < length; pos++)
+    {
+        out[pos] = shiftByte<shift>(in[pos], in[pos + 1]);
+    }
+}
+
+
+//! shift and reverse a whole buffer
+//!
+//! @param out     output buffer
+//! @param in      input buffer, length + 1 bytes are read
+//! @param length  number of bytes to write
+//! @param shift   number of bits to shift, 0 - 8
+//!
+void
+shiftReverseBlock(uint8_t       *out,
+                  const uint8_t *in,
+                  unsigned int   length,
+                  uint8_t        shift)
+{
+    switch (shift)
+    {
+        case 0: shiftReverseBlock<0>(out, in, length); break;
+        case 1: shiftReverseBlock<1>(out, in, length); break;
+        case 2: shiftReverseBlock<2>(out, in, length); break;
+        case 3: shiftReverseBlock<3>(out, in, length); break;
+        case 4: shiftReverseBlock<4>(out, in, length); break;
+        case 5: shiftReverseBlock<5>(out, in, length); break;
+        case 6: shiftReverseBlock<6>(out, in, length); break;
+        case 7: shiftReverseBlock<7>(out, in, length); break;
+        case 8: shiftReverseBlock<8>(out, in, length); break;
+
+        default:
+            for (unsigned int pos = 0; pos < length; pos++)
+            {
+                out[pos] = shiftByte(in[pos], in[pos + 1], shift);
+            }
+            break;
+    }
 }
 
 
@@ -305,43 +519,25 @@ validateHeader(uint8_t  *buffer,
     return (checkSum == buffer[startPos + 3]);
 }
 
-//! process a sector to by aligning based on sync bytes, and reversal of the bits in each byte
+
+//! check the header and data of an aligned sector
 //!
-//! @param buffer - original data
-//! @param out    - processed sector
-//! @param length - length of buffer
-//! @param side   - side sector was imaged from
-//! @param track  - track of sector
-//! @param sector - sector number
+//! @param buffer - aligned sector
+//! @param track  - expected track
+//! @param quiet  - don't print the details of the errors
 //!
 //! @return result status
 //!
-int
-processSector(uint8_t  *buffer,
-              uint8_t  *out,
-              uint16_t  length,
-              uint8_t   side,
-              uint8_t   track,
-              uint8_t   sector)
+static int
+checkSector(uint8_t  *buffer,
+            uint8_t   track,
+            bool      quiet)
 {
     // expect the sync (0xfd) character first.
     //
-    int pos   = 0;
-    int error = 0;
-
-    // align buffer and store it in out.
-    error = alignSector(out, buffer, length);
-
-    if (error)
-    {
-        return error;
-    }
-
+    int     pos = 0;
     uint8_t checkSum;
 
-    // copy aligned buffer from out back to buffer
-    memcpy(buffer, out, length);
-
     // look for sync character
     for (pos = 5; pos < 57; pos++)
     {
@@ -370,7 +566,10 @@ processSector(uint8_t  *buffer,
     // Disks, track number appears to be in b7-b1, side is in b0
     if (trackRead != track)
     {
-        printf("**** Unexpected track - expected: %d  received: %d\n", track, trackRead);
+        if (!quiet)
+        {
+            printf("**** Unexpected track - expected: %d  received: %d\n", track, trackRead);
+        }
         return Err_WrongTrack;
     }
     
@@ -412,18 +611,176 @@ processSector(uint8_t  *buffer,
 
     // verify checksum of the data block
 
-    // reset checksum value
-    checkSum = 0;
-
     // check all the data
-    for (int i = 0; i < 256; i++)
+    checkSum = blockChecksum(0, &buffer[pos], 256);
+    pos     += 256;
+
+    if (checkSum != buffer[pos])
     {
-        checkSum = updateChecksum(checkSum, buffer[pos++]);
+       if (!quiet)
+       {
+           printf("Invalid Data Checksum: calc: 0x%02x, read: 0x%02x\n", checkSum, buffer[pos]);
+       }
+       return Err_InvalidDataChecksum;
     }
 
-    if (checkSum != buffer[pos])
+    return No_Error;
+}
+
+
+//! process a sector to by aligning based on sync bytes, and reversal of the bits in each byte
+//!
+//! @param buffer - original data
+//! @param out    - processed sector
+//! @param length - length of buffer
+//! @param side   - side sector was imaged from
+//! @param track  - track of sector
+//! @param sector - sector number
+//!
+//! @return result status
+//!
+int
+processSector(uint8_t  *buffer,
+              uint8_t  *out,
+              uint16_t  length,
+              uint8_t   side,
+              uint8_t   track,
+              uint8_t   sector)
+{
+    int error = 0;
+
+    // align buffer and store it in out.
+    error = alignSector(out, buffer, length);
+
+    if (error)
+    {
+        return error;
+    }
+
+    // copy aligned buffer from out back to buffer
+    memcpy(buffer, out, length);
+
+    return checkSector(buffer, track, false);
+}
+
+
+//! sector number from the header of a processed sector
+//!
+//! @param buffer - processed sector
+//!
+//! @return sector number, or 0xff if the header sync is missing
+//!
+uint8_t
+headerSector(const uint8_t *buffer)
+{
+    // same search for the sync as checkSector()
+    for (int pos = 5; pos < 57; pos++)
+    {
+        if (buffer[pos] == PrefixSyncChar_c)
+        {
+            return buffer[pos + 3];
+        }
+    }
+
+    return 0xff;
+}
+
+
+//! decode, align and check a raw sector in one pass
+//!
+//! Gives the same results as decodeFM() followed by processSector(), but the checksums
+//! are calculated while the aligned data is written to out, and the sync positions come
+//! from the alignment instead of scanning for them again. Only when a sync was not found
+//! where processSector() would look for it is the aligned buffer scanned.
+//!
+//! @param raw    - FM encoded data, 2 * length bytes
+//! @param out    - processed sector
+//! @param length - length of processed sector
+//! @param side   - side sector was imaged from
+//! @param track  - track of sector
+//! @param sector - sector number
+//! @param quiet  - don't print the details of the errors, for probes and capture threads
+//!
+//! @return result status
+//!
+int
+processRawSector(uint8_t  *raw,
+                 uint8_t  *out,
+                 uint16_t  length,
+                 uint8_t   side,
+                 uint8_t   track,
+                 uint8_t   sector,
+                 bool      quiet)
+{
+    // a Heath sector is decoded on the stack, anything longer goes on the heap
+    static const unsigned int maxStackBytes_c = 512;
+
+    uint8_t               stackData[maxStackBytes_c];
+    std::vector<uint8_t>  heapData;
+    uint8_t              *data = stackData;
+    DecodeContext         context;
+    SectorSyncs           syncs;
+
+    if (length > maxStackBytes_c)
+    {
+        heapData.resize(length);
+        data = heapData.data();
+    }
+
+    if (Decode::decodeFM(data, raw, length, context) != 0)
+    {
+        return Err_InvalidClocksBits;
+    }
+
+    int error = alignSectorSyncs<true>(out, data, length, PrefixSyncChar_c, syncs);
+
+    if (error)
+    {
+        return error;
+    }
+
+    // the aligned output has 5 zeros, then a zero for each byte skipped before a sync
+    unsigned int headerPos = syncs.headerPos + 5;
+    unsigned int dataPos   = syncs.dataPos + 5;
+
+    // processSector() only looks for the header sync up to 56, the data sync within 65
+    // bytes of the header and needs the whole data block in the buffer.
+    if (!syncs.headerFound || (headerPos > 56) ||
+        !syncs.dataFound || (dataPos > headerPos + 69) || (dataPos + 257 >= length))
+    {
+        return checkSector(out, track, quiet);
+    }
+
+    uint8_t trackRead    = out[headerPos + 2];
+    uint8_t sectorRead   = out[headerPos + 3];
+    uint8_t checksumRead = out[headerPos + 4];
+
+    if (trackRead != track)
+    {
+        if (!quiet)
+        {
+            printf("**** Unexpected track - expected: %d  received: %d\n", track, trackRead);
+        }
+        return Err_WrongTrack;
+    }
+
+    if (sectorRead >= 10)
+    {
+        return Err_InvalidSector;
+    }
+
+    if (syncs.headerChecksum != checksumRead)
+    {
+        return Err_InvalidHeaderChecksum;
+    }
+
+    if (syncs.dataChecksum != out[dataPos + 257])
     {
-       printf("Invalid Data Checksum: calc: 0x%02x, read: 0x%02x\n", checkSum, buffer[pos]);
+       if (!quiet)
+       {
+           printf("Invalid Data Checksum: calc: 0x%02x, read: 0x%02x\n", syncs.dataChecksum,
+                  out[dataPos + 257]);
+       }
        return Err_InvalidDataChecksum;
     }
 
@@ -7,6 +7,7 @@
 #define __DISK_UTILS_H__
 
 #include <stdint.h>
+#include <array>
 
 enum
 {
@@ -64,6 +65,25 @@ int  processSector(uint8_t *buffer,
                    uint8_t  sector);
 
 
+//!
+//!  Decode and process a raw FM sector
+//!
+//!  Same result as decodeFM() followed by processSector(), done in a single pass over
+//!  the decoded data, writing straight into out.
+//!
+//! @param raw     FM encoded sector, 2 * length bytes
+//! @param out     pointer to the processed sector
+//! @param length  length of the processed sector
+//! @param quiet   don't print the details of the errors
+int  processRawSector(uint8_t *raw,
+                      uint8_t *out,
+                      uint16_t length,
+                      uint8_t  side,
+                      uint8_t  track,
+                      uint8_t  sector,
+                      bool     quiet = false);
+
+
 //!
 //! Align sector based on sync bytes, aligns both the header and data blocks
 //! and start of next header, if it finds it.
@@ -82,6 +102,16 @@ int  alignSector2(uint8_t  *out,
                   uint16_t  length,
                   uint8_t   syncByte = PrefixSyncChar_c);
 
+//!
+//! Sector number from the header of a processed sector
+//!
+//! @param buffer  processed sector
+//!
+//! \retval  sector number, or 0xff if the header sync is missing
+//!
+uint8_t headerSector(const uint8_t *buffer);
+
+
 //!
 //! Updates checksum from existing checksum and new character value
 //!
@@ -94,6 +124,49 @@ uint8_t updateChecksum(uint8_t checksum,
                        uint8_t val);
 
 
+//!
+//! Updates checksum from existing checksum and a block of characters, same result
+//! as calling updateChecksum() for each character
+//!
+//! @param checksum  existing checksum
+//! @param buf       characters to add to checksum
+//! @param length    number of characters
+//!
+//! \retval  new checksum
+//!
+uint8_t blockChecksum(uint8_t        checksum,
+                      const uint8_t *buf,
+                      unsigned int   length);
+
+
+//!
+//! Generate the table to reverse all the bits in a byte
+//!
+//! \retval table indexed by the byte value
+//!
+constexpr std::array<uint8_t, 256>
+genBitReverseTable()
+{
+    std::array<uint8_t, 256> table = {};
+
+    for (unsigned int val = 0; val < 256; val++)
+    {
+        for (unsigned int bit = 0; bit < 8; bit++)
+        {
+            if (val & (1 << bit))
+            {
+                table[val] |= 0x80 >> bit;
+            }
+        }
+    }
+
+    return table;
+}
+
+//! Pre-calculated array to reverse all the bits in a byte.
+inline constexpr std::array<uint8_t, 256> BitReverseTable = genBitReverseTable();
+
+
 //!
 //! Reverse character bits.
 //!
@@ -107,7 +180,30 @@ uint8_t updateChecksum(uint8_t checksum,
 //!
 //! \retval bits reversed
 //!
-uint8_t reverseChar(uint8_t val);
+inline uint8_t
+reverseChar(uint8_t val)
+{
+    return BitReverseTable[val];
+}
+
+
+//!
+//! Shift bytes to extract the next byte, for a shift known at compile time
+//!
+//! @param first   high byte
+//! @param second  low byte
+//!
+//! \retval extracted byte, with the bits reversed
+//!
+template <unsigned int shift>
+inline uint8_t
+shiftByte(uint8_t first,
+          uint8_t second)
+{
+    static_assert(shift <= 8, "shift must be 0 - 8");
+
+    return BitReverseTable[((((unsigned int) first) << 8 | second) >> (8 - shift)) & 0xff];
+}
 
 
 //!
@@ -120,9 +216,40 @@ uint8_t reverseChar(uint8_t val);
 //! \retval extracted byte
 //!
 //! \todo update the processing.
-uint8_t shiftByte(uint8_t first,
-                  uint8_t second,
-                  uint8_t shift);
+inline uint8_t
+shiftByte(uint8_t first,
+          uint8_t second,
+          uint8_t shift)
+{
+    switch (shift)
+    {
+        case 0: return shiftByte<0>(first, second);
+        case 1: return shiftByte<1>(first, second);
+        case 2: return shiftByte<2>(first, second);
+        case 3: return shiftByte<3>(first, second);
+        case 4: return shiftByte<4>(first, second);
+        case 5: return shiftByte<5>(first, second);
+        case 6: return shiftByte<6>(first, second);
+        case 7: return shiftByte<7>(first, second);
+        case 8: return shiftByte<8>(first, second);
+    }
+
+    return reverseChar(((((unsigned int) first) << 8 | second) >> (8 - shift)) & 0xff);
+}
+
+
+//!
+//! Shift and reverse a whole buffer, same as calling shiftByte() for each byte
+//!
+//! @param out     output buffer
+//! @param in      input buffer, length + 1 bytes are read
+//! @param length  number of bytes to write
+//! @param shift   number of bits to shift, 0 - 8
+//!
+void shiftReverseBlock(uint8_t       *out,
+                       const uint8_t *in,
+                       unsigned int   length,
+                       uint8_t        shift);
 
 
 #endif
@@ -5,6 +5,7 @@
 
 #include "drive.h"
 #include "fc5025.h"
+#include "fc5025_sim.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -16,11 +17,13 @@ static DriveInfo *drives = NULL;
 
 //! constructor
 //!
-Drive::Drive(DriveInfo *drive):heads_m(2),
+Drive::Drive(DriveInfo *drive):controller_m(new FC5025(drive->sim ? new FC5025Sim(*drive->sim) :
+                                                                    nullptr)),
+                               heads_m(2),
                                tpi_m(96),
                                rpm_m(360)
 {
-    status_m = FC5025::inst()->open(drive->usbdev);
+    status_m = controller_m->open(drive->usbdev);
 }
 
 
@@ -28,7 +31,8 @@ Drive::Drive(DriveInfo *drive):heads_m(2),
 //!
 Drive::~Drive()
 {
-    FC5025::inst()->close();
+    // closes the controller if it was opened
+    delete controller_m;
 }
 
 
@@ -87,7 +91,7 @@ Drive::get_drive_list(void)
     struct usb_device        **dev;
     DriveInfo                 *drive;
 
-    total_devs = FC5025::inst()->find(NULL, 0);
+    total_devs = FC5025::find(NULL, 0);
 
     if (total_devs == 0)
     {
@@ -106,7 +110,7 @@ Drive::get_drive_list(void)
         return NULL;
     }
 
-    listed_devs = FC5025::inst()->find(devs, total_devs);
+    listed_devs = FC5025::find(devs, total_devs);
 
     if (listed_devs == 0)
     {
@@ -132,6 +136,7 @@ Drive::get_drive_list(void)
     {
         snprintf(drive->id, 256, "%s/%s", (*dev)->bus->dirname, (*dev)->filename);
         drive->usbdev = *dev;
+        drive->sim    = NULL;
         if (get_desc(drive) == 0)
         {
             dev++;
@@ -142,6 +147,7 @@ Drive::get_drive_list(void)
     drive->id[0]   = '\0';
     drive->desc[0] = '\0';
     drive->usbdev  = NULL;
+    drive->sim     = NULL;
 
     if (drive == drives)
     {
@@ -9,6 +9,8 @@
 #include <stdint.h>
 
 struct usb_device;
+class FC5025;
+class FC5025Sim;
 
 // store info about the FC5025 devices
 struct DriveInfo
@@ -16,10 +18,12 @@ struct DriveInfo
     char               id[256];
     char               desc[256];
     struct usb_device *usbdev;
+    // simulated controller, copied for each Drive opened on it. NULL for a USB device
+    FC5025Sim         *sim;
 };
 
 
-//
+// a drive and the FC5025 controller it is on, each Drive opens its own controller
 class Drive
 {
 public:
@@ -27,6 +31,7 @@ public:
     ~Drive();
 
     uint8_t getStatus();
+    FC5025 *getController() { return controller_m; }
     static DriveInfo *get_drive_list(void);
 
 
@@ -39,6 +44,10 @@ public:
     uint16_t getRpm()  { return rpm_m;   }
 
 private:
+    Drive(const Drive &) = delete;
+    Drive &operator=(const Drive &) = delete;
+
+    FC5025  *controller_m;
     uint8_t  status_m;
 
     uint8_t  heads_m;
@@ -4,6 +4,7 @@
 //!
 
 #include "fc5025.h"
+#include "fc5025_transport.h"
 
 #include <stdio.h>
 #include <stdint.h>
@@ -12,6 +13,8 @@
 #include <time.h>
 #include <usb.h>
 
+#include <chrono>
+
 #define swap32(x) (((((uint32_t)x) & 0xff000000) >> 24) | \
                    ((((uint32_t)x) & 0x00ff0000) >>  8) | \
                    ((((uint32_t)x) & 0x0000ff00) <<  8) | \
@@ -19,37 +22,29 @@
 
 #define htov32(x) swap32(htonl(x))
 
-FC5025 *FC5025::pInst_m = nullptr;
 const uint8_t FC5025::testResponseSize_c = 32;
 
-// \todo move this into class.
-// CBW - Command Block Wrapper
-//
-static struct
-{
-    uint8_t      signature[4];
-    uint32_t     tag,
-                 xferlen;
-    uint8_t      flags;
-    uint8_t      padding1,
-                 padding2;
-    uint8_t      cdb[48];
-} __attribute__ ((__packed__)) cbw =
-{
-    { 'C', 'F', 'B', 'C'}, // signature
-    0x12345678,            // tag
-    0,                     // xferlen
-    0x80,                  // flags
-    0,                     // padding1
-    0,                     // padding2
-    { 0,}                  // cdb[]
-};
-
 
 //! Constructor
 //!
-FC5025::FC5025()
+//! @param transport   transport to the controller, deleted with the FC5025. nullptr
+//!                    for USB.
+//!
+FC5025::FC5025(FC5025Transport *transport): transport_m(transport),
+                                            open_m(false),
+                                            lastSenseKey_m(0),
+                                            lastASC_m(0),
+                                            lastASCQ_m(0)
 {
+    // CBW - Command Block Wrapper
+    memcpy(cbw_m.signature, "CFBC", sizeof(cbw_m.signature));
+    cbw_m.tag      = 0x12345678;
+    cbw_m.xferlen  = 0;
+    cbw_m.flags    = 0x80;
+    cbw_m.padding1 = 0;
+    cbw_m.padding2 = 0;
+    memset(cbw_m.cdb, 0, sizeof(cbw_m.cdb));
+
     // set drive parameters to default
     // - default for TEAC  1.2M
     //drive_StepRate_m = 15;     // 3 mSec
@@ -60,7 +55,10 @@ FC5025::FC5025()
     // H-17-4
     drive_StepRate_m = 30;   // 6 mSec
 
-    //cbw = new struct CommandBlockWrapper();
+    if (!transport_m)
+    {
+        transport_m = new UsbTransport();
+    }
 }
 
 
@@ -68,24 +66,11 @@ FC5025::FC5025()
 //!
 FC5025::~FC5025()
 {
-
-}
-
-
-//! get singleton
-//!
-//! @return FC5025
-//!
-FC5025 *
-FC5025::inst()
-{
-    if (pInst_m == nullptr)
+    if (open_m)
     {
-        pInst_m = new FC5025();
-        usb_init();
+        close();
     }
-
-    return pInst_m;
+    delete transport_m;
 }
 
 
@@ -125,18 +110,18 @@ FC5025::bulkCDB(void          *cdb,
 
     int             ret;
 
-    cbw.tag++;
-    cbw.xferlen = htov32(xferlen);
+    cbw_m.tag++;
+    cbw_m.xferlen = htov32(xferlen);
 
-    memset(&(cbw.cdb), 0, 48);
-    memcpy(&(cbw.cdb), cdb, length);
+    memset(&(cbw_m.cdb), 0, 48);
+    memcpy(&(cbw_m.cdb), cdb, length);
 
     if (xferlen_out != NULL)
     {
         *xferlen_out = 0;
     }
 
-    ret = usb_bulk_write(udev_m, 1, (const char *) &cbw, 63, 1500);
+    ret = transport_m->bulkWrite(1, (const char *) &cbw_m, 63, 1500);
     if (ret != 63)
     {
         printf("%s: failed usb_bulk_write1\n", __FUNCTION__);
@@ -147,7 +132,7 @@ FC5025::bulkCDB(void          *cdb,
     // followed by the status
     if (xferlen != 0)
     {
-        ret = usb_bulk_read(udev_m, 0x81, (char *) xferbuf, xferlen, timeout);
+        ret = transport_m->bulkRead(0x81, (char *) xferbuf, xferlen, timeout);
         if (ret < 0)
         {
             printf("%s: failed usb_bulk_read data\n", __FUNCTION__);
@@ -161,7 +146,7 @@ FC5025::bulkCDB(void          *cdb,
     }
 
     // get the status
-    ret = usb_bulk_read(udev_m, 0x81, (char *) &csw, 32, timeout);
+    ret = transport_m->bulkRead(0x81, (char *) &csw, 32, timeout);
     if ((ret < 12) || (ret > 31))
     {
         printf("%s: failed usb_bulk_read of status, ret: %d\n", __FUNCTION__, ret);
@@ -175,7 +160,7 @@ FC5025::bulkCDB(void          *cdb,
     }
 
     // verify tag
-    if (csw.tag != cbw.tag)
+    if (csw.tag != cbw_m.tag)
     {
         // response tag did not match transmitted tag
         printf("%s: failed csw tag\n", __FUNCTION__);
@@ -263,6 +248,39 @@ FC5025::testBoard(void)
 
 
 
+//! time a command that doesn't have to wait for the disk
+//!
+//! @return seconds, the fastest of a few tries
+//!
+double
+FC5025::measureTurnaround(void)
+{
+    const int   tries_c = 8;
+    double      best    = 0.0;
+    int         out;
+
+    for (int i = 0; i < tries_c; i++)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        // no bits in the mask, so nothing is changed
+        if (flags(0, 0, &out) != 0)
+        {
+            continue;
+        }
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        if ((best == 0.0) || (elapsed.count() < best))
+        {
+            best = elapsed.count();
+        }
+    }
+
+    return best;
+}
+
+
 //! recalibrate - try to find track zero
 //!
 //! @return status
@@ -525,19 +543,13 @@ FC5025::setDensity(int density)
 int
 FC5025::open(struct usb_device *dev)
 {
-    cbw.tag = time(NULL) & 0xffffffff;
-    udev_m    = usb_open(dev);
+    cbw_m.tag = time(NULL) & 0xffffffff;
 
-    if (!udev_m)
+    if (transport_m->open(dev) != 0)
     {
         return 1;
     }
-
-    if (usb_claim_interface(udev_m, 0) != 0)
-    {
-        usb_close(udev_m);
-        return 1;
-    }
+    open_m = true;
 
     return 0;
 }
@@ -550,12 +562,13 @@ FC5025::open(struct usb_device *dev)
 int
 FC5025::close(void)
 {
-    if ((usb_release_interface(udev_m, 0) != 0) || (usb_close(udev_m) != 0))
+    if (!open_m)
     {
         return 1;
     }
+    open_m = false;
 
-    return 0;
+    return transport_m->close();
 }
 
 
@@ -574,6 +587,7 @@ FC5025::find(struct usb_device **devs,
     struct usb_device *dev;
     int                num_found = 0;
 
+    UsbTransport::init();
     usb_find_busses();
     usb_find_devices();
 
@@ -2,6 +2,9 @@
 //!
 //! Communication with the FC5025 hardware
 //!
+//! There is one FC5025 object for each controller, so several can be used at once, each
+//! from its own thread. The commands go through a transport, normally USB.
+//!
 
 #ifndef __FC5025_H__
 #define __FC5025_H__
@@ -9,7 +12,7 @@
 #include <cstdint>
 
 struct usb_device;
-struct usb_dev_handle;
+class FC5025Transport;
 
 
 class FC5025
@@ -17,7 +20,8 @@ class FC5025
 
 public:
 
-    static FC5025* inst();
+    FC5025(FC5025Transport *transport = nullptr);
+    virtual ~FC5025();
 
     int bulkCDB(void                 *cdb,
                 int                   length,
@@ -54,14 +58,16 @@ public:
 
     int testBoard(void);
 
+    double measureTurnaround(void);
+
     int setDensity(int                density);
 
     int open(struct usb_device       *dev);
 
     int close(void);
 
-    int find(struct usb_device      **devs,
-            int                       max);
+    static int find(struct usb_device **devs,
+                    int                 max);
 
     int driveStatus(uint8_t          *track,
                     uint16_t         *speed,
@@ -151,9 +157,8 @@ private:
         uint8_t      cdb[48];
     } __attribute__ ((__packed__));
 
-    FC5025();
-    virtual ~FC5025();
-    static FC5025 *pInst_m;
+    FC5025(const FC5025 &) = delete;
+    FC5025 &operator=(const FC5025 &) = delete;
 
     static const uint16_t VendorID_c  = 0x16c0;
     static const uint16_t ProductID_c = 0x06d6;
@@ -163,13 +168,14 @@ private:
     int internalSeek(uint8_t mode,
                      uint8_t track);
 
-    usb_dev_handle *udev_m;
+    FC5025Transport *transport_m;
+    bool            open_m;
     uint8_t         lastSenseKey_m;
     uint8_t         lastASC_m;
     uint8_t         lastASCQ_m;
 
     uint8_t         drive_StepRate_m;
-//    CommandBlockWrapper *cbw;
+    CommandBlockWrapper cbw_m;
 
 };
 
@@ -0,0 +1,618 @@
+//! \file fc5025_sim.cpp
+//!
+//! Simulated FC5025 and drive, to capture without the hardware.
+//!
+
+#include "fc5025_sim.h"
+#include "fc5025.h"
+#include "disk_util.h"
+#include "h17block.h"
+#include "h17disk.h"
+#include "raw_sector.h"
+#include "raw_track.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+
+
+//! constructor
+//!
+//! @param sides      sides of the disk
+//! @param tracks     tracks of the disk
+//! @param driveTpi   tpi of the drive, a 40 track disk is on every other track of a
+//!                   96 tpi drive
+//!
+FC5025Sim::FC5025Sim(uint8_t sides,
+                     uint8_t tracks,
+                     uint8_t driveTpi): sides_m(sides),
+                                        tracks_m(tracks),
+                                        step_m(((tracks == 40) && (driveTpi == 96)) ? 2 : 1),
+                                        rpm_m(360.0),
+                                        latency_m(0.001),
+                                        errorRate_m(0.0),
+                                        random_m(1),
+                                        revolutions_m(sides * tracks),
+                                        blank_m(holes_c * holeBytes_c, 0),
+                                        spinStart_m(Clock::now()),
+                                        headTrack_m(0),
+                                        flags_m(0),
+                                        dataPending_m(false),
+                                        ready_m(Clock::now()),
+                                        status_m(0),
+                                        sense_m(0),
+                                        asc_m(0)
+{
+    memset(tag_m, 0, sizeof(tag_m));
+}
+
+
+//! destructor
+//!
+FC5025Sim::~FC5025Sim()
+{
+
+}
+
+//! use the raw data of an h17disk file as the disk, the last attempt of each sector is
+//! what is read from its hole. Tracks and sectors not in the file can't be read.
+//!
+//! @param name   file name
+//!
+//! @return success, false if the file has no raw data for the disk
+//!
+bool
+FC5025Sim::loadImage(const char *name)
+{
+    H17Disk image;
+    bool    found = false;
+
+    for (uint8_t track = 0; track < tracks_m; track++)
+    {
+        for (uint8_t side = 0; side < sides_m; side++)
+        {
+            std::vector<uint8_t> &rev = revolutions_m[track * sides_m + side];
+            std::vector<uint8_t>  data;
+
+            rev = blank_m;
+
+            if (!image.readTrackBlock(name, H17Disk::RawTrackDataId, side, track, data))
+            {
+                std::vector<uint8_t> compressed;
+
+                if (!image.readTrackBlock(name, H17Disk::CompressedRawTrackDataId, side, track,
+                                          compressed))
+                {
+                    continue;
+                }
+
+                H17CompressedRawDataBlock block(compressed.data(), compressed.size(), false);
+
+                if (!block.getRawTrackData(0, data))
+                {
+                    continue;
+                }
+            }
+
+            // the sectors follow the raw track header, the last attempt of each is kept
+            // as the one most likely to have read, rebuilding it when stored as a delta
+            std::vector<RawSector *> firsts(holes_c, nullptr);
+            std::vector<RawSector *> attempts;
+            uint32_t                 pos = RawTrack::headerSize_c;
+
+            while (pos + RawSector::headerSize_c <= data.size())
+            {
+                uint8_t  id     = data[pos];
+                uint8_t  sector = data[pos + 1];
+                uint16_t length = (data[pos + 2] << 8) | data[pos + 3];
+
+                if (((id != H17Disk::RawSectorDataId) && (id != H17Disk::RawSectorDeltaId)) ||
+                    (pos + RawSector::headerSize_c + length > data.size()) ||
+                    (sector >= holes_c))
+                {
+                    break;
+                }
+
+                RawSector *raw = new RawSector(&data[pos], data.size() - pos, length, false,
+                                               firsts[sector]);
+
+                attempts.push_back(raw);
+                if (!firsts[sector])
+                {
+                    firsts[sector] = raw;
+                }
+
+                uint8_t *buf = raw->getBuf();
+
+                if (buf)
+                {
+                    uint16_t size = raw->getBufSize();
+
+                    memcpy(&rev[sector * holeBytes_c], buf,
+                           (size < holeBytes_c) ? size : holeBytes_c);
+                    found = true;
+                }
+                pos += length;
+            }
+
+            for (RawSector *raw : attempts)
+            {
+                delete raw;
+            }
+        }
+    }
+
+    return found;
+}
+
+
+//! set the speed the disk turns at
+//!
+//! @param rpm
+//!
+void
+FC5025Sim::setRpm(double rpm)
+{
+    if (rpm > 0.0)
+    {
+        rpm_m = rpm;
+    }
+}
+
+
+//! set the time from sending a command until it gets to the drive
+//!
+//! @param seconds
+//!
+void
+FC5025Sim::setLatency(double seconds)
+{
+    latency_m = seconds;
+}
+
+
+//! set the chance of a sector read getting a bit error
+//!
+//! @param rate   0.0 to 1.0
+//!
+void
+FC5025Sim::setErrorRate(double rate)
+{
+    errorRate_m = rate;
+}
+
+
+//! seed the errors, so a run can be repeated
+//!
+//! @param seed
+//!
+void
+FC5025Sim::setSeed(uint32_t seed)
+{
+    random_m.seed(seed);
+}
+
+
+//! make every read of a sector fail
+//!
+//! @param side
+//! @param track
+//! @param sector
+//!
+void
+FC5025Sim::addBadSector(uint8_t side,
+                        uint8_t track,
+                        uint8_t sector)
+{
+    badSectors_m.push_back((side << 12) | (track << 4) | sector);
+}
+
+
+//! open the device, the disk starts turning
+//!
+//! @param dev   not used
+//!
+//! @return 0 - success
+//!
+int
+FC5025Sim::open(struct usb_device *dev)
+{
+    spinStart_m = Clock::now();
+
+    return 0;
+}
+
+
+//! close the device
+//!
+//! @return 0 - success
+//!
+int
+FC5025Sim::close(void)
+{
+    return 0;
+}
+
+
+//! take a command block wrapper and start the command
+//!
+//! @param endpoint
+//! @param buf
+//! @param length
+//! @param timeout
+//!
+//! @return bytes written, negative on error
+//!
+int
+FC5025Sim::bulkWrite(int         endpoint,
+                     const char *buf,
+                     int         length,
+                     int         timeout)
+{
+    const uint8_t *cbw = (const uint8_t *) buf;
+
+    if ((endpoint != 1) || (length != 63) || (memcmp(cbw, "CFBC", 4) != 0))
+    {
+        return -1;
+    }
+
+    // the transfer length is little endian
+    uint32_t xferlen = cbw[8] | (cbw[9] << 8) | (cbw[10] << 16) | ((uint32_t) cbw[11] << 24);
+
+    memcpy(tag_m, &cbw[4], sizeof(tag_m));
+    command(&cbw[15], xferlen);
+
+    return length;
+}
+
+
+//! read the data of the last command, then its status, waiting until it is done
+//!
+//! @param endpoint
+//! @param buf
+//! @param length
+//! @param timeout
+//!
+//! @return bytes read, negative on error
+//!
+int
+FC5025Sim::bulkRead(int   endpoint,
+                    char *buf,
+                    int   length,
+                    int   timeout)
+{
+    if (endpoint != 0x81)
+    {
+        return -1;
+    }
+
+    std::this_thread::sleep_until(ready_m);
+
+    // on an error the data is a zero length response
+    if (dataPending_m)
+    {
+        int size = ((int) data_m.size() < length) ? data_m.size() : length;
+
+        memcpy(buf, data_m.data(), size);
+        dataPending_m = false;
+
+        return size;
+    }
+
+    uint8_t csw[16] = { 'B', 'S', 'C', 'F' };
+
+    if (length < (int) sizeof(csw))
+    {
+        return -1;
+    }
+
+    memcpy(&csw[4], tag_m, sizeof(tag_m));
+    csw[12] = status_m;
+    csw[13] = sense_m;
+    csw[14] = asc_m;
+    memcpy(buf, csw, sizeof(csw));
+
+    return sizeof(csw);
+}
+
+
+//! run a command
+//!
+//! @param cdb       command descriptor block
+//! @param xferlen   bytes of data the host asks for
+//!
+void
+FC5025Sim::command(const uint8_t *cdb,
+                   uint32_t       xferlen)
+{
+    data_m.clear();
+    dataPending_m = (xferlen != 0);
+    ready_m       = Clock::now() + seconds(latency_m);
+    status_m      = 0;
+    sense_m       = 0;
+    asc_m         = 0;
+
+    switch ((FC5025::Opcode) cdb[0])
+    {
+        case FC5025::Opcode::Seek:
+        {
+            // mode 3 recalibrates, the step rate is in 0.2 mSec
+            uint8_t target = (cdb[1] == 3) ? 0 : cdb[3];
+            int     steps  = (cdb[1] == 3) ? headTrack_m : std::abs(target - headTrack_m);
+
+            ready_m     += seconds(steps * cdb[2] * 0.0002);
+            headTrack_m  = target;
+            break;
+        }
+        case FC5025::Opcode::SelfTest:
+            data_m.resize(FC5025::testResponseSize_c, 0);
+            break;
+
+        case FC5025::Opcode::Flags:
+            flags_m = (flags_m & ~cdb[1]) | (cdb[2] & cdb[1]);
+            data_m.push_back(flags_m);
+            break;
+
+        case FC5025::Opcode::DriveStatus:
+        {
+            uint16_t speed = lround(rpm_m * 100.0);
+
+            data_m = { headTrack_m, (uint8_t) (speed >> 8), (uint8_t) (speed & 0xff),
+                       holes_c, flags_m };
+            break;
+        }
+        case FC5025::Opcode::ReadFlexible:
+            readFlexible(cdb, xferlen);
+            break;
+
+        default:
+            fail((uint8_t) FC5025::Key::CommandError,
+                 (uint8_t) FC5025::ASC_Command::InvalidCommand);
+            break;
+    }
+
+    if (data_m.size() > xferlen)
+    {
+        data_m.resize(xferlen);
+    }
+}
+
+
+//! end the command with an error
+//!
+//! @param sense
+//! @param asc
+//!
+void
+FC5025Sim::fail(uint8_t sense,
+                uint8_t asc)
+{
+    data_m.clear();
+    status_m = 1;
+    sense_m  = sense;
+    asc_m    = asc;
+}
+
+
+//! read from a sector hole, for as long as the host asks for
+//!
+//! @param cdb
+//! @param xferlen
+//!
+void
+FC5025Sim::readFlexible(const uint8_t *cdb,
+                        uint32_t       xferlen)
+{
+    uint8_t side = cdb[1] & FC5025::ReadFlag_Side_c;
+    uint8_t hole = cdb[5] - 1;   // one based
+
+    if (hole >= holes_c)
+    {
+        fail((uint8_t) FC5025::Key::CommandError, (uint8_t) FC5025::ASC_Command::InvalidField);
+        return;
+    }
+
+    std::vector<uint8_t> *rev  = revolution(side, headTrack_m);
+    uint32_t              size = rev->size();
+
+    data_m.resize(xferlen);
+    for (uint32_t i = 0; i < xferlen; i++)
+    {
+        data_m[i] = (*rev)[(hole * holeBytes_c + i) % size];
+    }
+
+    // a bit error somewhere in the data field of each sector that is hit
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    std::uniform_int_distribution<int>     bit(64 * 8, (holeBytes_c - 64) * 8 - 1);
+
+    for (uint32_t offset = 0; offset < xferlen; offset += holeBytes_c)
+    {
+        uint8_t sector = (hole + offset / holeBytes_c) % holes_c;
+
+        // a single bit error can miss the data field, so a bad sector loses a run of
+        // flux in the middle of it instead, and can never pass its checksum
+        if (isBad(side, headTrack_m / step_m, sector))
+        {
+            for (uint32_t pos = offset + badStart_c; (pos < offset + badEnd_c) && (pos < xferlen);
+                 pos++)
+            {
+                data_m[pos] = 0;
+            }
+        }
+
+        if ((errorRate_m > 0.0) && (chance(random_m) < errorRate_m))
+        {
+            uint32_t pos = offset * 8 + bit(random_m);
+
+            if (pos / 8 < xferlen)
+            {
+                data_m[pos / 8] ^= 0x80 >> (pos % 8);
+            }
+        }
+    }
+
+    // wait for the hole after the command gets to the drive, then read the data
+    ready_m = holePasses(hole, ready_m) + seconds(holeTime() * xferlen / holeBytes_c);
+}
+
+
+//! time between two sector holes
+//!
+//! @return seconds
+//!
+double
+FC5025Sim::holeTime()
+{
+    return 60.0 / (rpm_m * holes_c);
+}
+
+
+//! when a hole next passes the head
+//!
+//! @param hole
+//! @param time   from this time on
+//!
+//! @return time the hole passes
+//!
+FC5025Sim::Clock::time_point
+FC5025Sim::holePasses(uint8_t           hole,
+                      Clock::time_point time)
+{
+    std::chrono::duration<double> elapsed = time - spinStart_m;
+
+    double position = std::fmod(elapsed.count() / holeTime(), holes_c);
+    double holes    = std::fmod(hole - position + holes_c, holes_c);
+
+    return time + seconds(holes * holeTime());
+}
+
+
+//! convert seconds to a clock duration
+//!
+//! @param s   seconds
+//!
+//! @return duration
+//!
+FC5025Sim::Clock::duration
+FC5025Sim::seconds(double s)
+{
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(s));
+}
+
+
+//! raw data of a revolution under the head
+//!
+//! @param side
+//! @param physicalTrack
+//!
+//! @return revolution, blank between the tracks of the disk
+//!
+std::vector<uint8_t> *
+FC5025Sim::revolution(uint8_t side,
+                      uint8_t physicalTrack)
+{
+    uint8_t track = physicalTrack / step_m;
+
+    if ((side >= sides_m) || (physicalTrack % step_m) || (track >= tracks_m))
+    {
+        return &blank_m;
+    }
+
+    std::vector<uint8_t> &rev = revolutions_m[track * sides_m + side];
+
+    if (rev.empty())
+    {
+        synthesize(side, track, rev);
+    }
+
+    return &rev;
+}
+
+
+//! make up a track of FM sectors, with data that depends on where the sector is
+//!
+//! @param side
+//! @param track
+//! @param rev    [out] revolution of raw data
+//!
+void
+FC5025Sim::synthesize(uint8_t               side,
+                      uint8_t               track,
+                      std::vector<uint8_t> &rev)
+{
+    uint32_t bits     = holes_c * holeBytes_c * 8;
+    uint8_t  trackNum = (sides_m == 2) ? ((track << 1) + side) : track;
+
+    rev.assign(holes_c * holeBytes_c, 0);
+
+    for (uint8_t sector = 0; sector < holes_c; sector++)
+    {
+        // header and data, each after a sync character, in the time between two holes
+        uint8_t chars[holeBytes_c / 2] = { 0 };
+
+        chars[10] = PrefixSyncChar_c;
+        chars[11] = 0;
+        chars[12] = trackNum;
+        chars[13] = sector;
+        chars[14] = blockChecksum(0, &chars[11], 3);
+
+        chars[30] = PrefixSyncChar_c;
+        for (int i = 0; i < 256; i++)
+        {
+            chars[31 + i] = (i * 7) ^ (sector * 29) ^ (track * 3) ^ side;
+        }
+        chars[287] = blockChecksum(0, &chars[31], 256);
+
+        // a clock bit before each data bit, low bit of a character first
+        uint32_t bit = sector * holeBytes_c * 8 + 4;
+
+        for (unsigned int i = 0; i < sizeof(chars); i++)
+        {
+            for (int b = 0; b < 8; b++)
+            {
+                for (int clockBit = 1; clockBit >= 0; clockBit--)
+                {
+                    uint32_t pos = bit++ % bits;
+
+                    if (clockBit || ((chars[i] >> b) & 1))
+                    {
+                        rev[pos / 8] |= 0x80 >> (pos % 8);
+                    }
+                    else
+                    {
+                        rev[pos / 8] &= ~(0x80 >> (pos % 8));
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+//! check if every read of a sector fails
+//!
+//! @param side
+//! @param track
+//! @param sector
+//!
+//! @return if bad
+//!
+bool
+FC5025Sim::isBad(uint8_t side,
+                 uint8_t track,
+                 uint8_t sector)
+{
+    uint16_t key = (side << 12) | (track << 4) | sector;
+
+    for (uint16_t bad : badSectors_m)
+    {
+        if (bad == key)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
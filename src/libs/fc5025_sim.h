@@ -0,0 +1,118 @@
+//! \file fc5025_sim.h
+//!
+//! Simulated FC5025 and drive, to capture without the hardware.
+//!
+
+#ifndef __FC5025_SIM_H__
+#define __FC5025_SIM_H__
+
+#include "fc5025_transport.h"
+
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+
+//! Answers the commands the FC5025 class sends, as a controller with a hard-sectored
+//! disk in its drive. The disk turns in real time at the set speed, a sector read waits
+//! for its hole to pass the head after the command gets to the drive, and takes as long
+//! as reading the data off the disk would.
+//!
+//! The disk is the raw data of an h17disk file, the last attempt of each sector, or FM
+//! tracks made up with valid headers and checksums. Reads can be given bit errors at a
+//! chosen rate, or always fail for some sectors.
+//!
+class FC5025Sim: public FC5025Transport
+{
+public:
+
+    FC5025Sim(uint8_t  sides,
+              uint8_t  tracks,
+              uint8_t  driveTpi);
+    virtual ~FC5025Sim();
+
+    bool         loadImage(const char *name);
+
+    void         setRpm(double        rpm);
+    void         setLatency(double    seconds);
+    void         setErrorRate(double  rate);
+    void         setSeed(uint32_t     seed);
+    void         addBadSector(uint8_t side,
+                              uint8_t track,
+                              uint8_t sector);
+
+    virtual int  open(struct usb_device *dev);
+    virtual int  close(void);
+
+    virtual int  bulkWrite(int         endpoint,
+                           const char *buf,
+                           int         length,
+                           int         timeout);
+    virtual int  bulkRead(int          endpoint,
+                          char        *buf,
+                          int          length,
+                          int          timeout);
+
+    static const uint8_t  holes_c     = 10;
+    static const uint16_t holeBytes_c = 640;
+
+private:
+
+    //! raw bytes from the hole of a bad sector with no flux, within its data field
+    static const uint16_t badStart_c  = 300;
+    static const uint16_t badEnd_c    = 400;
+
+    typedef std::chrono::steady_clock Clock;
+
+    void         command(const uint8_t *cdb,
+                         uint32_t       xferlen);
+    void         fail(uint8_t sense,
+                      uint8_t asc);
+    void         readFlexible(const uint8_t *cdb,
+                              uint32_t       xferlen);
+
+    double       holeTime();
+    Clock::time_point holePasses(uint8_t           hole,
+                                 Clock::time_point time);
+    Clock::duration   seconds(double s);
+
+    std::vector<uint8_t> *revolution(uint8_t side,
+                                     uint8_t physicalTrack);
+    void         synthesize(uint8_t               side,
+                            uint8_t               track,
+                            std::vector<uint8_t> &rev);
+    bool         isBad(uint8_t side,
+                       uint8_t track,
+                       uint8_t sector);
+
+    // disk and drive
+    uint8_t                           sides_m;
+    uint8_t                           tracks_m;
+    uint8_t                           step_m;
+    double                            rpm_m;
+    double                            latency_m;
+    double                            errorRate_m;
+    std::mt19937                      random_m;
+    std::vector<uint16_t>             badSectors_m;
+
+    // one revolution of raw data for each side and track, made up when empty
+    std::vector<std::vector<uint8_t>> revolutions_m;
+    std::vector<uint8_t>              blank_m;
+
+    // state of the controller
+    Clock::time_point                 spinStart_m;
+    uint8_t                           headTrack_m;
+    uint8_t                           flags_m;
+
+    // answer to the last command, sent once it is ready
+    uint8_t                           tag_m[4];
+    std::vector<uint8_t>              data_m;
+    bool                              dataPending_m;
+    Clock::time_point                 ready_m;
+    uint8_t                           status_m;
+    uint8_t                           sense_m;
+    uint8_t                           asc_m;
+};
+
+#endif
@@ -0,0 +1,133 @@
+//! \file fc5025_transport.cpp
+//!
+//! Bulk transfers to and from an FC5025, over USB or to a simulated controller.
+//!
+
+#include "fc5025_transport.h"
+
+#include <usb.h>
+
+#include <mutex>
+
+
+//! destructor
+//!
+FC5025Transport::~FC5025Transport()
+{
+
+}
+
+
+//! constructor
+//!
+UsbTransport::UsbTransport(): udev_m(nullptr)
+{
+    init();
+}
+
+
+//! destructor
+//!
+UsbTransport::~UsbTransport()
+{
+    if (udev_m)
+    {
+        close();
+    }
+}
+
+
+//! initialize the usb library, once for all the controllers
+//!
+void
+UsbTransport::init(void)
+{
+    static std::once_flag initialized;
+
+    std::call_once(initialized, usb_init);
+}
+
+
+//! open device
+//!
+//! @param dev  device to open
+//!
+//! @returns 0 - success, 1 - failure
+//!
+int
+UsbTransport::open(struct usb_device *dev)
+{
+    udev_m = usb_open(dev);
+
+    if (!udev_m)
+    {
+        return 1;
+    }
+
+    if (usb_claim_interface(udev_m, 0) != 0)
+    {
+        usb_close(udev_m);
+        udev_m = nullptr;
+        return 1;
+    }
+
+    return 0;
+}
+
+
+//! close device
+//!
+//! @return status
+//!
+int
+UsbTransport::close(void)
+{
+    if (!udev_m)
+    {
+        return 1;
+    }
+
+    int retVal = (usb_release_interface(udev_m, 0) != 0) || (usb_close(udev_m) != 0);
+
+    udev_m = nullptr;
+
+    return retVal;
+}
+
+
+//! write to a bulk endpoint
+//!
+//! @param endpoint
+//! @param buf
+//! @param length
+//! @param timeout   mSec
+//!
+//! @return bytes written, negative on error
+//!
+int
+UsbTransport::bulkWrite(int         endpoint,
+                        const char *buf,
+                        int         length,
+                        int         timeout)
+{
+    return usb_bulk_write(udev_m, endpoint, buf, length, timeout);
+}
+
+
+//! read from a bulk endpoint
+//!
+//! @param endpoint
+//! @param buf
+//! @param length
+//! @param timeout   mSec
+//!
+//! @return bytes read, negative on error
+//!
+int
+UsbTransport::bulkRead(int   endpoint,
+                       char *buf,
+                       int   length,
+                       int   timeout)
+{
+    return usb_bulk_read(udev_m, endpoint, buf, length, timeout);
+}
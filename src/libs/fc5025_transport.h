@@ -0,0 +1,64 @@
+//! \file fc5025_transport.h
+//!
+//! Bulk transfers to and from an FC5025, over USB or to a simulated controller.
+//!
+
+#ifndef __FC5025_TRANSPORT_H__
+#define __FC5025_TRANSPORT_H__
+
+struct usb_device;
+struct usb_dev_handle;
+
+
+//! The bulk endpoints that commands are sent and answered on, the FC5025 class builds
+//! the command and status wrappers on top of it.
+//!
+class FC5025Transport
+{
+public:
+
+    virtual ~FC5025Transport();
+
+    virtual int open(struct usb_device *dev) = 0;
+    virtual int close(void) = 0;
+
+    virtual int bulkWrite(int         endpoint,
+                          const char *buf,
+                          int         length,
+                          int         timeout) = 0;
+    virtual int bulkRead(int          endpoint,
+                         char        *buf,
+                         int          length,
+                         int          timeout) = 0;
+};
+
+
+//! Transport to an FC5025 on USB, through libusb.
+//!
+class UsbTransport: public FC5025Transport
+{
+public:
+
+    UsbTransport();
+    virtual ~UsbTransport();
+
+    virtual int open(struct usb_device *dev);
+    virtual int close(void);
+
+    virtual int bulkWrite(int         endpoint,
+                          const char *buf,
+                          int         length,
+                          int         timeout);
+    virtual int bulkRead(int          endpoint,
+                         char        *buf,
+                         int          length,
+                         int          timeout);
+
+    static void init(void);
+
+private:
+
+    usb_dev_handle *udev_m;
+};
+
+#endif
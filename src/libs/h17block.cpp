@@ -9,15 +9,18 @@
 #include "raw_track.h"
 #include "raw_sector.h"
 #include "dump.h"
+#include "lz.h"
 
 #include <cstring>
+#include <sstream>
 
 // H17Block
 
 //! Default constructor
 //!
 H17Block::H17Block(): size_m(0),
-                      buf_m(nullptr)
+                      buf_m(nullptr),
+                      ownsBuf_m(true)
 {
 
 }
@@ -26,14 +29,23 @@ H17Block::H17Block(): size_m(0),
 //!
 //! @param buf - buffer
 //! @param size - size of buffer
+//! @param copy - copy the buffer, otherwise keep a view into buf, which must outlive the block
 //!
-H17Block::H17Block(uint8_t buf[], uint32_t size)
+H17Block::H17Block(uint8_t  buf[],
+                   uint32_t size,
+                   bool     copy): size_m(size),
+                                   ownsBuf_m(copy)
 {
     // printf("%s\n", __PRETTY_FUNCTION__);
-    buf_m = new unsigned char[size];
-    size_m = size;
-
-    memcpy(buf_m, buf, size_m);
+    if (copy)
+    {
+        buf_m = new unsigned char[size];
+        memcpy(buf_m, buf, size_m);
+    }
+    else
+    {
+        buf_m = buf;
+    }
 }
 
 //! H17Block Destructor
@@ -41,16 +53,26 @@ H17Block::H17Block(uint8_t buf[], uint32_t size)
 H17Block::~H17Block()
 {
     //printf("%s\n", __PRETTY_FUNCTION__);
-    if (buf_m)
+    if ((buf_m) && (ownsBuf_m))
     {
         delete[] buf_m;
     }
 }
 
 
+//! create a block from the file data
+//!
+//! @param buf  - buffer starting with the block header
+//! @param size - size of buffer
+//! @param copy - copy the data, otherwise the block and its tracks and sectors are views
+//!               into buf, which must outlive the block
+//!
+//! @return new block, nullptr on failure
+//!
 H17Block *
 H17Block::create(uint8_t  buf[],
-                 uint32_t size)
+                 uint32_t size,
+                 bool     copy)
 {
     H17Block *newBlock = nullptr;
 
@@ -81,25 +103,31 @@ H17Block::create(uint8_t  buf[],
             newBlock = new H17FlagsBlock(&buf[6], blockSize);
             break;
         case LabelBlock_c:
-            newBlock = new H17LabelBlock(&buf[6], blockSize);
+            newBlock = new H17LabelBlock(&buf[6], blockSize, copy);
             break;
         case CommentBlock_c:
-            newBlock = new H17CommentBlock(&buf[6], blockSize);
+            newBlock = new H17CommentBlock(&buf[6], blockSize, copy);
             break;
         case DateBlock_c:
-            newBlock = new H17DateBlock(&buf[6], blockSize);
+            newBlock = new H17DateBlock(&buf[6], blockSize, copy);
             break;      
         case ImagerBlock_c:
-            newBlock = new H17ImagerBlock(&buf[6], blockSize);
+            newBlock = new H17ImagerBlock(&buf[6], blockSize, copy);
             break;
         case ProgramBlock_c:
-            newBlock = new H17ProgramBlock(&buf[6], blockSize);
+            newBlock = new H17ProgramBlock(&buf[6], blockSize, copy);
             break;
         case DataBlock_c:
-            newBlock = new H17DataBlock(&buf[6], blockSize);
+            newBlock = new H17DataBlock(&buf[6], blockSize, copy);
             break;
         case RawDataBlock_c:
-            newBlock = new H17RawDataBlock(&buf[6], blockSize);
+            newBlock = new H17RawDataBlock(&buf[6], blockSize, copy);
+            break;
+        case CompressedRawDataBlock_c:
+            newBlock = new H17CompressedRawDataBlock(&buf[6], blockSize, copy);
+            break;
+        case IndexBlock_c:
+            newBlock = new H17IndexBlock(&buf[6], blockSize);
             break;
         default:
             printf("Unknown Block Id: 0x%02x\n", buf[0]);
@@ -607,7 +635,8 @@ H17FlagsBlock::getMandatory()
 //! @param size
 //!
 H17LabelBlock::H17LabelBlock(uint8_t  buf[],
-                             uint32_t size): H17Block::H17Block( buf, size)
+                             uint32_t size,
+                             bool     copy): H17Block::H17Block( buf, size, copy)
 {
     // printf("%s\n", __PRETTY_FUNCTION__);
 
@@ -696,7 +725,8 @@ H17LabelBlock::analyze()
 // H17CommentBlock
 
 H17CommentBlock::H17CommentBlock(uint8_t  buf[],
-                                 uint32_t size): H17Block::H17Block( buf, size)
+                                 uint32_t size,
+                                 bool     copy): H17Block::H17Block( buf, size, copy)
 {
     // printf("%s\n", __PRETTY_FUNCTION__);
 
@@ -774,7 +804,8 @@ H17CommentBlock::getMandatory()
 // H17DateBlock
 
 H17DateBlock::H17DateBlock(uint8_t  buf[],
-                           uint32_t size): H17Block::H17Block( buf, size)
+                           uint32_t size,
+                           bool     copy): H17Block::H17Block( buf, size, copy)
 {
     // printf("%s\n", __PRETTY_FUNCTION__);
 
@@ -852,7 +883,8 @@ H17DateBlock::getMandatory()
 // H17ImagerBlock
 
 H17ImagerBlock::H17ImagerBlock(uint8_t  buf[],
-                               uint32_t size): H17Block::H17Block( buf, size)
+                               uint32_t size,
+                               bool     copy): H17Block::H17Block( buf, size, copy)
 {
     // printf("%s\n", __PRETTY_FUNCTION__);
 
@@ -930,7 +962,8 @@ H17ImagerBlock::getMandatory()
 // H17ProgramBlock
 
 H17ProgramBlock::H17ProgramBlock(uint8_t  buf[],
-                                 uint32_t size): H17Block::H17Block( buf, size)
+                                 uint32_t size,
+                                 bool     copy): H17Block::H17Block( buf, size, copy)
 {
     // printf("%s\n", __PRETTY_FUNCTION__);
 
@@ -1007,38 +1040,70 @@ H17ProgramBlock::getMandatory()
 
 // H17DataBlock
 
-//H17DataBlock::H17DataBlock(uint8_t buf[], uint32_t size): H17Block::H17Block( buf, size)
-H17DataBlock::H17DataBlock(uint8_t buf[],
-                           uint32_t size)
+//! constructor
+//!
+//! Only the track headers are read here, each track is parsed the first time it is
+//! accessed, with its sectors as views into the block's buffer.
+//!
+//! @param buf
+//! @param size
+//! @param copy - copy the buffer, otherwise keep a view into buf
+//!
+H17DataBlock::H17DataBlock(uint8_t  buf[],
+                           uint32_t size,
+                           bool     copy): H17Block::H17Block( buf, size, copy)
 {
     // printf("%s\n", __PRETTY_FUNCTION__);
 
-    size_m = size;
-  
-    uint32_t length;
     uint32_t pos = 0;
 
+    for (unsigned int side = 0; side < maxSides_c; side++)
+    {
+        for (unsigned int track = 0; track < maxTracks_c; track++)
+        {
+            trackIndex_m[side][track] = noTrack_c;
+        }
+    }
+
     while (pos < size)
     {
-        tracks_m.push_back(new Track(&buf[pos], size - pos, length));
-        pos += length;
+        if ((pos + Track::headerSize_c > size) || (buf_m[pos] != TrackDataId))
+        {
+            printf("Unexpected byte instead of TrackDataId: %d\n", buf_m[pos]);
+            break;
+        }
+
+        uint8_t side  = buf_m[pos + 1];
+        uint8_t track = buf_m[pos + 2];
+
+        if ((side < maxSides_c) && (track < maxTracks_c))
+        {
+            if (trackIndex_m[side][track] == noTrack_c)
+            {
+                trackIndex_m[side][track] = trackOffsets_m.size();
+            }
+            else
+            {
+                printf("Side: %d Track: %d - Duplicate track\n", side, track);
+            }
+        }
+
+        trackOffsets_m.push_back(pos);
+        pos += Track::headerSize_c + ((buf_m[pos + 3] << 8) | buf_m[pos + 4]);
     }
-     
+
+    tracks_m.resize(trackOffsets_m.size(), nullptr);
+
+    // sized so a disk with the usual sectors per track takes one slab of each
+    trackPool_m.setSlabObjects(trackOffsets_m.size());
+    sectorPool_m.setSlabObjects(trackOffsets_m.size() * Track::maxSectors_c);
 }
 
 H17DataBlock::~H17DataBlock()
 {
     // printf("%s\n", __PRETTY_FUNCTION__);
 
-    for (unsigned int i = 0 ; i < tracks_m.size(); i++)
-    {
-        if (tracks_m[i])
-        {
-            delete tracks_m[i];
-            tracks_m[i] = nullptr;
-        }
-    }
-    
+    // the tracks and sectors are freed with the pools
 }
 
 void
@@ -1048,6 +1113,28 @@ H17DataBlock::printBlockName()
 }
 
 
+//! get a track by its position in the block, parsing it on first use
+//!
+//! @param index
+//!
+//! @return track
+//!
+Track *
+H17DataBlock::getTrackAt(unsigned int index)
+{
+    if (!tracks_m[index])
+    {
+        uint32_t offset = trackOffsets_m[index];
+        uint32_t length;
+
+        tracks_m[index] = trackPool_m.create(&buf_m[offset], size_m - offset, length, false,
+                                             &sectorPool_m);
+    }
+
+    return tracks_m[index];
+}
+
+
 uint16_t
 H17DataBlock::getErrorCount()
 {
@@ -1055,7 +1142,7 @@ H17DataBlock::getErrorCount()
 
     for (unsigned int i = 0 ; i < tracks_m.size(); i++)
     {
-        count += tracks_m[i]->getErrorCount();
+        count += getTrackAt(i)->getErrorCount();
     }
 
     return count;
@@ -1064,12 +1151,22 @@ Track *
 H17DataBlock::getTrack(uint8_t side,
                        uint8_t track)
 {
-    for (unsigned int i = 0 ; i < tracks_m.size(); i++)
+    if ((side < maxSides_c) && (track < maxTracks_c))
+    {
+        int16_t index = trackIndex_m[side][track];
+
+        return (index == noTrack_c) ? nullptr : getTrackAt(index);
+    }
+
+    // match on the track header, so only the requested track is parsed
+    for (unsigned int i = 0 ; i < trackOffsets_m.size(); i++)
     {
-        if (tracks_m[i]->getTrackNumber() == track &&
-            tracks_m[i]->getSideNumber() == side)
+        uint8_t *header = &buf_m[trackOffsets_m[i]];
+
+        if (header[2] == track &&
+            header[1] == side)
         {
-            return tracks_m[i];
+            return getTrackAt(i);
         }
     }
 
@@ -1102,6 +1199,24 @@ H17DataBlock::getSector(uint16_t sectorNum)
     return getSector(0, trackNum, sectNum);
 }
 
+//! add the tracks to an index
+//!
+//! @param index
+//! @param dataPos - file offset the block's data is written at
+//!
+void
+H17DataBlock::addToIndex(H17IndexBlock &index,
+                         uint32_t       dataPos)
+{
+    for (unsigned int i = 0 ; i < trackOffsets_m.size(); i++)
+    {
+        uint8_t *header = &buf_m[trackOffsets_m[i]];
+
+        index.addEntry(TrackDataId, header[1], header[2], dataPos + trackOffsets_m[i],
+                       Track::headerSize_c + ((header[3] << 8) | header[4]));
+    }
+}
+
 //! get block id
 //!
 //! @return block id
@@ -1128,7 +1243,7 @@ H17DataBlock::writeToFile(std::ofstream &file)
 
     for (unsigned int i = 0 ; i < tracks_m.size(); i++)
     {
-        tracks_m[i]->writeToFile(file);
+        getTrackAt(i)->writeToFile(file);
     }
     
     return true;
@@ -1148,7 +1263,7 @@ H17DataBlock::writeAsH8D(std::ofstream &file)
     
     for (unsigned int i = 0 ; i < tracks_m.size(); i++)
     {   
-        tracks_m[i]->writeH8D(file);
+        getTrackAt(i)->writeH8D(file);
     }
     
     return true;
@@ -1168,7 +1283,7 @@ H17DataBlock::writeAsRaw(std::ofstream &file)
    
     for (unsigned int i = 0 ; i < tracks_m.size(); i++)
     {
-        tracks_m[i]->writeRaw(file);
+        getTrackAt(i)->writeRaw(file);
     }
    
     return true;
@@ -1212,7 +1327,7 @@ H17DataBlock::dump(uint8_t level)
 
     for (unsigned int i = 0; i < tracks_m.size(); ++i)
     {   
-        tracks_m[i]->dump(level);
+        getTrackAt(i)->dump(level);
     }
 
     return true;
@@ -1242,7 +1357,7 @@ H17DataBlock::analyze()
     
     for (unsigned int i = 0; i < tracks_m.size(); ++i)
     {
-        tracks_m[i]->analyze(trackValid);        
+        getTrackAt(i)->analyze(trackValid);
     } 
 
     /*for (int side = 0; side < expectedSides; ++side)
@@ -1272,42 +1387,157 @@ H17DataBlock::getMandatory()
 
 // H17RawDataBlock
 
+//! constructor
+//!
+//! Only the raw track headers are read here, each raw track is parsed the first time
+//! it is accessed, with its sectors as views into the block's buffer.
+//!
+//! @param buf
+//! @param size
+//! @param copy - copy the buffer, otherwise keep a view into buf
+//!
 H17RawDataBlock::H17RawDataBlock(uint8_t  buf[],
-                                 uint32_t size): H17Block::H17Block( buf, size)
+                                 uint32_t size,
+                                 bool     copy): H17Block::H17Block( buf, size, copy)
 {
     // printf("%s\n", __PRETTY_FUNCTION__);
 
-    size_m = size;
-
-    uint32_t length;
     uint32_t pos = 0;
 
     while (pos < size)
     {
-        rawTracks_m.push_back(new RawTrack(&buf[pos], size - pos, length));
-        pos += length;
+        if ((pos + RawTrack::headerSize_c > size) || (buf_m[pos] != RawTrackDataId))
+        {
+            printf("Unexpected byte instead of RawTrackDataId: %d\n", buf_m[pos]);
+            break;
+        }
+
+        rawTrackOffsets_m.push_back(pos);
+        pos += RawTrack::headerSize_c + (((uint32_t) buf_m[pos + 3] << 24) |
+                                         (buf_m[pos + 4] << 16) |
+                                         (buf_m[pos + 5] << 8) |
+                                          buf_m[pos + 6]);
     }
+
+    rawTracks_m.resize(rawTrackOffsets_m.size(), nullptr);
+
+    // sized so a disk with the usual sectors per track takes one slab of each
+    rawTrackPool_m.setSlabObjects(rawTrackOffsets_m.size());
+    rawSectorPool_m.setSlabObjects(rawTrackOffsets_m.size() * Track::maxSectors_c);
 }
 
 H17RawDataBlock::~H17RawDataBlock()
 {
     // printf("%s: %lu\n", __PRETTY_FUNCTION__, rawTracks_m.size());
 
-    for (unsigned int i = 0 ; i < rawTracks_m.size(); i++)
-    {   
-        if (rawTracks_m[i])
+    // the raw tracks and sectors are freed with the pools
+}
+
+
+void
+H17RawDataBlock::printBlockName()
+{
+    printf("  Raw Data\n");
+}
+
+
+//! get a raw track by its position in the block, parsing it on first use
+//!
+//! @param index
+//!
+//! @return raw track
+//!
+RawTrack *
+H17RawDataBlock::getRawTrackAt(unsigned int index)
+{
+    if (!rawTracks_m[index])
+    {
+        uint32_t offset = rawTrackOffsets_m[index];
+        uint32_t length;
+
+        rawTracks_m[index] = rawTrackPool_m.create(&buf_m[offset], size_m - offset, length, false,
+                                                   &rawSectorPool_m);
+    }
+
+    return rawTracks_m[index];
+}
+
+
+//! get a raw track
+//!
+//! @param side
+//! @param track
+//!
+//! @return raw track, nullptr if not found
+//!
+RawTrack *
+H17RawDataBlock::getRawTrack(uint8_t side,
+                             uint8_t track)
+{
+    for (unsigned int i = 0 ; i < rawTrackOffsets_m.size(); i++)
+    {
+        uint8_t *header = &buf_m[rawTrackOffsets_m[i]];
+
+        if (header[2] == track &&
+            header[1] == side)
         {
-            delete rawTracks_m[i];
-            rawTracks_m[i] = 0;
+            return getRawTrackAt(i);
         }
     }
+
+    return nullptr;
+}
+
+//! create a raw data block with the same tracks, with the later attempts of each sector
+//! stored as deltas against the first, or all stored in full
+//!
+//! Each track is encoded from a copy, so this block and its parsed tracks still match
+//! its buffer.
+//!
+//! @param delta - use deltas
+//!
+//! @return new block
+//!
+H17RawDataBlock *
+H17RawDataBlock::createDeltaBlock(bool delta)
+{
+    std::ostringstream data;
+
+    for (unsigned int i = 0 ; i < rawTrackOffsets_m.size(); i++)
+    {
+        uint32_t offset = rawTrackOffsets_m[i];
+        uint32_t length;
+        RawTrack track(&buf_m[offset], size_m - offset, length, true);
+
+        track.setDeltaEncoding(delta);
+        track.writeToFile(data);
+    }
+
+    std::string buf = data.str();
+
+    return new H17RawDataBlock((uint8_t *) buf.data(), buf.size());
 }
 
 
+//! add the raw tracks to an index
+//!
+//! @param index
+//! @param dataPos - file offset the block's data is written at
+//!
 void
-H17RawDataBlock::printBlockName()
+H17RawDataBlock::addToIndex(H17IndexBlock &index,
+                            uint32_t       dataPos)
 {
-    printf("  Raw Data\n");
+    for (unsigned int i = 0 ; i < rawTrackOffsets_m.size(); i++)
+    {
+        uint8_t *header = &buf_m[rawTrackOffsets_m[i]];
+
+        index.addEntry(RawTrackDataId, header[1], header[2], dataPos + rawTrackOffsets_m[i],
+                       RawTrack::headerSize_c + (((uint32_t) header[3] << 24) |
+                                                 (header[4] << 16) |
+                                                 (header[5] << 8) |
+                                                  header[6]));
+    }
 }
 
 //! get block id
@@ -1329,7 +1559,7 @@ H17RawDataBlock::writeToFile(std::ofstream &file)
 
     for (unsigned int i = 0 ; i < rawTracks_m.size(); i++)
     {   
-        rawTracks_m[i]->writeToFile(file);
+        getRawTrackAt(i)->writeToFile(file);
     }
 
     return true;
@@ -1377,3 +1607,656 @@ H17RawDataBlock::getMandatory()
 {
     return false;
 }
+
+
+// H17CompressedRawDataBlock
+
+//! constructor
+//!
+//! Only the sub-block headers are read here, each raw track is decompressed the first time
+//! it is accessed.
+//!
+//! @param buf
+//! @param size
+//! @param copy - copy the buffer, otherwise keep a view into buf
+//!
+H17CompressedRawDataBlock::H17CompressedRawDataBlock(uint8_t  buf[],
+                                                     uint32_t size,
+                                                     bool     copy): H17Block::H17Block( buf, size, copy)
+{
+    // printf("%s\n", __PRETTY_FUNCTION__);
+
+    indexTracks();
+}
+
+
+//! constructor, compressing the tracks of a raw data block
+//!
+//! Tracks that don't get smaller are stored as they are.
+//!
+//! @param rawData
+//!
+H17CompressedRawDataBlock::H17CompressedRawDataBlock(H17RawDataBlock &rawData)
+{
+    // printf("%s\n", __PRETTY_FUNCTION__);
+
+    uint8_t             *raw     = rawData.getData();
+    uint32_t             rawSize = rawData.getDataSize();
+    uint32_t             pos     = 0;
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> compressed;
+
+    while (pos + RawTrack::headerSize_c <= rawSize)
+    {
+        if (raw[pos] != RawTrackDataId)
+        {
+            printf("Unexpected byte instead of RawTrackDataId: %d\n", raw[pos]);
+            break;
+        }
+
+        uint32_t length = RawTrack::headerSize_c + (((uint32_t) raw[pos + 3] << 24) |
+                                                    (raw[pos + 4] << 16) |
+                                                    (raw[pos + 5] << 8) |
+                                                     raw[pos + 6]);
+
+        if (length > rawSize - pos)
+        {
+            printf("Raw track too long: %u\n", length);
+            break;
+        }
+
+        uint8_t codec = codecLZ_c;
+
+        if (!LZ::compress(&raw[pos], length, compressed))
+        {
+            codec = codecStored_c;
+            compressed.assign(&raw[pos], &raw[pos + length]);
+        }
+
+        uint32_t      compressedLength = compressed.size();
+        unsigned char header[trackHeaderSize_c] = {
+            CompressedRawTrackDataId,
+            raw[pos + 1],
+            raw[pos + 2],
+            codec,
+            (unsigned char) ((length >> 24) & 0xff),
+            (unsigned char) ((length >> 16) & 0xff),
+            (unsigned char) ((length >>  8) & 0xff),
+            (unsigned char)  (length        & 0xff),
+            (unsigned char) ((compressedLength >> 24) & 0xff),
+            (unsigned char) ((compressedLength >> 16) & 0xff),
+            (unsigned char) ((compressedLength >>  8) & 0xff),
+            (unsigned char)  (compressedLength        & 0xff)
+        };
+
+        data.insert(data.end(), header, header + trackHeaderSize_c);
+        data.insert(data.end(), compressed.begin(), compressed.end());
+
+        pos += length;
+    }
+
+    size_m = data.size();
+    buf_m  = new unsigned char[size_m];
+    memcpy(buf_m, data.data(), size_m);
+
+    indexTracks();
+}
+
+
+H17CompressedRawDataBlock::~H17CompressedRawDataBlock()
+{
+    // printf("%s\n", __PRETTY_FUNCTION__);
+
+    // the raw tracks and sectors are freed with the pools
+}
+
+
+//! find the compressed raw tracks in the buffer
+//!
+void
+H17CompressedRawDataBlock::indexTracks()
+{
+    uint32_t pos = 0;
+
+    while (pos < size_m)
+    {
+        if ((pos + trackHeaderSize_c > size_m) || (buf_m[pos] != CompressedRawTrackDataId))
+        {
+            printf("Unexpected byte instead of CompressedRawTrackDataId: %d\n", buf_m[pos]);
+            break;
+        }
+
+        uint32_t length = ((uint32_t) buf_m[pos + 8] << 24) | (buf_m[pos + 9] << 16) |
+                          (buf_m[pos + 10] << 8) | buf_m[pos + 11];
+
+        if (length > size_m - pos - trackHeaderSize_c)
+        {
+            printf("Compressed raw track too long: %u\n", length);
+            break;
+        }
+
+        trackOffsets_m.push_back(pos);
+        pos += trackHeaderSize_c + length;
+    }
+
+    rawTracks_m.resize(trackOffsets_m.size(), nullptr);
+    rawTrackData_m.resize(trackOffsets_m.size());
+
+    rawTrackPool_m.setSlabObjects(trackOffsets_m.size());
+    rawSectorPool_m.setSlabObjects(trackOffsets_m.size() * Track::maxSectors_c);
+}
+
+
+void
+H17CompressedRawDataBlock::printBlockName()
+{
+    printf("  Compressed Raw Data\n");
+}
+
+
+//! get block id
+//!
+//! @return block id
+//!
+uint8_t
+H17CompressedRawDataBlock::getBlockId()
+{
+    return CompressedRawDataBlock_c;
+}
+
+
+//! get mandatory flag
+//!
+//! @return false
+//!
+bool
+H17CompressedRawDataBlock::getMandatory()
+{
+    return false;
+}
+
+
+//! get number of raw tracks
+//!
+//! @return count
+//!
+unsigned int
+H17CompressedRawDataBlock::getRawTrackCount()
+{
+    return trackOffsets_m.size();
+}
+
+
+//! decompress a raw track
+//!
+//! Doesn't change the block, so the tracks can be decompressed from several threads.
+//!
+//! @param index - position of the track in the block
+//! @param data  - [out] the raw track sub-block
+//!
+//! @return success
+//!
+bool
+H17CompressedRawDataBlock::getRawTrackData(unsigned int          index,
+                                           std::vector<uint8_t> &data)
+{
+    if (index >= trackOffsets_m.size())
+    {
+        return false;
+    }
+
+    uint8_t *header           = &buf_m[trackOffsets_m[index]];
+    uint32_t length           = ((uint32_t) header[4] << 24) | (header[5] << 16) |
+                                (header[6] << 8) | header[7];
+    uint32_t compressedLength = ((uint32_t) header[8] << 24) | (header[9] << 16) |
+                                (header[10] << 8) | header[11];
+    uint8_t *compressed       = &header[trackHeaderSize_c];
+
+    // the lengths come from the file, don't let a corrupt one allocate gigabytes
+    if ((length > maxRawTrackBytes_c) ||
+        ((uint64_t) length > (uint64_t) compressedLength * LZ::maxExpansion_c))
+    {
+        printf("Side: %d Track: %d - Invalid raw track length: %u\n", header[1], header[2],
+               length);
+        data.clear();
+        return false;
+    }
+
+    data.resize(length);
+
+    switch (header[3])
+    {
+        case codecStored_c:
+            if (compressedLength == length)
+            {
+                memcpy(data.data(), compressed, length);
+                return true;
+            }
+            break;
+        case codecLZ_c:
+            if (LZ::decompress(compressed, compressedLength, data.data(), length))
+            {
+                return true;
+            }
+            break;
+        default:
+            printf("Unknown codec: %d\n", header[3]);
+            data.clear();
+            return false;
+    }
+
+    printf("Side: %d Track: %d - Corrupt compressed raw track\n", header[1], header[2]);
+    data.clear();
+
+    return false;
+}
+
+
+//! get a raw track by its position in the block, decompressing it on first use
+//!
+//! @param index
+//!
+//! @return raw track, nullptr if it can't be decompressed
+//!
+RawTrack *
+H17CompressedRawDataBlock::getRawTrackAt(unsigned int index)
+{
+    if ((!rawTracks_m[index]) && (getRawTrackData(index, rawTrackData_m[index])))
+    {
+        std::vector<uint8_t> &data = rawTrackData_m[index];
+        uint32_t              length;
+
+        rawTracks_m[index] = rawTrackPool_m.create(data.data(), data.size(), length, false,
+                                                   &rawSectorPool_m);
+    }
+
+    return rawTracks_m[index];
+}
+
+
+//! get a raw track
+//!
+//! @param side
+//! @param track
+//!
+//! @return raw track, nullptr if not found
+//!
+RawTrack *
+H17CompressedRawDataBlock::getRawTrack(uint8_t side,
+                                       uint8_t track)
+{
+    for (unsigned int i = 0 ; i < trackOffsets_m.size(); i++)
+    {
+        uint8_t *header = &buf_m[trackOffsets_m[i]];
+
+        if (header[2] == track &&
+            header[1] == side)
+        {
+            return getRawTrackAt(i);
+        }
+    }
+
+    return nullptr;
+}
+
+
+//! create an uncompressed raw data block with the same tracks
+//!
+//! @return new block, nullptr if a track can't be decompressed
+//!
+H17RawDataBlock *
+H17CompressedRawDataBlock::createRawDataBlock()
+{
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> track;
+
+    for (unsigned int i = 0 ; i < trackOffsets_m.size(); i++)
+    {
+        if (!getRawTrackData(i, track))
+        {
+            return nullptr;
+        }
+        data.insert(data.end(), track.begin(), track.end());
+    }
+
+    return new H17RawDataBlock(data.data(), data.size());
+}
+
+
+//! add the compressed raw tracks to an index
+//!
+//! @param index
+//! @param dataPos - file offset the block's data is written at
+//!
+void
+H17CompressedRawDataBlock::addToIndex(H17IndexBlock &index,
+                                      uint32_t       dataPos)
+{
+    for (unsigned int i = 0 ; i < trackOffsets_m.size(); i++)
+    {
+        uint8_t *header = &buf_m[trackOffsets_m[i]];
+
+        index.addEntry(CompressedRawTrackDataId, header[1], header[2], dataPos + trackOffsets_m[i],
+                       trackHeaderSize_c + (((uint32_t) header[8] << 24) |
+                                            (header[9] << 16) |
+                                            (header[10] << 8) |
+                                             header[11]));
+    }
+}
+
+
+//! dump the block to stdout
+//!
+//! @param level - detail level to display
+//!            0 - none
+//!            1 - minimal
+//!            2 - some
+//!            3 - lots
+//!            4 - complete
+//!
+//! @returns success
+//!
+bool
+H17CompressedRawDataBlock::dump(uint8_t level)
+{
+   if (level < 3)
+   {
+       return true;
+   }
+
+   uint64_t rawSize = 0;
+
+   for (unsigned int i = 0 ; i < trackOffsets_m.size(); i++)
+   {
+       uint8_t *header = &buf_m[trackOffsets_m[i]];
+
+       rawSize += ((uint32_t) header[4] << 24) | (header[5] << 16) | (header[6] << 8) | header[7];
+   }
+
+   printf("Compressed Raw Data: %zu tracks, %zu bytes from %zu\n", trackOffsets_m.size(),
+          (size_t) size_m, (size_t) rawSize);
+
+   return true;
+}
+
+bool
+H17CompressedRawDataBlock::analyze()
+{
+   // TODO ? validate expected tracks?
+
+   return true;
+}
+
+
+// H17IndexBlock
+
+//! constructor for an empty index
+//!
+H17IndexBlock::H17IndexBlock()
+{
+    // printf("%s\n", __PRETTY_FUNCTION__);
+
+}
+
+
+//! constructor
+//!
+//! @param buf
+//! @param size
+//!
+H17IndexBlock::H17IndexBlock(uint8_t  buf[],
+                             uint32_t size)
+{
+    // printf("%s\n", __PRETTY_FUNCTION__);
+
+    if (size % entrySize_c)
+    {
+        printf("Index block size not a multiple of %d: %d\n", entrySize_c, size);
+    }
+
+    for (uint32_t pos = 0; pos + entrySize_c <= size; pos += entrySize_c)
+    {
+        addEntry(buf[pos], buf[pos + 1], buf[pos + 2],
+                 ((uint32_t) buf[pos + 3] << 24) | (buf[pos + 4] << 16) |
+                 (buf[pos + 5] << 8) | buf[pos + 6],
+                 ((uint32_t) buf[pos + 7] << 24) | (buf[pos + 8] << 16) |
+                 (buf[pos + 9] << 8) | buf[pos + 10]);
+    }
+}
+
+
+//! destructor
+//!
+H17IndexBlock::~H17IndexBlock()
+{
+    // printf("%s\n", __PRETTY_FUNCTION__);
+
+}
+
+
+//! print block name
+//!
+void
+H17IndexBlock::printBlockName()
+{
+    printf("  Index\n");
+}
+
+
+//! get block id
+//!
+//! @return block id
+//!
+uint8_t
+H17IndexBlock::getBlockId()
+{
+    return IndexBlock_c;
+}
+
+
+//! get mandatory flag
+//!
+//! @return false, readers that don't know the block can skip it
+//!
+bool
+H17IndexBlock::getMandatory()
+{
+    return false;
+}
+
+
+//! get size of data portion of block
+//!
+//! @return size in bytes
+//!
+uint32_t
+H17IndexBlock::getDataSize()
+{
+    return entries_m.size() * entrySize_c;
+}
+
+
+//! add an entry
+//!
+//! @param id     - sub-block id, TrackDataId or RawTrackDataId
+//! @param side
+//! @param track
+//! @param offset - file offset of the sub-block
+//! @param length - length of the sub-block, including its header
+//!
+void
+H17IndexBlock::addEntry(uint8_t  id,
+                        uint8_t  side,
+                        uint8_t  track,
+                        uint32_t offset,
+                        uint32_t length)
+{
+    Entry entry = { id, side, track, offset, length };
+
+    entries_m.push_back(entry);
+}
+
+
+//! add the entries of another index, moving their offsets
+//!
+//! @param index
+//! @param base  - added to the offsets
+//!
+void
+H17IndexBlock::append(H17IndexBlock &index,
+                      uint32_t       base)
+{
+    for (unsigned int i = 0; i < index.entries_m.size(); i++)
+    {
+        Entry entry = index.entries_m[i];
+
+        entry.offset += base;
+        entries_m.push_back(entry);
+    }
+}
+
+
+//! find the entry for a sub-block
+//!
+//! @param id
+//! @param side
+//! @param track
+//! @param offset  - [out] file offset of the sub-block
+//! @param length  - [out] length of the sub-block
+//!
+//! @return if found
+//!
+bool
+H17IndexBlock::findEntry(uint8_t   id,
+                         uint8_t   side,
+                         uint8_t   track,
+                         uint32_t &offset,
+                         uint32_t &length)
+{
+    for (unsigned int i = 0; i < entries_m.size(); i++)
+    {
+        if ((entries_m[i].id == id) &&
+            (entries_m[i].side == side) &&
+            (entries_m[i].track == track))
+        {
+            offset = entries_m[i].offset;
+            length = entries_m[i].length;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+//! get number of entries
+//!
+//! @return count
+//!
+unsigned int
+H17IndexBlock::getEntryCount()
+{
+    return entries_m.size();
+}
+
+
+//! remove all entries
+//!
+void
+H17IndexBlock::clear()
+{
+    entries_m.clear();
+}
+
+
+//! write the entries, without the block header
+//!
+//! @param out
+//!
+//! @return success
+//!
+bool
+H17IndexBlock::writeEntries(std::ostream &out)
+{
+    for (unsigned int i = 0; i < entries_m.size(); i++)
+    {
+        Entry        &entry = entries_m[i];
+        unsigned char buf[entrySize_c] = {
+            entry.id,
+            entry.side,
+            entry.track,
+            (unsigned char) ((entry.offset >> 24) & 0xff),
+            (unsigned char) ((entry.offset >> 16) & 0xff),
+            (unsigned char) ((entry.offset >>  8) & 0xff),
+            (unsigned char)  (entry.offset        & 0xff),
+            (unsigned char) ((entry.length >> 24) & 0xff),
+            (unsigned char) ((entry.length >> 16) & 0xff),
+            (unsigned char) ((entry.length >>  8) & 0xff),
+            (unsigned char)  (entry.length        & 0xff)
+        };
+
+        out.write((const char*) buf, entrySize_c);
+    }
+
+    return true;
+}
+
+
+//! write block to file
+//!
+//! @param file
+//!
+//! @return status
+//!
+bool
+H17IndexBlock::writeToFile(std::ofstream &file)
+{
+    writeBlockHeader(file);
+
+    return writeEntries(file);
+}
+
+
+//! dump the block to stdout
+//!
+//! @param level - detail level to display
+//!            0 - none
+//!            1 - minimal
+//!            2 - some
+//!            3 - lots
+//!            4 - complete
+//!
+//! @returns success
+//!
+bool
+H17IndexBlock::dump(uint8_t level)
+{
+   if (level == 0)
+   {
+       return true;
+   }
+   if (level < 3)
+   {
+       printf("Index: %zu entries\n", entries_m.size());
+       return true;
+   }
+   printf(" Index Block:\n");
+   printf("=====================\n");
+   for (unsigned int i = 0; i < entries_m.size(); i++)
+   {
+       printf("   0x%02x S:%d/T:%02d  Offset: %u  Length: %u\n", entries_m[i].id,
+              entries_m[i].side, entries_m[i].track, entries_m[i].offset, entries_m[i].length);
+   }
+   printf("=====================\n");
+
+   return true;
+}
+
+bool
+H17IndexBlock::analyze()
+{
+   // TODO ? check the entries against the data blocks
+
+   return true;
+}
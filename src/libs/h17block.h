@@ -11,10 +11,14 @@
 #include <cstdint>
 #include <vector>
 
+#include "pool.h"
+
 
 class Track;
 class Sector;
 class RawTrack;
+class RawSector;
+class H17IndexBlock;
 
 
 class H17Block 
@@ -22,7 +26,7 @@ class H17Block
 
 public:
     H17Block();
-    H17Block(uint8_t buf[], uint32_t size);
+    H17Block(uint8_t buf[], uint32_t size, bool copy = true);
     virtual ~H17Block();
 
     virtual uint32_t     getDataSize();
@@ -39,7 +43,7 @@ public:
     virtual uint8_t      getBlockId() = 0;
     virtual void         printBlockName() = 0;
 
-    static H17Block *create(uint8_t buf[], uint32_t size);
+    static H17Block *create(uint8_t buf[], uint32_t size, bool copy = true);
 
     static const uint8_t DiskFormatBlock_c = 0x00;
     static const uint8_t FlagsBlock_c      = 0x01;
@@ -52,11 +56,18 @@ public:
     static const uint8_t DataBlock_c       = 0x10;
     static const uint8_t RawDataBlock_c    = 0x30;
 
+    static const uint8_t CompressedRawDataBlock_c = 0x38;
+
+    static const uint8_t IndexBlock_c      = 0x40;
+
     static const uint8_t TrackDataId       = 0x11;
     static const uint8_t SectorDataId      = 0x12;
 
     static const uint8_t RawTrackDataId    = 0x31;
     static const uint8_t RawSectorDataId   = 0x32;
+    static const uint8_t RawSectorDeltaId  = 0x33;
+
+    static const uint8_t CompressedRawTrackDataId = 0x39;
 
 protected:
     virtual bool         dumpText();
@@ -65,6 +76,9 @@ protected:
 
     uint32_t               size_m;
     uint8_t               *buf_m;
+
+    // false when buf_m is a view into a buffer owned by someone else, such as a mapped file
+    bool                   ownsBuf_m;
 };
 
 
@@ -124,7 +138,7 @@ class H17LabelBlock: public H17Block
 {
 public:
 
-    H17LabelBlock(uint8_t buf[], uint32_t size);
+    H17LabelBlock(uint8_t buf[], uint32_t size, bool copy = true);
     virtual ~H17LabelBlock();
 
     virtual uint8_t      getBlockId();
@@ -142,7 +156,7 @@ class H17CommentBlock: public H17Block
 {
 public:
 
-    H17CommentBlock(uint8_t buf[], uint32_t size);
+    H17CommentBlock(uint8_t buf[], uint32_t size, bool copy = true);
     virtual ~H17CommentBlock();
 
     virtual uint8_t      getBlockId();
@@ -160,7 +174,7 @@ class H17DateBlock: public H17Block
 {
 public:
 
-    H17DateBlock(uint8_t buf[], uint32_t size);
+    H17DateBlock(uint8_t buf[], uint32_t size, bool copy = true);
     virtual ~H17DateBlock();
 
     virtual uint8_t      getBlockId();
@@ -178,7 +192,7 @@ class H17ImagerBlock: public H17Block
 {
 public:
 
-    H17ImagerBlock(uint8_t buf[], uint32_t size);
+    H17ImagerBlock(uint8_t buf[], uint32_t size, bool copy = true);
     virtual ~H17ImagerBlock();
    
     virtual uint8_t      getBlockId();
@@ -196,7 +210,7 @@ class H17ProgramBlock: public H17Block
 {
 public:
 
-    H17ProgramBlock(uint8_t buf[], uint32_t size);
+    H17ProgramBlock(uint8_t buf[], uint32_t size, bool copy = true);
     virtual ~H17ProgramBlock();
    
     virtual uint8_t      getBlockId();
@@ -214,7 +228,7 @@ class H17DataBlock: public H17Block
 {
 public:
 
-    H17DataBlock(uint8_t buf[], uint32_t size);
+    H17DataBlock(uint8_t buf[], uint32_t size, bool copy = true);
     virtual ~H17DataBlock();
 
     virtual uint8_t      getBlockId();
@@ -233,8 +247,25 @@ public:
     virtual Sector *     getSector(uint16_t sector);
     virtual uint16_t     getErrorCount();
 
+    virtual void         addToIndex(H17IndexBlock &index, uint32_t dataPos);
+
 private:
-    std::vector<Track *> tracks_m;
+    Track               *getTrackAt(unsigned int index);
+
+    static const uint8_t  maxSides_c  = 2;
+    static const uint8_t  maxTracks_c = 80;
+    static const int16_t  noTrack_c   = -1;
+
+    // offset of each track in buf_m, tracks are parsed on first use
+    std::vector<uint32_t> trackOffsets_m;
+    std::vector<Track *>  tracks_m;
+
+    // the parsed tracks and sectors, freed with the block
+    Pool<Sector>          sectorPool_m;
+    Pool<Track>           trackPool_m;
+
+    // position in trackOffsets_m of each side/track
+    int16_t               trackIndex_m[maxSides_c][maxTracks_c];
 
 };
 
@@ -243,7 +274,7 @@ class H17RawDataBlock: public H17Block
 {
 public:
 
-    H17RawDataBlock(uint8_t buf[], uint32_t size);
+    H17RawDataBlock(uint8_t buf[], uint32_t size, bool copy = true);
     virtual ~H17RawDataBlock();
 
     virtual uint8_t      getBlockId();
@@ -253,9 +284,128 @@ public:
     virtual bool         analyze();
     virtual void         printBlockName();
 
+    virtual RawTrack *   getRawTrack(uint8_t side, uint8_t track);
+    virtual H17RawDataBlock *createDeltaBlock(bool delta);
+
+    virtual void         addToIndex(H17IndexBlock &index, uint32_t dataPos);
+
 private:
+    RawTrack            *getRawTrackAt(unsigned int index);
+
+    // offset of each raw track in buf_m, raw tracks are parsed on first use
+    std::vector<uint32_t>   rawTrackOffsets_m;
     std::vector<RawTrack *> rawTracks_m;
 
+    // the parsed raw tracks and sectors, freed with the block
+    Pool<RawSector>         rawSectorPool_m;
+    Pool<RawTrack>          rawTrackPool_m;
+
+};
+
+
+//! Raw data with each raw track compressed on its own, so a track can be read, or the
+//! tracks decoded in parallel, without decompressing the whole block.
+//!
+//! Each sub-block is the id, side, track and codec, then the size of the raw track
+//! sub-block and the size of the compressed data, both 4 bytes big-endian, followed by
+//! the compressed data. Decompressed, it is the raw track sub-block as it would be in the
+//! raw data block.
+//!
+class H17CompressedRawDataBlock: public H17Block
+{
+public:
+
+    H17CompressedRawDataBlock(uint8_t buf[], uint32_t size, bool copy = true);
+    H17CompressedRawDataBlock(H17RawDataBlock &rawData);
+    virtual ~H17CompressedRawDataBlock();
+
+    virtual uint8_t      getBlockId();
+    virtual bool         getMandatory();
+    virtual bool         dump(uint8_t level = 5);
+    virtual bool         analyze();
+    virtual void         printBlockName();
+
+    virtual RawTrack *   getRawTrack(uint8_t side, uint8_t track);
+    virtual unsigned int getRawTrackCount();
+    virtual bool         getRawTrackData(unsigned int index, std::vector<uint8_t> &data);
+    virtual H17RawDataBlock *createRawDataBlock();
+
+    virtual void         addToIndex(H17IndexBlock &index, uint32_t dataPos);
+
+    static const uint8_t  codecStored_c   = 0x00;
+    static const uint8_t  codecLZ_c       = 0x01;
+
+    static const uint32_t trackHeaderSize_c = 12;
+
+    //! largest raw track accepted, far more than every retry of every sector of a track
+    static const uint32_t maxRawTrackBytes_c = 0x100000;
+
+private:
+    void                 indexTracks();
+    RawTrack            *getRawTrackAt(unsigned int index);
+
+    // offset of each compressed raw track in buf_m
+    std::vector<uint32_t>             trackOffsets_m;
+
+    // raw tracks decompressed on first use, they are views into their data
+    std::vector<RawTrack *>           rawTracks_m;
+    std::vector<std::vector<uint8_t>> rawTrackData_m;
+
+    Pool<RawSector>                   rawSectorPool_m;
+    Pool<RawTrack>                    rawTrackPool_m;
+};
+
+
+//! Index of the track sub-blocks in the file, so a reader can seek straight to one track.
+//!
+//! Each entry is the sub-block id, side and track, followed by the file offset of the
+//! sub-block and its length including the sub-block header, both 4 bytes big-endian.
+//!
+class H17IndexBlock: public H17Block
+{
+public:
+
+    H17IndexBlock();
+    H17IndexBlock(uint8_t buf[], uint32_t size);
+    virtual ~H17IndexBlock();
+
+    virtual uint8_t      getBlockId();
+    virtual bool         writeToFile(std::ofstream &file);
+    virtual bool         getMandatory();
+    virtual uint32_t     getDataSize();
+    virtual bool         dump(uint8_t level = 5);
+    virtual bool         analyze();
+    virtual void         printBlockName();
+
+    virtual void         addEntry(uint8_t  id,
+                                  uint8_t  side,
+                                  uint8_t  track,
+                                  uint32_t offset,
+                                  uint32_t length);
+    virtual void         append(H17IndexBlock &index, uint32_t base);
+    virtual bool         findEntry(uint8_t   id,
+                                   uint8_t   side,
+                                   uint8_t   track,
+                                   uint32_t &offset,
+                                   uint32_t &length);
+    virtual unsigned int getEntryCount();
+    virtual bool         writeEntries(std::ostream &out);
+    virtual void         clear();
+
+    static const uint32_t entrySize_c = 11;
+
+private:
+
+    struct Entry
+    {
+        uint8_t  id;
+        uint8_t  side;
+        uint8_t  track;
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    std::vector<Entry>   entries_m;
 };
 
 #endif
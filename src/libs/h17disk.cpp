@@ -4,6 +4,7 @@
 //!
 
 #include "h17disk.h"
+#include "async_writer.h"
 #include "disk_util.h"
 #include "h17block.h"
 #include "decode.h"
@@ -12,6 +13,10 @@
 #include "raw_track.h"
 #include "dump.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -26,6 +31,10 @@ const uint8_t H17Disk::ProgramBlock_c    = 0x06;
 const uint8_t H17Disk::DataBlock_c       = 0x10;
 const uint8_t H17Disk::RawDataBlock_c    = 0x30;
 
+const uint8_t H17Disk::CompressedRawDataBlock_c = 0x38;
+
+const uint8_t H17Disk::IndexBlock_c      = 0x40;
+
 // SubBlock IDs
 //
 const uint8_t H17Disk::TrackDataId       = 0x11;
@@ -33,6 +42,9 @@ const uint8_t H17Disk::SectorDataId      = 0x12;
 
 const uint8_t H17Disk::RawTrackDataId    = 0x31;
 const uint8_t H17Disk::RawSectorDataId   = 0x32;
+const uint8_t H17Disk::RawSectorDeltaId  = 0x33;
+
+const uint8_t H17Disk::CompressedRawTrackDataId = 0x39;
 
 // flags
 const uint8_t H17Disk::DistUnknown            = 0x00;
@@ -67,11 +79,31 @@ H17Disk::H17Disk(): sides_m(defaultSides_c),
                     trackDataSource_m(2),
                     writeProtect_m(false),
                     disableRaw_m(false),
+                    deltaRaw_m(false),
+                    writeIndex_m(false),
                     versionMajor_m(versionMajor_c),
                     versionMinor_m(versionMinor_c),
                     versionPoint_m(versionPoint_c),
+                    map_m(nullptr),
+                    mapSize_m(0),
+                    copyBlocks_m(true),
+                    out_m(&file_m),
+                    streaming_m(false),
+                    asyncWriter_m(nullptr),
+                    asyncOut_m(nullptr),
                     summarize_m(false),
-                    sectorErrs_m(0)
+                    sectorErrs_m(0),
+                    spillRaw_m(false),
+                    curRawTrack_m(nullptr),
+                    rawSpill_m(nullptr),
+                    rawSpillWriter_m(nullptr),
+                    rawSpillOut_m(nullptr),
+                    rawSpillSize_m(0),
+                    trackIndex_m(new H17IndexBlock()),
+                    rawTrackIndex_m(new H17IndexBlock()),
+                    trackPos_m(0),
+                    dataBlockPos_m(-1),
+                    rawDataBlockPos_m(-1)
 {
     int i;
     for( i = 0; i < 10; i++)
@@ -103,6 +135,25 @@ H17Disk::~H17Disk()
         }
     }
 
+    if (asyncWriter_m)
+    {
+        closeFile();
+    }
+
+    closeRawSpill();
+    if (rawSpill_m)
+    {
+        fclose(rawSpill_m);
+    }
+    delete curRawTrack_m;
+    delete trackIndex_m;
+    delete rawTrackIndex_m;
+
+    // only after the blocks, which may still reference it
+    if (map_m)
+    {
+        munmap(map_m, mapSize_m);
+    }
 }
 
 //! disable raw blocks
@@ -113,6 +164,40 @@ H17Disk::disableRaw()
     disableRaw_m = true;
 }
 
+
+//! keep raw sectors for only the current track in memory
+//!
+//! Each raw track is handed to an I/O thread that appends it to a temporary file when
+//! the track ends, and copied into the raw data block by writeRawDataBlock(). The file
+//! format is unchanged.
+//!
+void
+H17Disk::spillRaw()
+{
+    spillRaw_m = true;
+}
+
+
+//! store retries of a sector as deltas against the first attempt
+//!
+void
+H17Disk::deltaRaw()
+{
+    deltaRaw_m = true;
+}
+
+
+//! write an index block of the tracks when the file is closed or saved
+//!
+//! Off by default, readers from before the index block fail on any block they don't
+//! know, so only files for readers built with it should have one.
+//!
+void
+H17Disk::writeIndex()
+{
+    writeIndex_m = true;
+}
+
 bool
 H17Disk::fileExists(const char *name)
 {
@@ -150,10 +235,91 @@ H17Disk::openForWrite(const char *name)
 
     file_m.open(name, ios::out | ios::binary);
 
+    out_m       = &file_m;
+    streaming_m = false;
+
     return (file_m.is_open());
 }
 
 
+//! open a stream for writing, such as a pipe, stdout or a socket
+//!
+//! Nothing is written out of order, the data block is held in memory until
+//! endDataBlock() and then written with its final length.
+//!
+//! @param out        stream to write to, it must stay valid until closeFile()
+//!
+//! @return success
+//!
+bool
+H17Disk::openForStream(std::ostream &out)
+{
+    // make sure a file is not already open
+    if (file_m.is_open())
+    {
+        file_m.close();
+    }
+
+    out_m       = &out;
+    streaming_m = true;
+
+    return out.good();
+}
+
+
+//! open file for writing from a background thread
+//!
+//! Each track is handed to the I/O thread when it ends, so the caller only waits on
+//! the file when the writer has fallen a full queue behind. closeFile() waits for
+//! the writes to finish and syncs the file to the disk.
+//!
+//! @param name       file name
+//!
+//! @return success
+//!
+bool
+H17Disk::openForAsyncWrite(const char *name)
+{
+    if (fileExists(name) || asyncWriter_m)
+    {
+        return false;
+    }
+
+    // make sure a file is not already open
+    if (file_m.is_open())
+    {
+        file_m.close();
+    }
+
+    asyncWriter_m = new AsyncWriter();
+
+    if (!asyncWriter_m->open(name))
+    {
+        delete asyncWriter_m;
+        asyncWriter_m = nullptr;
+
+        return false;
+    }
+
+    asyncOut_m  = new std::ostream(asyncWriter_m);
+    out_m       = asyncOut_m;
+    streaming_m = false;
+
+    return true;
+}
+
+
+//! check that a file or stream is open for writing
+//!
+//! @return if open
+//!
+bool
+H17Disk::isOpenForWrite()
+{
+    return streaming_m || asyncWriter_m || file_m.is_open();
+}
+
+
 //! open file for read
 //!
 //! @param name       file name
@@ -234,6 +400,183 @@ H17Disk::loadFile(const char *name)
 }
 
 
+//! load file by mapping it into memory
+//!
+//! The blocks, tracks and sectors are views into the mapping instead of copies, the
+//! mapping is released when the H17Disk is destroyed. The file must not be modified
+//! while it is mapped.
+//!
+//! @param name       file name
+//!
+//! @return success
+//!
+bool
+H17Disk::mapFile(const char *name)
+{
+    bool           status = false;
+    struct stat    fileStat;
+
+    if (map_m)
+    {
+        printf("File already mapped\n");
+        return status;
+    }
+
+    int fd = open(name, O_RDONLY);
+
+    if (fd < 0)
+    {
+        return status;
+    }
+
+    if ((fstat(fd, &fileStat) == 0) && (fileStat.st_size > 0))
+    {
+        void *addr = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (addr != MAP_FAILED)
+        {
+            map_m     = (uint8_t *) addr;
+            mapSize_m = fileStat.st_size;
+        }
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+
+    if (map_m)
+    {
+        setDefaults();
+
+        copyBlocks_m = false;
+        status = loadBuffer(map_m, mapSize_m);
+        copyBlocks_m = true;
+    }
+
+    return status;
+}
+
+
+//! read one track sub-block from a file, without loading the rest of it
+//!
+//! Only the block headers are read to find the index block, which gives the position of
+//! the track. Files without an index are searched by the sub-block headers.
+//!
+//! @param name   file name
+//! @param id     TrackDataId, RawTrackDataId or CompressedRawTrackDataId
+//! @param side
+//! @param track
+//! @param buf    [out] the sub-block, including its header
+//!
+//! @return if found
+//!
+bool
+H17Disk::readTrackBlock(const char           *name,
+                        uint8_t               id,
+                        uint8_t               side,
+                        uint8_t               track,
+                        std::vector<uint8_t> &buf)
+{
+    std::ifstream file(name, ios::in | ios::binary);
+    unsigned char header[H17CompressedRawDataBlock::trackHeaderSize_c];
+
+    if (!file.read((char *) header, 8) ||
+        (header[0] != 'H') || (header[1] != '1') || (header[2] != '7') || (header[3] != 'D'))
+    {
+        printf("%s - not a h17disk file: %s\n", __FUNCTION__, name);
+        return false;
+    }
+
+    uint8_t      blockId    = DataBlock_c;
+    unsigned int headerSize = 5;
+
+    if (id == RawTrackDataId)
+    {
+        blockId    = RawDataBlock_c;
+        headerSize = 7;
+    }
+    else if (id == CompressedRawTrackDataId)
+    {
+        blockId    = CompressedRawDataBlock_c;
+        headerSize = H17CompressedRawDataBlock::trackHeaderSize_c;
+    }
+    uint32_t     pos        = ((header[4] == '2') && (header[7] == 0xff)) ? 8 : 7;
+    uint32_t     blockPos   = 0;
+    uint32_t     blockEnd   = 0;
+    uint32_t     offset     = 0;
+    uint32_t     length     = 0;
+    bool         found      = false;
+
+    // walk the block headers
+    while (!found && file.seekg(pos) && file.read((char *) header, 6))
+    {
+        uint32_t size = ((uint32_t) header[2] << 24) | (header[3] << 16) |
+                        (header[4] << 8) | header[5];
+
+        if (header[0] == IndexBlock_c)
+        {
+            std::vector<uint8_t> data(size);
+
+            if (file.read((char *) data.data(), size))
+            {
+                H17IndexBlock index(data.data(), size);
+
+                found = index.findEntry(id, side, track, offset, length);
+            }
+        }
+        else if (header[0] == blockId)
+        {
+            blockPos = pos + 6;
+            blockEnd = blockPos + size;
+        }
+        pos += 6 + size;
+    }
+
+    // no index, walk the sub-block headers
+    file.clear();
+
+    for (pos = blockPos; !found && (pos < blockEnd); pos += length)
+    {
+        if (!file.seekg(pos) || !file.read((char *) header, headerSize) || (header[0] != id))
+        {
+            break;
+        }
+
+        if (id == RawTrackDataId)
+        {
+            length = ((uint32_t) header[3] << 24) | (header[4] << 16) | (header[5] << 8) | header[6];
+        }
+        else if (id == CompressedRawTrackDataId)
+        {
+            length = ((uint32_t) header[8] << 24) | (header[9] << 16) | (header[10] << 8) | header[11];
+        }
+        else
+        {
+            length = (header[3] << 8) | header[4];
+        }
+        length += headerSize;
+
+        if ((header[1] == side) && (header[2] == track))
+        {
+            offset = pos;
+            found  = true;
+        }
+    }
+
+    file.clear();
+    buf.resize(length);
+
+    if (!found || !file.seekg(offset) || !file.read((char *) buf.data(), length) ||
+        (length < headerSize) || (buf[0] != id) || (buf[1] != side) || (buf[2] != track))
+    {
+        buf.clear();
+
+        return false;
+    }
+
+    return true;
+}
+
+
 //! reprocess file
 //!
 //!  For all sectors with an error
@@ -267,14 +610,39 @@ H17Disk::saveFile(const char *name)
 
     writeHeader();
 
+    // with writeIndex(), the index is rebuilt, the blocks may not be at the same
+    // positions as when loaded. Otherwise a loaded index is dropped.
+    H17IndexBlock index;
+
     for (int i = 0; i < 256; i++)
     {
-        if (blocks_m[i])
+        if ((blocks_m[i]) && (i != IndexBlock_c))
         {
+            uint32_t dataPos = (uint32_t) file_m.tellp() + blocks_m[i]->getHeaderSize();
+
+            if (writeIndex_m && (i == DataBlock_c))
+            {
+                ((H17DataBlock *) blocks_m[i])->addToIndex(index, dataPos);
+            }
+            else if (writeIndex_m && (i == RawDataBlock_c))
+            {
+                ((H17RawDataBlock *) blocks_m[i])->addToIndex(index, dataPos);
+            }
+            else if (writeIndex_m && (i == CompressedRawDataBlock_c))
+            {
+                ((H17CompressedRawDataBlock *) blocks_m[i])->addToIndex(index, dataPos);
+            }
+
             printf("Writing block: %d\n", i);
             blocks_m[i]->writeToFile(file_m);
         }
     }
+
+    if (index.getEntryCount())
+    {
+        printf("Writing block: %d\n", IndexBlock_c);
+        index.writeToFile(file_m);
+    }
     file_m.close();
 
     return true;
@@ -337,6 +705,103 @@ H17Disk::saveAsRaw(const char *name)
 }
 
 
+//! replace the raw data block with a compressed raw data block
+//!
+//! @return success
+//!
+bool
+H17Disk::compressRawData()
+{
+    H17RawDataBlock *rawData = (H17RawDataBlock *) blocks_m[RawDataBlock_c];
+
+    if (!rawData)
+    {
+        return blocks_m[CompressedRawDataBlock_c] != nullptr;
+    }
+
+    if (blocks_m[CompressedRawDataBlock_c])
+    {
+        printf("%s - already have a compressed raw data block\n", __FUNCTION__);
+        return false;
+    }
+
+    blocks_m[CompressedRawDataBlock_c] = new H17CompressedRawDataBlock(*rawData);
+    blocks_m[RawDataBlock_c]           = nullptr;
+
+    printf("Raw data compressed from %u to %u bytes\n", rawData->getDataSize(),
+           blocks_m[CompressedRawDataBlock_c]->getDataSize());
+
+    delete rawData;
+
+    return true;
+}
+
+
+//! rewrite the raw data block with retries stored as deltas, or all in full
+//!
+//! @param delta  use deltas
+//!
+//! @return success
+//!
+bool
+H17Disk::deltaRawData(bool delta)
+{
+    H17RawDataBlock *rawData = (H17RawDataBlock *) blocks_m[RawDataBlock_c];
+
+    if (!rawData)
+    {
+        return false;
+    }
+
+    blocks_m[RawDataBlock_c] = rawData->createDeltaBlock(delta);
+
+    printf("Raw data changed from %u to %u bytes\n", rawData->getDataSize(),
+           blocks_m[RawDataBlock_c]->getDataSize());
+
+    delete rawData;
+
+    return true;
+}
+
+
+//! replace the compressed raw data block with a raw data block
+//!
+//! @return success
+//!
+bool
+H17Disk::decompressRawData()
+{
+    H17CompressedRawDataBlock *compressed =
+        (H17CompressedRawDataBlock *) blocks_m[CompressedRawDataBlock_c];
+
+    if (!compressed)
+    {
+        return blocks_m[RawDataBlock_c] != nullptr;
+    }
+
+    if (blocks_m[RawDataBlock_c])
+    {
+        printf("%s - already have a raw data block\n", __FUNCTION__);
+        return false;
+    }
+
+    H17RawDataBlock *rawData = compressed->createRawDataBlock();
+
+    if (!rawData)
+    {
+        printf("%s - unable to decompress the raw data\n", __FUNCTION__);
+        return false;
+    }
+
+    blocks_m[RawDataBlock_c]           = rawData;
+    blocks_m[CompressedRawDataBlock_c] = nullptr;
+
+    delete compressed;
+
+    return true;
+}
+
+
 //! analyze the disk image
 //!
 //! @return success
@@ -346,7 +811,8 @@ H17Disk::analyze()
 {
     std::vector<uint8_t> optionalBlocks =  { DiskFormatBlock_c, FlagsBlock_c, LabelBlock_c,
                                              CommentBlock_c, DateBlock_c, ImagerBlock_c,
-                                             ProgramBlock_c, RawDataBlock_c };
+                                             ProgramBlock_c, RawDataBlock_c,
+                                             CompressedRawDataBlock_c };
 
     if (blocks_m[DataBlock_c])
     {
@@ -416,7 +882,7 @@ H17Disk::dumpFileInfo(const char *name,
     // unsigned char *inputBuffer;
     bool           status = false;
 
-    if (!loadFile(name))
+    if (!mapFile(name))
     {
         return status;
     }
@@ -703,6 +1169,12 @@ H17Disk::validateBlock(unsigned char buf[],
         case RawDataBlock_c:
             validateRawDataBlock(&buf[6], blockSize);
             break;
+        case CompressedRawDataBlock_c:
+            validateCompressedRawDataBlock(&buf[6], blockSize);
+            break;
+        case IndexBlock_c:
+            validateIndexBlock(&buf[6], blockSize);
+            break;
         default:
             printf("Unknown Block Id: 0x%02x\n", buf[0]);
             //! \todo check to see if mandatory , and skip the data.
@@ -770,6 +1242,12 @@ H17Disk::dumpBlock(unsigned char buf[],
         case RawDataBlock_c:
             validateRawDataBlock(&buf[6], blockSize);
             break;
+        case CompressedRawDataBlock_c:
+            validateCompressedRawDataBlock(&buf[6], blockSize);
+            break;
+        case IndexBlock_c:
+            validateIndexBlock(&buf[6], blockSize);
+            break;
         default:
             printf("Unknown Block Id: 0x%02x\n", buf[0]);
             //! \todo check to see if mandatory , and skip the data.
@@ -793,7 +1271,7 @@ H17Disk::loadBlock(unsigned char buf[],
                    unsigned int &length)
 {
 
-    H17Block *block = H17Block::create(buf, size);
+    H17Block *block = H17Block::create(buf, size, copyBlocks_m);
 
     if (block)
     {
@@ -811,6 +1289,21 @@ H17Disk::loadBlock(unsigned char buf[],
             length = block->getBlockSize();
         }
     }
+    else if ((size >= 6) && !(buf[1] & MandatoryFlagMask))
+    {
+        // a block added after this reader was written, it's safe to skip
+        length = 6 + (((unsigned int) buf[2] << 24) |
+                      ((unsigned int) buf[3] << 16) |
+                      ((unsigned int) buf[4] <<  8) |
+                      ((unsigned int) buf[5]      ));
+
+        if (size < length)
+        {
+            printf("Invalid File format: short block\n");
+            return false;
+        }
+        printf("Skipping non-mandatory block: 0x%02x\n", buf[0]);
+    }
     else
     {
         printf("Invalid File format: unable to create block\n");
@@ -1400,6 +1893,18 @@ H17Disk::validateRawTrackBlock(unsigned char  buf[],
         {
             validateRawSectorBlock(&buf[pos], size - pos, len);
         }
+        else if (buf[pos - 1] == RawSectorDeltaId)
+        {
+            if (size - pos < 3)
+            {
+                printf("Insufficient space for sector delta sub-block\n");
+                return false;
+            }
+            len = ((buf[pos + 1] << 8) | buf[pos + 2]) + 3;
+            printf("   Raw Sector Delta Sub-Block:\n");
+            printf("     Sector:   %d\n", buf[pos]);
+            printf("     Length: %d\n", len - 3);
+        }
         else
         {
             printf("Unknown subblock in Raw Track Block: %d\n", buf[pos-1]);
@@ -1468,7 +1973,8 @@ H17Disk::validateRawSectorBlock(unsigned char  buf[],
     //unsigned char decode[length]; // should be length/2 but don't care about memory right now.
     //unsigned char *buff = new unsigned char[blockLength];
     unsigned char buff[blockLength];
-    Decode::decodeFM(buff, &buf[3], blockLength >> 1);
+    DecodeContext decodeContext;
+    Decode::decodeFM(buff, &buf[3], blockLength >> 1, decodeContext);
 
     printf("  Data: \n");
     dumpDataBlock(buff, blockLength >> 1);
@@ -1490,6 +1996,68 @@ H17Disk::validateRawSectorBlock(unsigned char  buf[],
 }
 
 
+//! validate CompressedRawDataBlock
+//!
+//! @param      buf     data buffer
+//! @param      size    size of buffer
+//!
+//! @return  if validation was successful
+//!
+bool
+H17Disk::validateCompressedRawDataBlock(unsigned char buf[],
+                                        unsigned int  size)
+{
+    printf("Compressed Raw Data Block:\n");
+
+    H17CompressedRawDataBlock block(buf, size, false);
+    std::vector<uint8_t>      data;
+    unsigned int              bad = 0;
+
+    for (unsigned int i = 0; i < block.getRawTrackCount(); i++)
+    {
+        if (!block.getRawTrackData(i, data))
+        {
+            bad++;
+        }
+    }
+
+    printf("Total tracks in Compressed Raw Data Block: %d\n", block.getRawTrackCount());
+
+    if (bad)
+    {
+        printf("Tracks that can't be decompressed: %d\n", bad);
+        return false;
+    }
+
+    return true;
+}
+
+
+//! validate IndexBlock
+//!
+//! @param      buf     data buffer
+//! @param      size    size of buffer
+//!
+//! @return  if validation was successful
+//!
+bool
+H17Disk::validateIndexBlock(unsigned char buf[],
+                            unsigned int  size)
+{
+    printf("Index Block:\n");
+
+    if (size % H17IndexBlock::entrySize_c)
+    {
+        printf("Unexpected Index Block size: %d\n", size);
+        return false;
+    }
+
+    printf("Total entries in Index Block: %d\n", size / H17IndexBlock::entrySize_c);
+
+    return true;
+}
+
+
 //! write File Header
 //!
 //! @return success
@@ -1507,12 +2075,12 @@ H17Disk::writeHeader()
          versionPoint_m
     };
 
-    if (!file_m.is_open())
+    if (!isOpenForWrite())
     {
         return false;
     }
 
-    file_m.write((const char*) buf, 7);
+    out_m->write((const char*) buf, 7);
 
     return true;
 }
@@ -1555,7 +2123,7 @@ H17Disk::writeDiskFormatBlock()
 {
     writeBlockHeader(DiskFormatBlock_c, 0x80, 2);
     unsigned char buf[2] = { sides_m, tracks_m };
-    file_m.write((const char*) buf, 2);
+    out_m->write((const char*) buf, 2);
 
     return true;
 }
@@ -1609,7 +2177,7 @@ H17Disk::setTrackDataParameter(unsigned char val)
 bool
 H17Disk::writeParameters()
 {
-    if (!file_m.is_open())
+    if (!isOpenForWrite())
     {
         return false;
     }
@@ -1619,7 +2187,7 @@ H17Disk::writeParameters()
 
     unsigned char buf[3] = { writeProtect_m, distribution_m, trackDataSource_m };
 
-    file_m.write((const char*) buf, 3);
+    out_m->write((const char*) buf, 3);
 
     return true;
 }
@@ -1632,6 +2200,41 @@ H17Disk::writeParameters()
 bool
 H17Disk::closeFile(void)
 {
+    if (isOpenForWrite())
+    {
+        writeIndexBlock();
+    }
+
+    if (asyncWriter_m)
+    {
+        out_m->flush();
+
+        bool status = asyncWriter_m->close();
+
+        if (!status)
+        {
+            printf("%s - write failed\n", __FUNCTION__);
+        }
+
+        delete asyncOut_m;
+        delete asyncWriter_m;
+        asyncOut_m    = nullptr;
+        asyncWriter_m = nullptr;
+        out_m         = &file_m;
+
+        return status;
+    }
+
+    if (streaming_m)
+    {
+        out_m->flush();
+
+        out_m       = &file_m;
+        streaming_m = false;
+
+        return true;
+    }
+
     if (!file_m.is_open())
     {
         return false;
@@ -1665,12 +2268,47 @@ H17Disk::writeBlockHeader(uint8_t  blockId,
     buf[4] = (length >>  8) & 0xff;
     buf[5] = length & 0xff;
 
-    file_m.write((const char*) buf, 6);
+    out_m->write((const char*) buf, 6);
 
     return true;
 }
 
 
+//! write the index of the tracks written, if writeIndex() was called and their
+//! positions are known
+//!
+//! @return success
+//!
+bool
+H17Disk::writeIndexBlock()
+{
+    H17IndexBlock index;
+
+    if (dataBlockPos_m != (streampos) -1)
+    {
+        index.append(*trackIndex_m, dataBlockPos_m);
+    }
+    if (rawDataBlockPos_m != (streampos) -1)
+    {
+        index.append(*rawTrackIndex_m, rawDataBlockPos_m);
+    }
+
+    trackIndex_m->clear();
+    rawTrackIndex_m->clear();
+    dataBlockPos_m    = -1;
+    rawDataBlockPos_m = -1;
+
+    if (!writeIndex_m || !index.getEntryCount())
+    {
+        return true;
+    }
+
+    writeBlockHeader(IndexBlock_c, 0x00, index.getDataSize());
+
+    return index.writeEntries(*out_m);
+}
+
+
 //! write label block
 //!
 //! @param buf
@@ -1684,7 +2322,7 @@ H17Disk::writeLabel(unsigned char *buf,
 {
     writeBlockHeader(LabelBlock_c, 0x00, length);
 
-    file_m.write((const char*) buf, length);
+    out_m->write((const char*) buf, length);
 
     return true;
 }
@@ -1703,7 +2341,7 @@ H17Disk::writeComment(unsigned char *buf,
 {
     writeBlockHeader(CommentBlock_c, 0x00, length);
 
-    file_m.write((const char*) buf, length);
+    out_m->write((const char*) buf, length);
 
     return true;
 }
@@ -1722,7 +2360,7 @@ H17Disk::writeDate(unsigned char *buf,
 {
     writeBlockHeader(DateBlock_c, 0x00, length);
 
-    file_m.write((const char*) buf, length);
+    out_m->write((const char*) buf, length);
 
     return true;
 }
@@ -1741,7 +2379,7 @@ H17Disk::writeImager(unsigned char *buf,
 {
     writeBlockHeader(ImagerBlock_c, 0x00, length);
 
-    file_m.write((const char*) buf, length);
+    out_m->write((const char*) buf, length);
 
     return true;
 }
@@ -1760,7 +2398,7 @@ H17Disk::writeProgram(unsigned char *buf,
 {
     writeBlockHeader(ProgramBlock_c, 0x00, length);
 
-    file_m.write((const char*) buf, length);
+    out_m->write((const char*) buf, length);
 
     return true;
 }
@@ -1768,15 +2406,29 @@ H17Disk::writeProgram(unsigned char *buf,
 
 //! start data block
 //!
+//! When streaming, the tracks are held in memory until endDataBlock(), otherwise the
+//! block header is written now and its length is updated by endDataBlock().
+//!
 //! @return success
 //!
 bool
 H17Disk::startData()
 {
-    dataSize_m = 0;
+    trackIndex_m->clear();
+    trackPos_m     = 0;
+    dataBlockPos_m = -1;
+
+    if (streaming_m)
+    {
+        dataBlock_m.str("");
+    }
+    else
+    {
+        writeBlockHeader(DataBlock_c, 0x80, 0);
+        dataBlockSizePos_m = out_m->tellp() - (streampos) 4;
+        dataBlockPos_m     = out_m->tellp();
+    }
 
-    writeBlockHeader(DataBlock_c, 0x80, 0);
-    dataBlockSizePos_m = file_m.tellp() - (streampos) 4;
     for (int i = 0; i < maxSectors_c; i++)
     {
         curTrackSectors_m[i] = nullptr;
@@ -1810,11 +2462,7 @@ H17Disk::startTrack(unsigned char side,
         }
     }
 
-    // Handle the process block
-    unsigned char buf[5] = { TrackDataId, side, track, 0, 0};
-
-    file_m.write((const char*) buf, 5);
-    trackSizePos_m = file_m.tellp() - (streampos) 2;
+    // the track header is written by endTrack(), once the size is known
     curSide_m = side;
     curTrack_m = track;
 
@@ -1825,8 +2473,20 @@ H17Disk::startTrack(unsigned char side,
         return true;
     }
 
+    RawTrack *rawTrack = new RawTrack(side, track);
+
+    rawTrack->setDeltaEncoding(deltaRaw_m);
+
+    if (spillRaw_m)
+    {
+        spillRawTrack();
+        curRawTrack_m = rawTrack;
+
+        return true;
+    }
+
     // add a new 'rawTrack' to the disk
-    rawTracks_m.push_back(new RawTrack(side, track));
+    rawTracks_m.push_back(rawTrack);
 
     return true;
 }
@@ -1862,7 +2522,7 @@ H17Disk::addSector(unsigned char  sector,
 }
 
 
-//! end track and update size of track
+//! end track and write it out with its size
 //!
 //! @return success
 //!
@@ -1887,24 +2547,45 @@ H17Disk::endTrack()
         }
     }
 
+    uint16_t length = 0;
+
+    for (int i = 0; i < maxSectors_c; i++)
+    {
+        length += curTrackSectors_m[i]->getBlockSize();
+    }
+
+    std::ostream &out = streaming_m ? dataBlock_m : *out_m;
+
+    unsigned char buf[5] = { TrackDataId,
+                             curSide_m,
+                             curTrack_m,
+                             (unsigned char) ((length >> 8) & 0xff),
+                             (unsigned char) (length & 0xff) };
+
+    out.write((const char*) buf, 5);
+
+    trackIndex_m->addEntry(TrackDataId, curSide_m, curTrack_m, trackPos_m, 5 + length);
+    trackPos_m += 5 + length;
+
     // write sectors in order
     for (int i = 0; i < maxSectors_c; i++)
     {
-        curTrackSectors_m[i]->writeToFile(file_m);
+        curTrackSectors_m[i]->writeToFile(out);
         // free space
         delete curTrackSectors_m[i];
         curTrackSectors_m[i] = nullptr;
     }
 
-    // update track size field in block.
-    streampos curPos = file_m.tellp();
-    uint16_t length = (uint16_t) (curPos - trackSizePos_m - 2);
+    if (spillRaw_m)
+    {
+        spillRawTrack();
+    }
 
-    unsigned char buf[2] = { (unsigned char) ((length >> 8) & 0xff),
-                             (unsigned char) (length & 0xff) };
-    file_m.seekp(trackSizePos_m, ios::beg);
-    file_m.write((const char*)buf, 2);
-    file_m.seekp(curPos, ios::beg);
+    // hand the finished track to the I/O thread
+    if (asyncWriter_m)
+    {
+        out_m->flush();
+    }
 
     return true;
 }
@@ -1917,8 +2598,27 @@ H17Disk::endTrack()
 bool
 H17Disk::endDataBlock()
 {
+    if (streaming_m)
+    {
+        std::string data = dataBlock_m.str();
+
+        // -1 if the output can't tell its position, the tracks are then left out of the index
+        dataBlockPos_m = out_m->tellp();
+        if (dataBlockPos_m != (streampos) -1)
+        {
+            dataBlockPos_m += 6;
+        }
+
+        writeBlockHeader(DataBlock_c, 0x80, data.size());
+        out_m->write(data.data(), data.size());
+
+        dataBlock_m.str("");
+
+        return true;
+    }
+
     // go back and write the size of the data block to the header
-    streampos curPos = file_m.tellp();
+    streampos curPos = out_m->tellp();
     uint32_t length = (uint32_t) (curPos - dataBlockSizePos_m - 4);
 
     unsigned char buf[4] = { (unsigned char) ((length >> 24) & 0xff),
@@ -1926,11 +2626,11 @@ H17Disk::endDataBlock()
                              (unsigned char) ((length >>  8) & 0xff),
                              (unsigned char)  (length        & 0xff) };
 
-    file_m.seekp(dataBlockSizePos_m, ios::beg);
-    file_m.write((const char*)buf, 4);
+    out_m->seekp(dataBlockSizePos_m, ios::beg);
+    out_m->write((const char*)buf, 4);
 
     // go to next byte position after data block.
-    file_m.seekp(curPos, ios::beg);
+    out_m->seekp(curPos, ios::beg);
 
     return true;
 }
@@ -1947,39 +2647,159 @@ H17Disk::writeRawDataBlock()
     {
         return true;
     }
-    // header with a zero size
-    unsigned char buf[6] = { RawDataBlock_c, 0x00, 0x00, 0x00, 0x00, 0x00 };
+    // include a track that was not ended, and wait for the spilled tracks to be written
+    if (spillRaw_m)
+    {
+        spillRawTrack();
+    }
+    if (!closeRawSpill())
+    {
+        printf("%s - unable to spill raw tracks, raw data block not written\n", __FUNCTION__);
 
-    file_m.write((const char *) buf, 6);
+        if (rawSpill_m)
+        {
+            fclose(rawSpill_m);
+            rawSpill_m     = nullptr;
+            rawSpillSize_m = 0;
+        }
 
-    // determine spot to write the size, once it's determined.
-    streampos rawSizePos = file_m.tellp() - (streampos) 4;
+        return false;
+    }
+
+    // the raw tracks are all in memory or spilled, so the size is known up front
+    uint32_t length = rawSpillSize_m;
+
+    for (unsigned int i = 0 ; i < rawTracks_m.size(); i++)
+    {
+        length += rawTracks_m[i]->getBlockSize();
+    }
+
+    rawDataBlockPos_m = out_m->tellp();
+    if (rawDataBlockPos_m != (streampos) -1)
+    {
+        rawDataBlockPos_m += 6;
+    }
+
+    writeBlockHeader(RawDataBlock_c, 0x00, length);
+
+    // the spilled tracks are already in the index, the ones in memory follow them
+    uint32_t trackPos = rawSpillSize_m;
+
+    for (unsigned int i = 0 ; i < rawTracks_m.size(); i++)
+    {
+        rawTrackIndex_m->addEntry(RawTrackDataId, rawTracks_m[i]->getSideNumber(),
+                                  rawTracks_m[i]->getTrackNumber(), trackPos,
+                                  rawTracks_m[i]->getBlockSize());
+        trackPos += rawTracks_m[i]->getBlockSize();
+    }
+
+    if (rawSpill_m)
+    {
+        std::vector<char> buf(64 * 1024);
+        size_t            count;
+
+        rewind(rawSpill_m);
+        while ((count = fread(buf.data(), 1, buf.size(), rawSpill_m)) > 0)
+        {
+            out_m->write(buf.data(), count);
+        }
+
+        fclose(rawSpill_m);
+        rawSpill_m     = nullptr;
+        rawSpillSize_m = 0;
+    }
 
     // write all tracks, they will recursively write the sectors.
     for (unsigned int i = 0 ; i < rawTracks_m.size(); i++)
     {
-        rawTracks_m[i]->writeToFile(file_m);
+        rawTracks_m[i]->writeToFile(*out_m);
+    }
+
+    return true;
+}
+
+
+//! hand the current raw track to the spill file's I/O thread and free it
+//!
+//! If the spill file can't be opened, the track is kept in memory instead. Errors
+//! writing it are reported by closeRawSpill().
+//!
+//! @return success
+//!
+bool
+H17Disk::spillRawTrack()
+{
+    if (!curRawTrack_m)
+    {
+        return true;
+    }
+
+    if (!rawSpillWriter_m)
+    {
+        if (!rawSpill_m)
+        {
+            rawSpill_m = tmpfile();
+        }
+
+        rawSpillWriter_m = new AsyncWriter();
+
+        if ((!rawSpill_m) || (!rawSpillWriter_m->open(fileno(rawSpill_m))))
+        {
+            printf("%s - unable to spill raw track, keeping it in memory\n", __FUNCTION__);
+            delete rawSpillWriter_m;
+            rawSpillWriter_m = nullptr;
+
+            rawTracks_m.push_back(curRawTrack_m);
+            curRawTrack_m = nullptr;
+
+            return false;
+        }
+
+        rawSpillOut_m = new std::ostream(rawSpillWriter_m);
     }
 
-    // determine current position, to calculate size of block
-    streampos curPos = file_m.tellp();
-    uint32_t length = (uint32_t) (curPos - rawSizePos - 4);
-    unsigned char buf2[4] = { (unsigned char) ((length >> 24) & 0xff),
-                              (unsigned char) ((length >> 16) & 0xff),
-                              (unsigned char) ((length >>  8) & 0xff),
-                              (unsigned char)  (length        & 0xff) };
+    uint32_t size = curRawTrack_m->getBlockSize();
+
+    curRawTrack_m->writeToFile(*rawSpillOut_m);
+    rawSpillOut_m->flush();
 
-    // position to the size field
-    file_m.seekp(rawSizePos, ios::beg);
-    file_m.write((const char*) buf2, 4);
+    rawTrackIndex_m->addEntry(RawTrackDataId, curRawTrack_m->getSideNumber(),
+                              curRawTrack_m->getTrackNumber(), rawSpillSize_m, size);
+    rawSpillSize_m += size;
 
-    // position to next byte after this block.
-    file_m.seekp(curPos, ios::beg);
+    delete curRawTrack_m;
+    curRawTrack_m = nullptr;
 
     return true;
 }
 
 
+//! wait for the I/O thread to write the spilled raw tracks, the spill file stays open
+//! to be read back
+//!
+//! @return false if they could not all be written
+//!
+bool
+H17Disk::closeRawSpill()
+{
+    if (!rawSpillWriter_m)
+    {
+        return true;
+    }
+
+    rawSpillOut_m->flush();
+
+    bool status = rawSpillWriter_m->close();
+
+    delete rawSpillOut_m;
+    delete rawSpillWriter_m;
+    rawSpillOut_m    = nullptr;
+    rawSpillWriter_m = nullptr;
+
+    return status;
+}
+
+
 //! add raw data sector
 //!
 //! @param sector
@@ -2000,6 +2820,14 @@ H17Disk::addRawSector(uint8_t    sector,
 
     // allocate a new raw sector, and store it to the current track.
     RawSector *tmp = new RawSector(curSide_m, curTrack_m, sector, buf, length);
+
+    if (spillRaw_m)
+    {
+        curRawTrack_m->addRawSector(tmp);
+
+        return true;
+    }
+
     uint8_t trackPos = curTrack_m;
 
     if (sides_m == 2)
@@ -8,10 +8,13 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <vector>
 #include <cstdint>
 
+class AsyncWriter;
 class H17Block;
+class H17IndexBlock;
 class RawTrack;
 class Sector;
 
@@ -34,6 +37,10 @@ public:
     static const uint8_t DataBlock_c;
     static const uint8_t RawDataBlock_c;
 
+    static const uint8_t CompressedRawDataBlock_c;
+
+    static const uint8_t IndexBlock_c;
+
     // SubBlock IDs
     //
     static const uint8_t TrackDataId;
@@ -41,6 +48,9 @@ public:
 
     static const uint8_t RawTrackDataId;
     static const uint8_t RawSectorDataId;
+    static const uint8_t RawSectorDeltaId;
+
+    static const uint8_t CompressedRawTrackDataId;
 
     // flags
     static const uint8_t DistUnknown;
@@ -63,14 +73,26 @@ public:
     // Open a file
     virtual bool openForWrite(const char *name);
     virtual bool openForRead(const char *name);
+    virtual bool openForStream(std::ostream &out);
+    virtual bool openForAsyncWrite(const char *name);
     //virtual bool openForRecovery(const char *name);
     virtual bool fileExists(const char *name);
 
     virtual bool loadFile(const char *name);
+    virtual bool mapFile(const char *name);
+    virtual bool readTrackBlock(const char           *name,
+                                uint8_t               id,
+                                uint8_t               side,
+                                uint8_t               track,
+                                std::vector<uint8_t> &buf);
     virtual bool saveFile(const char  *name);
     virtual bool saveAsH8D(const char *name);
     virtual bool saveAsRaw(const char *name);
 
+    virtual bool compressRawData();
+    virtual bool decompressRawData();
+    virtual bool deltaRawData(bool delta);
+
     virtual bool loadBuffer(unsigned char buf[], unsigned int size);
     virtual bool loadHeader(unsigned char buf[], unsigned int size, unsigned int &length);
     virtual bool loadBlock(unsigned char buf[], unsigned int size, unsigned int &length);
@@ -102,6 +124,8 @@ public:
     virtual bool validateRawDataBlock(unsigned char buf[], unsigned int size);
     virtual bool validateRawTrackBlock(unsigned char buf[], unsigned int size, unsigned int &length);
     virtual bool validateRawSectorBlock(unsigned char buf[], unsigned int size, unsigned int &length);
+    virtual bool validateCompressedRawDataBlock(unsigned char buf[], unsigned int size);
+    virtual bool validateIndexBlock(unsigned char buf[], unsigned int size);
 
     virtual void dumpSectorHeader(unsigned char buf[]);
     virtual void dumpSectorData(unsigned char buf[]);
@@ -109,6 +133,9 @@ public:
     virtual bool closeFile(void);
 
     virtual void disableRaw();
+    virtual void spillRaw();
+    virtual void deltaRaw();
+    virtual void writeIndex();
 
     // write Header
     virtual bool writeHeader();
@@ -188,6 +215,8 @@ private:
     unsigned char trackDataSource_m;
     bool          writeProtect_m;
     bool          disableRaw_m;
+    bool          deltaRaw_m;
+    bool          writeIndex_m;
 
     uint8_t       versionMajor_m;
     uint8_t       versionMinor_m;
@@ -195,17 +224,33 @@ private:
 
     H17Block     *blocks_m[256];
 
+    // mapped file from mapFile(), the blocks are views into it
+    uint8_t      *map_m;
+    size_t        mapSize_m;
+    bool          copyBlocks_m;
+
     std::ifstream inFile_m; 
     std::ofstream file_m; 
 
-    unsigned int  dataSize_m;
+    // where the writer output goes, file_m unless streaming or writing asynchronously
+    std::ostream       *out_m;
+    bool                streaming_m;
+
+    // background writer from openForAsyncWrite(), and the stream on it
+    AsyncWriter        *asyncWriter_m;
+    std::ostream       *asyncOut_m;
 
-    std::streampos  dataBlockSizePos_m, trackSizePos_m;
+    // data block contents while streaming, written out by endDataBlock()
+    std::ostringstream  dataBlock_m;
+
+    std::streampos  dataBlockSizePos_m;
 
     bool          summarize_m;
 //    virtual bool writeHeader();
 
     bool writeBlockHeader(uint8_t blockId, uint8_t flag, uint32_t length);
+    bool writeIndexBlock();
+    bool isOpenForWrite();
 
 //    static const unsigned char maxTracks_c  = 160; // 2 sided, 80 tracks
     static const unsigned char maxSectors_c = 10;
@@ -215,6 +260,26 @@ private:
 
     unsigned int sectorErrs_m;
 
+    // with spillRaw(), only the current raw track is kept in memory, the completed
+    // ones are appended to a temporary file by a background writer
+    bool          spillRaw_m;
+    RawTrack     *curRawTrack_m;
+    FILE         *rawSpill_m;
+    AsyncWriter  *rawSpillWriter_m;
+    std::ostream *rawSpillOut_m;
+    uint32_t      rawSpillSize_m;
+
+    bool spillRawTrack();
+    bool closeRawSpill();
+
+    // tracks written, for the index block written by closeFile(). The offsets are
+    // relative to the data of their block, whose file position is -1 until known.
+    H17IndexBlock  *trackIndex_m;
+    H17IndexBlock  *rawTrackIndex_m;
+    uint32_t        trackPos_m;
+    std::streampos  dataBlockPos_m;
+    std::streampos  rawDataBlockPos_m;
+
     //std::vector<Track *> tracksData_m;
 
     virtual bool setDefaults();
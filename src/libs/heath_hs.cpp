@@ -4,13 +4,13 @@
 //!
 
 #include "heath_hs.h"
-#include "decode.h"
 #include "disk_util.h"
 #include "fc5025.h"
 
 #include <stdio.h>
 #include <arpa/inet.h>
 #include <string.h>
+#include <vector>
 
 
 //! constructor
@@ -23,7 +23,8 @@
 HeathHSDisk::HeathHSDisk(uint8_t  sides,
                          uint8_t  tracks,
                          uint8_t  driveTpi,
-                         uint16_t driveRpm): maxSide_m(sides),
+                         uint16_t driveRpm): controller_m(nullptr),
+                                             maxSide_m(sides),
                                              maxTrack_m(tracks),
                                              driveRpm_m(driveRpm),
                                              driveTpi_m(driveTpi)
@@ -290,6 +291,17 @@ HeathHSDisk::setTracks(uint8_t tracks)
 }
 
 
+//! set the controller to read the disk through
+//!
+//! @param controller
+//!
+void
+HeathHSDisk::setController(FC5025 *controller)
+{
+    controller_m = controller;
+}
+
+
 //! return the number of bytes per sector
 //!
 //! @param side
@@ -326,6 +338,8 @@ HeathHSDisk::sectorRawBytes(uint8_t side,
 
 //! read a given sector of a disk through the FC5025 device
 //!
+//! Nothing is printed, this runs on the capture threads and the caller reports the status.
+//!
 //! @param buffer     buffer to write the processed sector
 //! @param rawBuffer  buffer to write the raw sector
 //! @param side       disk side to read
@@ -342,54 +356,145 @@ HeathHSDisk::readSector(uint8_t *buffer,
                         uint8_t  sector)
 {
     unsigned char   raw[sectorRawBytes_c];  // as read in from the fc5025
-    unsigned char   data[sectorBytes_c];    // after removing clock-bits
     unsigned char   out[sectorBytes_c];     // after processing sector for alignment
 
     int   status = No_Error;
 
     //printf("bit timing: %d\n", bitcellTiming_m);
 
-    status = FC5025::inst()->readHardSectorSector(raw, sectorRawBytes_c, side, track, sector, bitcellTiming_m);
-    if (status) {
-       printf("%s - readSector failed: %d\n", __FUNCTION__, status);
+    if (!controller_m)
+    {
+        return Err_ReadError;
     }
 
-    // printf("%s - xfer success\n", __FUNCTION__);
+    status = controller_m->readHardSectorSector(raw, sectorRawBytes_c, side, track, sector, bitcellTiming_m);
+    if (status)
+    {
+        return Err_ReadError;
+    }
 
     if (rawBuffer)
     {
         memcpy(rawBuffer, raw, sectorRawBytes_c);
     }
 
+    // decode, align and check in one pass, straight into the caller's buffer
+    status = processRawSector(raw, buffer ? buffer : out, sectorBytes_c, side,
+                              expectedTrackNum(side, track), sector, true);
 
-    if (Decode::decodeFM(data, raw, sectorBytes_c) != 0)
-    {
-        status = Err_InvalidClocksBits;
-        return status;
-    }
+    return status;
+}
 
-    uint8_t expectedTrackNum;
 
-    if (maxSide_m == 2) {
-        expectedTrackNum = (track << 1) + side;
+//! read a whole track through the FC5025 device with a single command
+//!
+//! The read starts at the hole of the first sector and continues for a little over a
+//! revolution, the sectors are then split out of it. Each sector is looked for near
+//! where its hole should be, starting after the previous sector that was found, so
+//! changes in the speed don't add up over the track. The offsets are probed quietly, and
+//! the status of the offset that is kept is left for the caller to report.
+//!
+//! @param buffer     buffer for the processed sectors, in sector order
+//! @param rawBuffer  buffer for the raw sectors, in sector order
+//! @param status     [out] status of each sector
+//! @param side       disk side to read
+//! @param track      track to read
+//!
+//! @return status of the read, the sectors can still have errors
+//!
+int
+HeathHSDisk::readTrack(uint8_t *buffer,
+                       uint8_t *rawBuffer,
+                       int     *status,
+                       uint8_t  side,
+                       uint8_t  track)
+{
+    uint8_t        numSectors = maxSector(track, side) + 1;
+    uint16_t       length     = trackRawBytes(side, track);
+    std::vector<unsigned char> raw(length);  // a little over a revolution, off the stack
+    unsigned char  out[sectorBytes_c];
+    uint8_t        trackNum   = expectedTrackNum(side, track);
+    int            start      = 0;
+
+    if (!controller_m ||
+        controller_m->readHardSectorSector(raw.data(), length, side, track, 0, bitcellTiming_m))
+    {
+        for (uint8_t sector = 0; sector < numSectors; sector++)
+        {
+            status[sector] = Err_ReadError;
+        }
+        return Err_ReadError;
     }
-    else
+
+    for (uint8_t sector = 0; sector < numSectors; sector++)
     {
-        expectedTrackNum = track;
+        uint8_t *sectorBuf = buffer ? &buffer[sector * sectorBytes_c] : out;
+        int      found     = -1;
+
+        // try where the hole should be first, then further away on either side
+        for (int skew = 0; (skew <= maxHoleSkew_c) && (found < 0); skew += holeSkewStep_c)
+        {
+            int candidates[2] = { start - skew, start + skew };
+
+            for (int i = 0; (i < (skew ? 2 : 1)) && (found < 0); i++)
+            {
+                int pos = candidates[i];
+
+                if ((pos >= 0) && (pos + sectorRawBytes_c <= length) &&
+                    (processRawSector(&raw[pos], sectorBuf, sectorBytes_c, side, trackNum,
+                                      sector, true) == No_Error) &&
+                    (headerSector(sectorBuf) == sector))
+                {
+                    found = pos;
+                }
+            }
+        }
+
+        if (found < 0)
+        {
+            // keep the sector where the hole should be, for the caller to retry
+            found          = start;
+            status[sector] = processRawSector(&raw[found], sectorBuf, sectorBytes_c, side,
+                                              trackNum, sector, true);
+            if (status[sector] == No_Error)
+            {
+                status[sector] = Err_InvalidSector;
+            }
+        }
+        else
+        {
+            status[sector] = No_Error;
+        }
+
+        if (rawBuffer)
+        {
+            memcpy(&rawBuffer[sector * sectorRawBytes_c], &raw[found], sectorRawBytes_c);
+        }
+
+        start = found + holeRawBytes_c;
     }
 
-    status = processSector(data, out, sectorBytes_c, side, expectedTrackNum, sector);
+    return No_Error;
+}
 
-    printf("%s - side: %d t: %d sect: %d processStatus: %d\n", __FUNCTION__, side,
-        track, sector, status);
 
-    // Copy data back if buffer provided.
-    if (buffer)
+//! track number expected in the sector headers
+//!
+//! @param side
+//! @param track
+//!
+//! @return track number
+//!
+uint8_t
+HeathHSDisk::expectedTrackNum(uint8_t side,
+                              uint8_t track)
+{
+    if (maxSide_m == 2)
     {
-        memcpy(buffer, out, sectorBytes_c);
+        return (track << 1) + side;
     }
 
-    return status;
+    return track;
 }
 
 
@@ -8,6 +8,8 @@
 
 #include "disk.h"
 
+class FC5025;
+
 
 class HeathHSDisk: virtual public Disk
 {
@@ -58,6 +60,11 @@ public:
                             uint8_t  side,
                             uint8_t  track,
                             uint8_t  sector);
+    virtual int  readTrack(uint8_t *buffer,
+                           uint8_t *rawBuffer,
+                           int     *status,
+                           uint8_t  side,
+                           uint8_t  track);
 #if 0
     virtual int  processSector(uint8_t *buffer,
                                uint8_t *out,
@@ -69,11 +76,19 @@ public:
     virtual bool setSides(uint8_t    sides);
     virtual bool setTracks(uint8_t   tracks);
 
+    virtual void setController(FC5025 *controller);
+
     static int   defaultSectorBytes()    { return sectorBytes_c; };
     static int   defaultSectorRawBytes() { return sectorRawBytes_c; };
+    static int   defaultHoleRawBytes()   { return holeRawBytes_c; };
 
 private:
 
+    uint8_t  expectedTrackNum(uint8_t side,
+                              uint8_t track);
+
+    // controller the disk is read through
+    FC5025  *controller_m;
     uint8_t  maxSide_m;
     uint8_t  maxTrack_m;
     uint8_t  tpi_m;
@@ -88,6 +103,14 @@ private:
 
     // over read the sector - double the data bits due to clock bits.
     static const uint16_t sectorRawBytes_c = 700;
+
+    // raw bytes between two sector holes, 320 characters with their clock bits.
+    static const uint16_t holeRawBytes_c   = 640;
+
+    // when a track is read in one transfer, how far the start of a sector is searched
+    // for around where the hole should be, for the drive speed not matching the disk.
+    static const uint16_t maxHoleSkew_c    = 64;
+    static const uint16_t holeSkewStep_c   = 8;
 };
 
 #endif
@@ -0,0 +1,213 @@
+//! \file lz.cpp
+//!
+//! Small LZ77 byte coder, used to compress raw track data.
+//!
+
+#include "lz.h"
+
+#include <cstring>
+
+
+//! write the part of a length that didn't fit in the token
+//!
+//! @param out
+//! @param length   remaining length
+//!
+void
+LZ::writeLength(std::vector<uint8_t> &out,
+                uint32_t              length)
+{
+    while (length >= 255)
+    {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back(length);
+}
+
+
+//! read the part of a length that didn't fit in the token
+//!
+//! @param in
+//! @param size
+//! @param pos      [in/out] position in in
+//! @param length   [in/out] length from the token, updated
+//!
+//! @return success, false if the input ended
+//!
+bool
+LZ::readLength(const uint8_t *in,
+               uint32_t       size,
+               uint32_t      &pos,
+               uint32_t      &length)
+{
+    uint8_t value;
+
+    do
+    {
+        if (pos >= size)
+        {
+            return false;
+        }
+        value   = in[pos++];
+        length += value;
+    } while (value == 255);
+
+    return true;
+}
+
+
+//! compress a buffer
+//!
+//! @param in
+//! @param size
+//! @param out   [out] compressed data
+//!
+//! @return true if the data got smaller
+//!
+bool
+LZ::compress(const uint8_t        *in,
+             uint32_t              size,
+             std::vector<uint8_t> &out)
+{
+    // last position each hash of 4 bytes was seen at
+    std::vector<int32_t> table(1 << hashBits_c, -1);
+    uint32_t             pos    = 0;
+    uint32_t             anchor = 0;
+
+    out.clear();
+    out.reserve(size);
+
+    while (pos + minMatch_c <= size)
+    {
+        uint32_t value;
+
+        memcpy(&value, &in[pos], sizeof(value));
+
+        uint32_t hash      = (value * 2654435761u) >> (32 - hashBits_c);
+        int32_t  candidate = table[hash];
+
+        table[hash] = pos;
+
+        if ((candidate < 0) || (pos - candidate > maxOffset_c) ||
+            (memcmp(&in[candidate], &in[pos], minMatch_c) != 0))
+        {
+            pos++;
+            continue;
+        }
+
+        uint32_t match = minMatch_c;
+
+        while ((pos + match < size) && (in[candidate + match] == in[pos + match]))
+        {
+            match++;
+        }
+
+        uint32_t literals = pos - anchor;
+        uint32_t offset   = pos - candidate;
+
+        out.push_back(((literals < 15 ? literals : 15) << 4) |
+                      ((match - minMatch_c) < 15 ? (match - minMatch_c) : 15));
+        if (literals >= 15)
+        {
+            writeLength(out, literals - 15);
+        }
+        out.insert(out.end(), &in[anchor], &in[pos]);
+        out.push_back(offset & 0xff);
+        out.push_back(offset >> 8);
+        if (match - minMatch_c >= 15)
+        {
+            writeLength(out, match - minMatch_c - 15);
+        }
+
+        pos   += match;
+        anchor = pos;
+    }
+
+    // the rest as literals
+    uint32_t literals = size - anchor;
+
+    out.push_back((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15)
+    {
+        writeLength(out, literals - 15);
+    }
+    out.insert(out.end(), &in[anchor], &in[size]);
+
+    return out.size() < size;
+}
+
+
+//! decompress a buffer
+//!
+//! @param in
+//! @param size
+//! @param out       buffer for the decompressed data
+//! @param outSize   expected size of the decompressed data
+//!
+//! @return success, false if the data is corrupt, truncated or not the expected size
+//!
+bool
+LZ::decompress(const uint8_t *in,
+               uint32_t       size,
+               uint8_t       *out,
+               uint32_t       outSize)
+{
+    uint32_t pos    = 0;
+    uint32_t outPos = 0;
+
+    while (pos < size)
+    {
+        uint8_t  token    = in[pos++];
+        uint32_t literals = token >> 4;
+
+        if ((literals == 15) && !readLength(in, size, pos, literals))
+        {
+            return false;
+        }
+        if ((literals > size - pos) || (literals > outSize - outPos))
+        {
+            return false;
+        }
+
+        memcpy(&out[outPos], &in[pos], literals);
+        pos    += literals;
+        outPos += literals;
+
+        // the last sequence has no match
+        if (pos == size)
+        {
+            return outPos == outSize;
+        }
+
+        if (pos + 2 > size)
+        {
+            return false;
+        }
+
+        uint32_t offset = in[pos] | (in[pos + 1] << 8);
+        uint32_t match  = token & 0x0f;
+
+        pos += 2;
+
+        if ((match == 15) && !readLength(in, size, pos, match))
+        {
+            return false;
+        }
+        match += minMatch_c;
+
+        if ((offset == 0) || (offset > outPos) || (match > outSize - outPos))
+        {
+            return false;
+        }
+
+        // the match can overlap the bytes being written
+        for (uint32_t i = 0; i < match; i++, outPos++)
+        {
+            out[outPos] = out[outPos - offset];
+        }
+    }
+
+    // the input ended without the last sequence
+    return false;
+}
@@ -0,0 +1,49 @@
+//! \file lz.h
+//!
+//! Small LZ77 byte coder, used to compress raw track data.
+//!
+
+#ifndef __LZ_H__
+#define __LZ_H__
+
+#include <cstdint>
+#include <vector>
+
+
+//! Compresses a buffer as a series of sequences, each a token byte with the literal and
+//! match lengths, the literal bytes, then a 2 byte offset back to the match. Lengths that
+//! don't fit in the token continue in following bytes, 255 meaning more follow. The last
+//! sequence has only literals.
+//!
+class LZ
+{
+public:
+
+    static bool compress(const uint8_t        *in,
+                         uint32_t              size,
+                         std::vector<uint8_t> &out);
+
+    static bool decompress(const uint8_t *in,
+                           uint32_t       size,
+                           uint8_t       *out,
+                           uint32_t       outSize);
+
+    static const uint32_t minMatch_c  = 4;
+    static const uint32_t maxOffset_c = 0xffff;
+
+    //! most bytes one compressed byte can decompress to, a 255 length byte
+    static const uint32_t maxExpansion_c = 255;
+
+private:
+
+    static void writeLength(std::vector<uint8_t> &out,
+                            uint32_t              length);
+    static bool readLength(const uint8_t *in,
+                           uint32_t       size,
+                           uint32_t      &pos,
+                           uint32_t      &length);
+
+    static const unsigned int hashBits_c = 14;
+};
+
+#endif
@@ -0,0 +1,89 @@
+//! \file pool.h
+//!
+//! Pool allocator for objects that are all freed together.
+//!
+
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+
+//! Allocates objects of one type from contiguous slabs. The objects are destroyed, and the
+//! slabs freed, when the pool is destroyed. Objects can't be freed individually.
+//!
+template <class T>
+class Pool
+{
+public:
+
+    Pool(unsigned int slabObjects = defaultSlabObjects_c): slabObjects_m(slabObjects ? slabObjects : 1),
+                                                           used_m(0)
+    {
+    }
+
+    ~Pool()
+    {
+        // every slab but the last is full
+        for (unsigned int i = 0; i < slabs_m.size(); i++)
+        {
+            unsigned int count = (i + 1 < slabs_m.size()) ? slabCount_m[i] : used_m;
+
+            for (unsigned int j = 0; j < count; j++)
+            {
+                slabs_m[i][j].~T();
+            }
+            ::operator delete(slabs_m[i]);
+        }
+    }
+
+    Pool(const Pool &) = delete;
+    Pool &operator=(const Pool &) = delete;
+
+    //! set the number of objects in the slabs allocated from now on
+    //!
+    //! @param slabObjects
+    //!
+    void
+    setSlabObjects(unsigned int slabObjects)
+    {
+        slabObjects_m = slabObjects ? slabObjects : 1;
+    }
+
+    //! construct an object in the pool
+    //!
+    //! @param args   constructor arguments
+    //!
+    //! @return new object, owned by the pool
+    //!
+    template <class... Args>
+    T *
+    create(Args&&... args)
+    {
+        if (slabs_m.empty() || (used_m == slabCount_m.back()))
+        {
+            slabs_m.push_back(static_cast<T *>(::operator new(sizeof(T) * slabObjects_m)));
+            slabCount_m.push_back(slabObjects_m);
+            used_m = 0;
+        }
+
+        T *object = new (&slabs_m.back()[used_m]) T(std::forward<Args>(args)...);
+        used_m++;
+
+        return object;
+    }
+
+private:
+
+    static const unsigned int defaultSlabObjects_c = 64;
+
+    std::vector<T *>          slabs_m;
+    std::vector<unsigned int> slabCount_m;
+    unsigned int              slabObjects_m;
+    unsigned int              used_m;
+};
+
+#endif
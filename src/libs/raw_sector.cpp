@@ -23,7 +23,12 @@ RawSector::RawSector(uint8_t    side,
                      uint16_t   bufSize): bufSize_m(bufSize),
                                           // side_m(side),
                                           // track_m(track),
-                                          sector_m(sector)
+                                          sector_m(sector),
+                                          ownsBuf_m(true),
+                                          delta_m(nullptr),
+                                          deltaSize_m(0),
+                                          ownsDelta_m(true),
+                                          base_m(nullptr)
 {
     buf_m = new uint8_t[bufSize_m];
     memcpy(buf_m, buf, bufSize);
@@ -35,10 +40,21 @@ RawSector::RawSector(uint8_t    side,
 //! @param buf
 //! @param size
 //! @param length
+//! @param copy   copy the sector data, otherwise keep a view into buf
+//! @param base   first attempt of the sector in the track, needed for a delta
 //!
-RawSector::RawSector(uint8_t  *buf,
-                     uint32_t  size,
-                     uint16_t &length)
+RawSector::RawSector(uint8_t   *buf,
+                     uint32_t   size,
+                     uint16_t  &length,
+                     bool       copy,
+                     RawSector *base): bufSize_m(0),
+                                       buf_m(nullptr),
+                                       sector_m(0),
+                                       ownsBuf_m(copy),
+                                       delta_m(nullptr),
+                                       deltaSize_m(0),
+                                       ownsDelta_m(copy),
+                                       base_m(base)
 {
      if (buf[0] == H17Disk::RawSectorDataId)
      {
@@ -46,11 +62,45 @@ RawSector::RawSector(uint8_t  *buf,
          bufSize_m = (buf[2] << 8) | buf[3];
          // TODO make sure bufSize_m isn't larger than size
          //
-         buf_m = (uint8_t*) new char[bufSize_m];
-         memcpy(buf_m, &buf[4], bufSize_m);
+         if (copy)
+         {
+             buf_m = (uint8_t*) new char[bufSize_m];
+             memcpy(buf_m, &buf[4], bufSize_m);
+         }
+         else
+         {
+             buf_m = &buf[4];
+         }
 
          length = bufSize_m + 4;
      }
+     else if (buf[0] == H17Disk::RawSectorDeltaId)
+     {
+         sector_m    = buf[1];
+         deltaSize_m = (buf[2] << 8) | buf[3];
+         length      = deltaSize_m + 4;
+
+         if (copy)
+         {
+             delta_m = new uint8_t[deltaSize_m];
+             memcpy(delta_m, &buf[4], deltaSize_m);
+         }
+         else
+         {
+             delta_m = &buf[4];
+         }
+
+         if (deltaSize_m >= deltaHeaderSize_c)
+         {
+             bufSize_m = (delta_m[0] << 8) | delta_m[1];
+         }
+
+         if ((!base_m) || (base_m->getSectorNumber() != sector_m))
+         {
+             printf("Sector: %d - raw delta without a first attempt\n", sector_m);
+             base_m = nullptr;
+         }
+     }
      else
      {
          //*** error
@@ -64,10 +114,14 @@ RawSector::RawSector(uint8_t  *buf,
 RawSector::~RawSector()
 {
     // printf("%s\n", __PRETTY_FUNCTION__);
-    if (buf_m)
+    if ((buf_m) && (ownsBuf_m))
     {
         delete[] buf_m;
     }
+    if ((delta_m) && (ownsDelta_m))
+    {
+        delete[] delta_m;
+    }
 }
 
 
@@ -79,8 +133,23 @@ RawSector::~RawSector()
 //! @return success
 //!
 bool
-RawSector::writeToFile(std::ofstream &file)
+RawSector::writeToFile(std::ostream &file)
 {
+    if (delta_m)
+    {
+        uint8_t header[headerSize_c] = {
+            H17Disk::RawSectorDeltaId,
+            sector_m,
+            (uint8_t) ((deltaSize_m >> 8) & 0xff),
+            (uint8_t) (deltaSize_m & 0xff)
+        };
+
+        file.write((const char*) header, headerSize_c);
+        file.write((const char*) delta_m, deltaSize_m);
+
+        return true;
+    }
+
     uint8_t header[headerSize_c] = { 
         H17Disk::RawSectorDataId, 
         sector_m, 
@@ -113,7 +182,311 @@ RawSector::getBufSize()
 uint16_t
 RawSector::getBlockSize()
 {
-    return bufSize_m + headerSize_c;
+    return (delta_m ? deltaSize_m : bufSize_m) + headerSize_c;
+}
+
+
+//! Get the sector number
+//!
+//! @return sector number
+//!
+uint8_t
+RawSector::getSectorNumber()
+{
+    return sector_m;
+}
+
+
+//! Check if the sector is stored as a delta
+//!
+//! @return if delta
+//!
+bool
+RawSector::isDelta()
+{
+    return delta_m != nullptr;
+}
+
+
+//! Get the raw data, rebuilding it from the delta on first use
+//!
+//! @return raw data, bufSize_m bytes, nullptr if the delta is invalid or corrupt
+//!
+uint8_t *
+RawSector::getBuf()
+{
+    if ((buf_m) || (!delta_m) || (!base_m))
+    {
+        return buf_m;
+    }
+
+    uint8_t *base = base_m->getBuf();
+
+    if (!base || (base_m->getBufSize() != bufSize_m) || (deltaSize_m < deltaHeaderSize_c))
+    {
+        printf("Sector: %d - invalid raw delta\n", sector_m);
+        return buf_m;
+    }
+
+    buf_m     = new uint8_t[bufSize_m];
+    ownsBuf_m = true;
+
+    shiftBits(base, buf_m, bufSize_m, (int8_t) delta_m[2]);
+
+    // runs of bytes to skip, then bytes to xor
+    uint16_t pos = deltaHeaderSize_c;
+    uint16_t out = 0;
+    uint16_t skip;
+    uint16_t count;
+
+    while (pos < deltaSize_m)
+    {
+        if (!readCount(pos, skip) || !readCount(pos, count) ||
+            (count > deltaSize_m - pos) || (skip + count > bufSize_m - out))
+        {
+            printf("Sector: %d - corrupt raw delta\n", sector_m);
+
+            // don't hand out a partly rebuilt sector, or try to rebuild it again
+            delete[] buf_m;
+            buf_m  = nullptr;
+            base_m = nullptr;
+
+            return nullptr;
+        }
+
+        out += skip;
+        for (uint16_t i = 0; i < count; i++)
+        {
+            buf_m[out++] ^= delta_m[pos++];
+        }
+    }
+
+    return buf_m;
+}
+
+
+//! Store the sector as a delta against an earlier attempt, if that is smaller
+//!
+//! The earlier attempt is shifted by up to maxShift_c bits to line it up, then the bytes
+//! that still differ are kept as runs xor'ed with it. The full data is freed.
+//!
+//! @param base   first attempt of the same sector, stored in full
+//!
+//! @return if stored as a delta
+//!
+bool
+RawSector::encodeDelta(RawSector *base)
+{
+    if ((delta_m) || (!buf_m) || (!base) || (base->isDelta()) || (!base->getBuf()) ||
+        (base->getBufSize() != bufSize_m) || (base->getSectorNumber() != sector_m))
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> shifted(bufSize_m);
+    int                  bestShift = 0;
+    unsigned int         bestCount = bufSize_m + 1;
+
+    for (int shift = -maxShift_c; shift <= maxShift_c; shift++)
+    {
+        unsigned int count = 0;
+
+        shiftBits(base->getBuf(), shifted.data(), bufSize_m, shift);
+
+        for (uint16_t i = 0; i < bufSize_m; i++)
+        {
+            count += buf_m[i] != shifted[i];
+        }
+
+        if (count < bestCount)
+        {
+            bestCount = count;
+            bestShift = shift;
+        }
+    }
+
+    shiftBits(base->getBuf(), shifted.data(), bufSize_m, bestShift);
+
+    std::vector<uint8_t> delta = { (uint8_t) (bufSize_m >> 8), (uint8_t) (bufSize_m & 0xff),
+                                   (uint8_t) bestShift };
+    uint16_t             pos   = 0;
+
+    while (pos < bufSize_m)
+    {
+        uint16_t start = pos;
+
+        while ((pos < bufSize_m) && (buf_m[pos] == shifted[pos]))
+        {
+            pos++;
+        }
+
+        if (pos == bufSize_m)
+        {
+            break;
+        }
+
+        // end the run at 3 matching bytes, shorter gaps cost less to keep in the run
+        uint16_t end = pos;
+
+        while (end < bufSize_m)
+        {
+            uint16_t same = 0;
+
+            while ((end + same < bufSize_m) && (same < 3) &&
+                   (buf_m[end + same] == shifted[end + same]))
+            {
+                same++;
+            }
+
+            if ((same == 3) || (end + same == bufSize_m))
+            {
+                break;
+            }
+            end += same + 1;
+        }
+
+        writeCount(delta, pos - start);
+        writeCount(delta, end - pos);
+        for (; pos < end; pos++)
+        {
+            delta.push_back(buf_m[pos] ^ shifted[pos]);
+        }
+    }
+
+    if (delta.size() >= bufSize_m)
+    {
+        return false;
+    }
+
+    deltaSize_m = delta.size();
+    delta_m     = new uint8_t[deltaSize_m];
+    ownsDelta_m = true;
+    base_m      = base;
+    memcpy(delta_m, delta.data(), deltaSize_m);
+
+    if (ownsBuf_m)
+    {
+        delete[] buf_m;
+    }
+    buf_m = nullptr;
+
+    return true;
+}
+
+
+//! Store the sector in full again
+//!
+//! @return success
+//!
+bool
+RawSector::expand()
+{
+    if (!delta_m)
+    {
+        return true;
+    }
+
+    if (!getBuf())
+    {
+        return false;
+    }
+
+    if (ownsDelta_m)
+    {
+        delete[] delta_m;
+    }
+    delta_m     = nullptr;
+    deltaSize_m = 0;
+    base_m      = nullptr;
+
+    return true;
+}
+
+
+//! shift a bit stream, the bits are in order from the msb of the first byte
+//!
+//! @param in
+//! @param out     [out] in, delayed by shift bits, which can be negative
+//! @param size    size of in and out
+//! @param shift
+//!
+void
+RawSector::shiftBits(const uint8_t *in,
+                     uint8_t       *out,
+                     uint16_t       size,
+                     int            shift)
+{
+    auto at = [in, size](int pos) -> unsigned int
+    {
+        return ((pos >= 0) && (pos < size)) ? in[pos] : 0;
+    };
+
+    int bytes = ((shift < 0) ? -shift : shift) >> 3;
+    int bits  = ((shift < 0) ? -shift : shift) & 7;
+
+    for (int i = 0; i < size; i++)
+    {
+        if (shift >= 0)
+        {
+            out[i] = (at(i - bytes) >> bits) | (at(i - bytes - 1) << (8 - bits));
+        }
+        else
+        {
+            out[i] = (at(i + bytes) << bits) | (at(i + bytes + 1) >> (8 - bits));
+        }
+    }
+}
+
+
+//! append a count, 7 bits per byte with the msb set when more bytes follow
+//!
+//! @param out
+//! @param count
+//!
+void
+RawSector::writeCount(std::vector<uint8_t> &out,
+                      uint16_t              count)
+{
+    while (count >= 0x80)
+    {
+        out.push_back(0x80 | (count & 0x7f));
+        count >>= 7;
+    }
+    out.push_back(count);
+}
+
+
+//! read a count from the delta
+//!
+//! @param pos     [in/out] position in delta_m
+//! @param count   [out]
+//!
+//! @return success
+//!
+bool
+RawSector::readCount(uint16_t &pos,
+                     uint16_t &count)
+{
+    count = 0;
+
+    for (unsigned int shift = 0; shift < 16; shift += 7)
+    {
+        if (pos >= deltaSize_m)
+        {
+            return false;
+        }
+
+        uint8_t value = delta_m[pos++];
+
+        count |= (value & 0x7f) << shift;
+
+        if (!(value & 0x80))
+        {
+            return true;
+        }
+    }
+
+    return false;
 }
 
 
@@ -9,6 +9,7 @@
 #include <iostream>
 #include <fstream>
 #include <cstdint>
+#include <vector>
 
 class RawSector
 {
@@ -21,24 +22,53 @@ public:
               uint8_t  *buf,
               uint16_t  bufSize);
 
-    RawSector(uint8_t  *buf,
-              uint32_t  size,
-              uint16_t &length);
+    RawSector(uint8_t   *buf,
+              uint32_t   size,
+              uint16_t  &length,
+              bool       copy = true,
+              RawSector *base = nullptr);
 
     ~RawSector();
 
-    bool     writeToFile(std::ofstream &file);
+    bool     writeToFile(std::ostream &file);
     uint16_t getBufSize();
     uint16_t getBlockSize();
+    uint8_t *getBuf();
+    uint8_t  getSectorNumber();
     void     dumpSector();
 
+    bool     encodeDelta(RawSector *base);
+    bool     expand();
+    bool     isDelta();
+
     static const uint8_t headerSize_c = 4;
 
+    // a delta starts with the raw length and the bit shift of the first attempt
+    static const uint8_t deltaHeaderSize_c = 3;
+    static const int     maxShift_c        = 16;
+
 private:
 
+    static void shiftBits(const uint8_t *in,
+                          uint8_t       *out,
+                          uint16_t       size,
+                          int            shift);
+    static void writeCount(std::vector<uint8_t> &out,
+                           uint16_t              count);
+    bool        readCount(uint16_t &pos,
+                          uint16_t &count);
+
     uint16_t   bufSize_m;
     uint8_t   *buf_m;
     uint8_t    sector_m;
+    bool       ownsBuf_m;
+
+    // a later attempt can be stored as a delta against the first attempt of the sector,
+    // buf_m is then rebuilt from it when needed
+    uint8_t   *delta_m;
+    uint16_t   deltaSize_m;
+    bool       ownsDelta_m;
+    RawSector *base_m;
 
 };
 
@@ -15,7 +15,9 @@
 //!
 RawTrack::RawTrack(uint8_t side,
                    uint8_t track): side_m(side),
-                                   track_m(track)
+                                   track_m(track),
+                                   ownsSectors_m(true),
+                                   deltaEncoding_m(false)
 {
     sectors_m.reserve(100);
 }
@@ -26,10 +28,15 @@ RawTrack::RawTrack(uint8_t side,
 //! @param[in] buf - data buffer
 //! @param[in] size - size of buffer
 //! @param[out] length - total block length
+//! @param[in] copy - copy the sector data, otherwise the sectors are views into buf
+//! @param[in] pool - pool to allocate the sectors from, which then owns them
 //!
-RawTrack::RawTrack(uint8_t  *buf,
-                   uint32_t  size,
-                   uint32_t &length)
+RawTrack::RawTrack(uint8_t          *buf,
+                   uint32_t          size,
+                   uint32_t         &length,
+                   bool              copy,
+                   Pool<RawSector>  *pool): ownsSectors_m(!pool),
+                                            deltaEncoding_m(false)
 {
     // printf("Track::Track buf[0]: %d\n", buf[0]);
     if (H17Disk::RawTrackDataId == buf[0])
@@ -43,7 +50,26 @@ RawTrack::RawTrack(uint8_t  *buf,
         while(pos < size_m)
         {
             // printf("Track::Track pos: %d  buf[pos]: %d\n", pos, buf[pos + 5]);
-            sectors_m.push_back(new RawSector(&buf[pos + 7], size_m - pos, cur_length));
+
+            // later attempts can be deltas against the first one
+            RawSector *base = nullptr;
+
+            if (buf[pos + 7] == H17Disk::RawSectorDeltaId)
+            {
+                base = getFirstAttempt(buf[pos + 8]);
+                deltaEncoding_m = true;
+            }
+
+            if (pool)
+            {
+                sectors_m.push_back(pool->create(&buf[pos + 7], size_m - pos, cur_length, copy,
+                                                 base));
+            }
+            else
+            {
+                sectors_m.push_back(new RawSector(&buf[pos + 7], size_m - pos, cur_length, copy,
+                                                  base));
+            }
             pos += cur_length;
         }
         length = size_m + 7;
@@ -61,7 +87,7 @@ RawTrack::RawTrack(uint8_t  *buf,
 RawTrack::~RawTrack()
 {
     // printf("%s\n", __PRETTY_FUNCTION__);
-    for(unsigned int i = 0; i < sectors_m.size(); ++i)
+    for(unsigned int i = 0; ownsSectors_m && (i < sectors_m.size()); ++i)
     {
         delete sectors_m[i];
     } 
@@ -77,22 +103,116 @@ RawTrack::~RawTrack()
 bool
 RawTrack::addRawSector(RawSector *sector)
 {
+    if (deltaEncoding_m)
+    {
+        RawSector *base = getFirstAttempt(sector->getSectorNumber());
+
+        if (base)
+        {
+            sector->encodeDelta(base);
+        }
+    }
+
     sectors_m.push_back(sector);
 
     return true;
 }
 
 
+//! find the first attempt of a sector
+//!
+//! @param sector     sector number
+//!
+//! @return raw sector, nullptr if none yet
+//!
+RawSector *
+RawTrack::getFirstAttempt(uint8_t sector)
+{
+    for (unsigned int i = 0; i < sectors_m.size(); i++)
+    {
+        if (sectors_m[i]->getSectorNumber() == sector)
+        {
+            return sectors_m[i];
+        }
+    }
+
+    return nullptr;
+}
+
+
+//! store the later attempts of each sector as deltas against the first, or all in full
+//!
+//! @param delta   use deltas
+//!
+void
+RawTrack::setDeltaEncoding(bool delta)
+{
+    deltaEncoding_m = delta;
+
+    for (unsigned int i = 0; i < sectors_m.size(); i++)
+    {
+        RawSector *base = getFirstAttempt(sectors_m[i]->getSectorNumber());
+
+        if ((!delta) || (base == sectors_m[i]))
+        {
+            sectors_m[i]->expand();
+        }
+        else if (!sectors_m[i]->isDelta())
+        {
+            sectors_m[i]->encodeDelta(base);
+        }
+    }
+}
+
+
+//! getSideNumber
+//!
+//! @return   side number
+//!
+uint8_t
+RawTrack::getSideNumber()
+{
+    return side_m;
+}
+
+//! getTrackNumber
+//!
+//! @return   track number
+//!
+uint8_t
+RawTrack::getTrackNumber()
+{
+    return track_m;
+}
+
+//! get entire size of the raw track, including the header
+//!
+//! @return block size
+//!
+uint32_t
+RawTrack::getBlockSize()
+{
+    uint32_t size = headerSize_c;
+
+    for (unsigned int i = 0; i < sectors_m.size(); i++)
+    {
+        size += sectors_m[i]->getBlockSize();
+    }
+
+    return size;
+}
+
+
 //! writeToFile
 //!
 //! writes the raw track to a file
 //!
-//! @param file   ofstream for file
+//! @param file   stream to write to
 //!
 //! @return  success
 //!
 bool
-RawTrack::writeToFile(std::ofstream &file)
+RawTrack::writeToFile(std::ostream &file)
 {
     uint32_t size = 0;
 
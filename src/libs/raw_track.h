@@ -9,6 +9,9 @@
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <cstdint>
+
+#include "pool.h"
 
 class RawSector;
 
@@ -19,14 +22,21 @@ public:
     RawTrack(uint8_t   side,
              uint8_t   track);
 
-    RawTrack(uint8_t  *buf,
-             uint32_t  size,
-             uint32_t &length);
+    RawTrack(uint8_t          *buf,
+             uint32_t          size,
+             uint32_t         &length,
+             bool              copy = true,
+             Pool<RawSector>  *pool = nullptr);
 
     ~RawTrack();
 
     bool addRawSector(RawSector    *sector);
-    bool writeToFile(std::ofstream &file);
+    bool writeToFile(std::ostream  &file);
+    void setDeltaEncoding(bool      delta);
+
+    uint32_t getBlockSize();
+    uint8_t  getSideNumber();
+    uint8_t  getTrackNumber();
 
     static const unsigned char headerSize_c = 7;
 
@@ -37,6 +47,14 @@ private:
     uint8_t                  track_m;
     uint32_t                 size_m;
 
+    // false when the sectors belong to a pool
+    bool                     ownsSectors_m;
+
+    // store later attempts of a sector as deltas against the first
+    bool                     deltaEncoding_m;
+
+    RawSector               *getFirstAttempt(uint8_t sector);
+
 };
 
 #endif
@@ -0,0 +1,467 @@
+//! \file read_scheduler.cpp
+//!
+//! Chooses the order to read the sectors of a hard-sectored track in.
+//!
+
+#include "read_scheduler.h"
+
+#include <cmath>
+
+
+const double ReadScheduler::marginHoles_c = 0.1;
+const double ReadScheduler::missHoles_c   = 0.25;
+
+
+//! constructor
+//!
+//! @param holes      sector holes in a revolution
+//! @param readHoles  length of a sector read, in the time between two holes
+//! @param rpm        speed of the drive
+//!
+ReadScheduler::ReadScheduler(uint8_t  holes,
+                             double   readHoles,
+                             uint16_t rpm): holes_m(holes),
+                                            readHoles_m(readHoles),
+                                            rpm_m(rpm),
+                                            order_m(order_Rotational),
+                                            turnaround_m(0.0),
+                                            processing_m(0.0),
+                                            missLead_m(0.0),
+                                            phaseKnown_m(false),
+                                            lastSector_m(0),
+                                            chosen_m(false),
+                                            chosenSector_m(0),
+                                            curSector_m(0),
+                                            curWait_m(-1.0),
+                                            first_m(0),
+                                            last_m(0),
+                                            trackReads_m(0),
+                                            trackRevolutions_m(0.0),
+                                            tracks_m(0),
+                                            totalRevolutions_m(0.0),
+                                            misses_m(0)
+{
+
+}
+
+
+//! set the order to read the sectors in
+//!
+//! @param order
+//!
+void
+ReadScheduler::setOrder(Order order)
+{
+    order_m = order;
+}
+
+
+//! set the speed the disk is turning at, as measured by the drive
+//!
+//! @param rpm
+//!
+void
+ReadScheduler::setRpm(double rpm)
+{
+    if (rpm > 0.0)
+    {
+        rpm_m = rpm;
+    }
+}
+
+
+//! set the time from sending a command until the drive has answered it, when it doesn't
+//! have to wait for the disk
+//!
+//! @param seconds
+//!
+void
+ReadScheduler::setTurnaround(double seconds)
+{
+    turnaround_m = seconds;
+}
+
+
+//! start a track, all its sectors are pending
+//!
+//! @param first   first sector
+//! @param last    last sector
+//!
+void
+ReadScheduler::startTrack(uint8_t first,
+                          uint8_t last)
+{
+    first_m = first;
+    last_m  = last;
+
+    pending_m.clear();
+    attempts_m.clear();
+    for (unsigned int sector = first; sector <= last; sector++)
+    {
+        pending_m.push_back(sector);
+        attempts_m.push_back(0);
+    }
+
+    trackStart_m       = Clock::now();
+    trackReads_m       = 0;
+    trackRevolutions_m = 0.0;
+}
+
+
+//! the track is done, update the revolutions spent on it
+//!
+void
+ReadScheduler::endTrack()
+{
+    std::chrono::duration<double> elapsed = Clock::now() - trackStart_m;
+
+    trackRevolutions_m  = elapsed.count() / (holeTime() * holes_m);
+    totalRevolutions_m += trackRevolutions_m;
+    tracks_m++;
+}
+
+
+//! choose the next sector to read, from the ones with the fewest reads
+//!
+//! @param sector  [out] sector to read
+//!
+//! @return false if no sectors are pending
+//!
+bool
+ReadScheduler::nextSector(uint8_t &sector)
+{
+    if (pending_m.empty())
+    {
+        return false;
+    }
+
+    unsigned int pass = attempts_m[0];
+
+    for (unsigned int i = 1; i < attempts_m.size(); i++)
+    {
+        if (attempts_m[i] < pass)
+        {
+            pass = attempts_m[i];
+        }
+    }
+
+    if (order_m == order_EvenOdd)
+    {
+        for (unsigned int start = 0; start < 2; start++)
+        {
+            for (unsigned int next = first_m + start; next <= last_m; next += 2)
+            {
+                if (isPending(next, pass))
+                {
+                    sector = next;
+                    return true;
+                }
+            }
+        }
+    }
+
+    if (!phaseKnown_m)
+    {
+        for (unsigned int i = 0; i < pending_m.size(); i++)
+        {
+            if (attempts_m[i] == pass)
+            {
+                sector = pending_m[i];
+                return true;
+            }
+        }
+    }
+
+    chosenTime_m = Clock::now();
+
+    // where the disk will be when the command gets to the drive
+    Clock::time_point arrival = chosenTime_m +
+                                std::chrono::duration_cast<Clock::duration>(
+                                    std::chrono::duration<double>(getLead()));
+    double            best    = -1.0;
+
+    for (unsigned int i = 0; i < pending_m.size(); i++)
+    {
+        if (attempts_m[i] != pass)
+        {
+            continue;
+        }
+
+        double wait = waitFor(pending_m[i], arrival);
+
+        if (wait < marginHoles_c * holeTime())
+        {
+            wait += holeTime() * holes_m;
+        }
+
+        if ((best < 0.0) || (wait < best))
+        {
+            best   = wait;
+            sector = pending_m[i];
+        }
+    }
+
+    chosen_m       = true;
+    chosenSector_m = sector;
+
+    return true;
+}
+
+
+//! a read of a sector is being sent to the drive
+//!
+//! @param sector
+//!
+void
+ReadScheduler::startRead(uint8_t sector)
+{
+    curStart_m  = Clock::now();
+    curSector_m = sector;
+    curWait_m   = -1.0;
+
+    if (chosen_m && (chosenSector_m == sector))
+    {
+        std::chrono::duration<double> spent = curStart_m - chosenTime_m;
+
+        // time from choosing the sector until the read is sent, averaged
+        processing_m = (processing_m * 7.0 + spent.count()) / 8.0;
+    }
+    chosen_m = false;
+
+    if (phaseKnown_m)
+    {
+        curWait_m = waitFor(sector, curStart_m);
+    }
+}
+
+
+//! the read started by startRead() is done
+//!
+//! @param retry   sector needs to be read again, keep it pending
+//!
+void
+ReadScheduler::endRead(bool retry)
+{
+    Clock::time_point             now     = Clock::now();
+    std::chrono::duration<double> elapsed = now - curStart_m;
+    double                        wait    = elapsed.count() - readHoles_m * holeTime();
+
+    trackReads_m++;
+
+    // waited about a revolution more than the hole was away, the command got to the
+    // drive after the hole had passed
+    if ((curWait_m >= 0.0) && (wait > curWait_m + holeTime() * holes_m / 2))
+    {
+        misses_m++;
+        missLead_m += missHoles_c * holeTime();
+
+        if (missLead_m > holeTime() * holes_m)
+        {
+            missLead_m = holeTime() * holes_m;
+        }
+    }
+
+    phaseKnown_m = true;
+    lastSector_m = curSector_m;
+    lastDone_m   = now;
+
+    markRead(curSector_m, retry);
+}
+
+
+//! count a read of a sector, for reads not timed with startRead() and endRead()
+//!
+//! @param sector
+//! @param retry   sector needs to be read again, keep it pending
+//!
+void
+ReadScheduler::markRead(uint8_t sector,
+                        bool    retry)
+{
+    for (unsigned int i = 0; i < pending_m.size(); i++)
+    {
+        if (pending_m[i] == sector)
+        {
+            if (retry)
+            {
+                attempts_m[i]++;
+            }
+            else
+            {
+                pending_m.erase(pending_m.begin() + i);
+                attempts_m.erase(attempts_m.begin() + i);
+            }
+            break;
+        }
+    }
+}
+
+
+//! get the number of reads done of a pending sector
+//!
+//! @param sector
+//!
+//! @return reads, 0 if the sector is not pending
+//!
+unsigned int
+ReadScheduler::getAttempts(uint8_t sector)
+{
+    for (unsigned int i = 0; i < pending_m.size(); i++)
+    {
+        if (pending_m[i] == sector)
+        {
+            return attempts_m[i];
+        }
+    }
+
+    return 0;
+}
+
+
+//! get the speed used for the disk
+//!
+//! @return rpm
+//!
+double
+ReadScheduler::getRpm()
+{
+    return rpm_m;
+}
+
+
+//! get the time it takes a command to get to the drive
+//!
+//! @return seconds
+//!
+double
+ReadScheduler::getLead()
+{
+    return turnaround_m + processing_m + missLead_m;
+}
+
+
+//! get the number of reads that missed their hole
+//!
+//! @return misses
+//!
+unsigned int
+ReadScheduler::getMisses()
+{
+    return misses_m;
+}
+
+
+//! get the number of reads done on the current or last track
+//!
+//! @return reads
+//!
+unsigned int
+ReadScheduler::getTrackReads()
+{
+    return trackReads_m;
+}
+
+
+//! get the revolutions spent on the last track
+//!
+//! @return revolutions
+//!
+double
+ReadScheduler::getTrackRevolutions()
+{
+    return trackRevolutions_m;
+}
+
+
+//! get the number of tracks done
+//!
+//! @return tracks
+//!
+unsigned int
+ReadScheduler::getTracks()
+{
+    return tracks_m;
+}
+
+
+//! get the revolutions spent on all the tracks
+//!
+//! @return revolutions
+//!
+double
+ReadScheduler::getTotalRevolutions()
+{
+    return totalRevolutions_m;
+}
+
+
+//! time between two sector holes
+//!
+//! @return seconds
+//!
+double
+ReadScheduler::holeTime()
+{
+    return 60.0 / (rpm_m * holes_m);
+}
+
+
+//! position of the disk at a given time, in holes from the start of the last sector
+//! that was read
+//!
+//! @param time
+//!
+//! @return holes
+//!
+double
+ReadScheduler::holesAt(Clock::time_point time)
+{
+    std::chrono::duration<double> elapsed = time - lastDone_m;
+
+    return lastSector_m + readHoles_m + elapsed.count() / holeTime();
+}
+
+
+//! time from a given time until the hole of a sector passes the head
+//!
+//! @param sector
+//! @param time
+//!
+//! @return seconds
+//!
+double
+ReadScheduler::waitFor(uint8_t           sector,
+                       Clock::time_point time)
+{
+    double holes = std::fmod(sector - holesAt(time), holes_m);
+
+    if (holes < 0.0)
+    {
+        holes += holes_m;
+    }
+
+    return holes * holeTime();
+}
+
+
+//! check if a sector is still to be read in the current pass
+//!
+//! @param sector
+//! @param attempts   reads already done of the sectors in the pass
+//!
+//! @return if pending
+//!
+bool
+ReadScheduler::isPending(uint8_t      sector,
+                         unsigned int attempts)
+{
+    for (unsigned int i = 0; i < pending_m.size(); i++)
+    {
+        if (pending_m[i] == sector)
+        {
+            return attempts_m[i] == attempts;
+        }
+    }
+
+    return false;
+}
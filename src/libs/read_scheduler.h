@@ -0,0 +1,117 @@
+//! \file read_scheduler.h
+//!
+//! Chooses the order to read the sectors of a hard-sectored track in.
+//!
+
+#ifndef __READ_SCHEDULER_H__
+#define __READ_SCHEDULER_H__
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+
+//! Keeps track of where the disk is in its rotation, from when the last read ended, and
+//! picks the sector whose hole will pass the head first after the next command gets to
+//! the drive. The time a command needs to get to the drive is the measured turnaround of
+//! a command plus the time the caller takes between reads, extended each time a hole is
+//! missed.
+//!
+//! A sector read that needs to be retried stays pending, and is read again in a later
+//! pass over the track, once every sector with fewer attempts has been read.
+//!
+class ReadScheduler
+{
+public:
+
+    enum Order
+    {
+        order_EvenOdd,      // 0, 2, 4, ... then 1, 3, 5, ...
+        order_Rotational    // next hole to reach the head
+    };
+
+    ReadScheduler(uint8_t  holes,
+                  double   readHoles,
+                  uint16_t rpm);
+
+    void     setOrder(Order    order);
+    void     setRpm(double     rpm);
+    void     setTurnaround(double seconds);
+
+    void     startTrack(uint8_t first,
+                        uint8_t last);
+    void     endTrack();
+
+    bool     nextSector(uint8_t &sector);
+    void     startRead(uint8_t   sector);
+    void     endRead(bool        retry);
+    void     markRead(uint8_t    sector,
+                      bool       retry);
+
+    unsigned int getAttempts(uint8_t sector);
+
+    double       getRpm();
+    double       getLead();
+    unsigned int getMisses();
+
+    unsigned int getTrackReads();
+    double       getTrackRevolutions();
+    unsigned int getTracks();
+    double       getTotalRevolutions();
+
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    double   holeTime();
+    double   holesAt(Clock::time_point time);
+    double   waitFor(uint8_t           sector,
+                     Clock::time_point time);
+    bool     isPending(uint8_t         sector,
+                       unsigned int    attempts);
+
+    uint8_t             holes_m;
+    double              readHoles_m;
+    double              rpm_m;
+    Order               order_m;
+
+    // time for a command to get to the drive
+    double              turnaround_m;
+    double              processing_m;
+    double              missLead_m;
+
+    // rotation, from the end of the last read
+    bool                phaseKnown_m;
+    uint8_t             lastSector_m;
+    Clock::time_point   lastDone_m;
+
+    // when the next sector was chosen, and which one
+    bool                chosen_m;
+    uint8_t             chosenSector_m;
+    Clock::time_point   chosenTime_m;
+
+    // read in progress
+    uint8_t             curSector_m;
+    Clock::time_point   curStart_m;
+    double              curWait_m;
+
+    // sectors still to be read, and the reads already done of each
+    std::vector<uint8_t> pending_m;
+    std::vector<uint8_t> attempts_m;
+    uint8_t              first_m;
+    uint8_t              last_m;
+
+    // instrumentation
+    Clock::time_point   trackStart_m;
+    unsigned int        trackReads_m;
+    double              trackRevolutions_m;
+    unsigned int        tracks_m;
+    double              totalRevolutions_m;
+    unsigned int        misses_m;
+
+    // margin before a hole, and how much to add for each hole that is missed
+    static const double marginHoles_c;
+    static const double missHoles_c;
+};
+
+#endif
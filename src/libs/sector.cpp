@@ -28,7 +28,8 @@ Sector::Sector(uint8_t   side,
                uint16_t  bufSize): bufSize_m(bufSize),
                                    buf_m(nullptr),
                                    sector_m(sector),
-                                   error_m(error)
+                                   error_m(error),
+                                   ownsBuf_m(true)
 {
     // deep copy the sector data
     if ((buf) && (bufSize > 0))
@@ -49,10 +50,16 @@ Sector::Sector(uint8_t   side,
 //! @param buf    existing sector written value.
 //! @param size   length of the buffer
 //! @param length amount of space used by this sector
+//! @param copy   copy the sector data, otherwise keep a view into buf
 //!
 Sector::Sector(uint8_t  *buf,
-               uint16_t size,
-               uint16_t &length)
+               uint16_t  size,
+               uint16_t &length,
+               bool      copy): bufSize_m(0),
+                                buf_m(nullptr),
+                                sector_m(0),
+                                error_m(0),
+                                ownsBuf_m(copy)
 {
      if (buf[0] == H17Disk::SectorDataId)
      {
@@ -60,8 +67,15 @@ Sector::Sector(uint8_t  *buf,
          error_m = buf[2];
          bufSize_m = (buf[3] << 8) | buf[4];
 
-         buf_m = (uint8_t*) new char[bufSize_m]; 
-         memcpy(buf_m, &buf[5], bufSize_m);
+         if (copy)
+         {
+             buf_m = (uint8_t*) new char[bufSize_m]; 
+             memcpy(buf_m, &buf[5], bufSize_m);
+         }
+         else
+         {
+             buf_m = &buf[5];
+         }
 
          length = bufSize_m + 5;
      }
@@ -79,7 +93,7 @@ Sector::~Sector()
 {
     // printf("%s\n", __PRETTY_FUNCTION__);
     // free allocated memory
-    if (buf_m)
+    if ((buf_m) && (ownsBuf_m))
     {
         delete[] buf_m;
     }
@@ -93,7 +107,7 @@ Sector::~Sector()
 //! @return success
 //!
 bool
-Sector::writeToFile(std::ofstream &file)
+Sector::writeToFile(std::ostream &file)
 {
     // create header
     unsigned char buf[headerSize_c] = { H17Disk::SectorDataId,
@@ -172,7 +186,7 @@ Sector::getSectorDataOffset()
 //! @return success
 //!
 bool
-Sector::writeToH8D(std::ofstream &file)
+Sector::writeToH8D(std::ostream &file)
 {
 
     uint16_t pos = getSectorDataOffset();
@@ -201,7 +215,7 @@ Sector::getSectorData()
 //! @return success
 //!
 bool
-Sector::writeToRaw(std::ofstream &file)
+Sector::writeToRaw(std::ostream &file)
 {   
     
     // write out the sector
@@ -216,10 +230,29 @@ Sector::writeToRaw(std::ofstream &file)
 
 //! get sector number from the header portion of the sector
 //!
-//! @return success
+//! @return sector number, 20 if the header sync was not found
 //!
 uint8_t
 Sector::getSectorNum()
+{
+    uint8_t sectorNum = findSectorNum();
+
+    if (sectorNum == noSectorNum_c)
+    {
+        printf("Could not find sector number: %d\n", sector_m);
+    }
+
+    return sectorNum;
+}
+
+
+//! get sector number from the header portion of the sector, without reporting a
+//! missing header
+//!
+//! @return sector number, 20 if the header sync was not found
+//!
+uint8_t
+Sector::findSectorNum()
 {
 
     uint16_t pos = 0;
@@ -231,10 +264,9 @@ Sector::getSectorNum()
     }
 
 
-    if (pos > (bufSize_m - 3))
+    if (pos + 3 >= bufSize_m)
     {
-        printf("Could not find sector number: %d\n", sector_m);
-        return 20;
+        return noSectorNum_c;
     }
     {
         return buf_m[pos+3]; 
@@ -267,6 +299,17 @@ Sector::analyze()
         valid = false;
         printf("size is too small: %d\n", bufSize_m);
     }
+    else if (!error_m)
+    {
+        // sector was read without error, the data checksum must still match
+        uint16_t pos = getSectorDataOffset();
+
+        if ((pos + 256 < bufSize_m) && (blockChecksum(0, &buf_m[pos], 256) != buf_m[pos + 256]))
+        {
+            valid = false;
+            printf("sector(%d) has invalid data checksum\n", sector_m);
+        }
+    }
 
     return valid;
 }
@@ -391,12 +434,11 @@ Sector::dumpData(unsigned char buf[])
 {
     printf("    Sector Data:\n");
     uint8_t printAble[16];
-    uint8_t calculatedChecksum = 0;
+    uint8_t calculatedChecksum = blockChecksum(0, buf, 256);
 
 
     for (unsigned int i = 0; i < 256; i++)
     {
-        calculatedChecksum = updateChecksum(calculatedChecksum, buf[i]);
         printAble[i % 16] = isprint(buf[i]) ? buf[i] : '.';
         if  ((i % 16) == 0)
         {
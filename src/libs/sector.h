@@ -17,7 +17,8 @@ public:
 
     Sector(uint8_t  *buf,
            uint16_t  size,
-           uint16_t &length);
+           uint16_t &length,
+           bool      copy = true);
 
     Sector(uint8_t   side,
            uint8_t   track,
@@ -28,11 +29,12 @@ public:
 
     ~Sector();
 
-    bool     writeToFile(std::ofstream &file);
-    bool     writeToH8D(std::ofstream &file);
-    bool     writeToRaw(std::ofstream &file);
+    bool     writeToFile(std::ostream &file);
+    bool     writeToH8D(std::ostream &file);
+    bool     writeToRaw(std::ostream &file);
 
     uint8_t  getSectorNum();
+    uint8_t  findSectorNum();
     uint16_t getBlockSize();
     bool     analyze();
 
@@ -43,6 +45,9 @@ public:
 
     static const uint8_t headerSize_c = 5;
 
+    //! returned as the sector number when the header sync is missing
+    static const uint8_t noSectorNum_c = 20;
+
     bool     dump(int level);
 
 private:
@@ -54,6 +59,7 @@ private:
     uint8_t  *buf_m;
     uint8_t   sector_m;
     uint8_t   error_m;
+    bool      ownsBuf_m;
 
 };
 
@@ -16,7 +16,9 @@
 //! @param track   track number
 //!
 Track::Track(uint8_t side,
-             uint8_t track): side_m(side),
+             uint8_t track): sectorIndex_m(),
+                             ownsSectors_m(true),
+                             side_m(side),
                              track_m(track)
 {
     sectors_m.reserve(100);
@@ -28,10 +30,15 @@ Track::Track(uint8_t side,
 //! @param[in]  buf    buffer with existing track data
 //! @param[in]  size   buffer size
 //! @param[out] length amount of buffer used for track data
+//! @param[in]  copy   copy the sector data, otherwise the sectors are views into buf
+//! @param[in]  pool   pool to allocate the sectors from, which then owns them
 //!
-Track::Track(uint8_t  *buf,
-             uint32_t  size,
-             uint32_t &length)
+Track::Track(uint8_t       *buf,
+             uint32_t       size,
+             uint32_t      &length,
+             bool           copy,
+             Pool<Sector>  *pool): sectorIndex_m(),
+                                   ownsSectors_m(!pool)
 {
      if (H17Block::TrackDataId == buf[0])
      {
@@ -41,9 +48,19 @@ Track::Track(uint8_t  *buf,
          uint16_t pos = 0;
          uint16_t cur_length;
 
+         sectors_m.reserve(maxSectors_c);
+
          while(pos < size_m)
          {
-             sectors_m.push_back(new Sector(&buf[pos + 5], size_m - pos, cur_length));
+             if (pool)
+             {
+                 sectors_m.push_back(pool->create(&buf[pos + 5], size_m - pos, cur_length, copy));
+             }
+             else
+             {
+                 sectors_m.push_back(new Sector(&buf[pos + 5], size_m - pos, cur_length, copy));
+             }
+             indexSector(sectors_m.back());
              pos += cur_length;
          }
          length = size_m + 5;
@@ -60,7 +77,7 @@ Track::Track(uint8_t  *buf,
 //!
 Track::~Track()
 {
-    for (unsigned int i = 0; i < sectors_m.size(); ++i)
+    for (unsigned int i = 0; ownsSectors_m && (i < sectors_m.size()); ++i)
     {
         delete sectors_m[i];
     }
@@ -99,10 +116,77 @@ Track::addSector(Sector *sector)
 {
     sectors_m.push_back(sector);
 
+    return indexSector(sector);
+}
+
+
+//! add a sector to the sector number index, the first sector with a given number
+//! is the one returned by getSector(). Missing and duplicate sectors are reported by
+//! reportSectors(), not here, so parsing a track prints nothing.
+//!
+//! @param sector     pointer to sector
+//!
+//! @return false if the sector number is a duplicate
+//!
+bool
+Track::indexSector(Sector *sector)
+{
+    uint8_t sectorNum = sector->findSectorNum();
+
+    if (sectorNum >= maxSectors_c)
+    {
+        return true;
+    }
+
+    if (sectorIndex_m[sectorNum])
+    {
+        return false;
+    }
+
+    sectorIndex_m[sectorNum] = sector;
+
     return true;
 }
 
 
+//! report missing and duplicate sector numbers
+//!
+//! @return true if each sector number is on the track once
+//!
+bool
+Track::reportSectors()
+{
+    unsigned int count[maxSectors_c] = { 0 };
+    bool         valid = true;
+
+    for (unsigned int i = 0; i < sectors_m.size(); ++i)
+    {
+        uint8_t sectorNum = sectors_m[i]->findSectorNum();
+
+        if (sectorNum < maxSectors_c)
+        {
+            count[sectorNum]++;
+        }
+    }
+
+    for (uint8_t i = 0; i < maxSectors_c; i++)
+    {
+        if (!count[i])
+        {
+            printf("Side: %d Track: %d - Missing sector: %d\n", side_m, track_m, i);
+            valid = false;
+        }
+        else if (count[i] > 1)
+        {
+            printf("Side: %d Track: %d - Duplicate sector: %d\n", side_m, track_m, i);
+            valid = false;
+        }
+    }
+
+    return valid;
+}
+
+
 //! analyze and validate track
 //!
 //! @param validTracks 
@@ -128,6 +212,8 @@ Track::analyze(bool validTracks[2][80])
     }
 
 
+    reportSectors();
+
     for (unsigned int i = 0; i < sectors_m.size(); ++i)
     {
         valid &= sectors_m[i]->analyze();
@@ -141,6 +227,11 @@ Track::analyze(bool validTracks[2][80])
 Sector *
 Track::getSector(uint16_t sectorNum) {
 
+    if (sectorNum < maxSectors_c)
+    {
+        return sectorIndex_m[sectorNum];
+    }
+
     for(uint16_t j = 0; j < sectors_m.size(); j++)
     {
         if (sectorNum == sectors_m[j]->getSectorNum())
@@ -156,12 +247,12 @@ Track::getSector(uint16_t sectorNum) {
 //!
 //! writes the track to a file in h17disk format
 //!
-//! @param file   ofstream for file
+//! @param file   stream to write to
 //!
 //! @return  success
 //!
 bool
-Track::writeToFile(std::ofstream &file)
+Track::writeToFile(std::ostream &file)
 {
     uint32_t size = 0;
 
@@ -197,12 +288,12 @@ Track::writeToFile(std::ofstream &file)
 //!
 //! writes the track to a file
 //!
-//! @param file   ofstream for file
+//! @param file   stream to write to
 //!
 //! @return  success
 //!
 bool
-Track::writeH8D(std::ofstream &file)
+Track::writeH8D(std::ostream &file)
 {
     for (uint8_t i = 0; i < 10; i++)
     {
@@ -226,12 +317,12 @@ Track::writeH8D(std::ofstream &file)
 //!
 //! writes the track to a file
 //!
-//! @param file   ofstream for file
+//! @param file   stream to write to
 //!
 //! @return  success
 //!
 bool
-Track::writeRaw(std::ofstream &file)
+Track::writeRaw(std::ostream &file)
 {
     uint16_t numOfSectors = sectors_m.size();
     bool status = true;
@@ -290,6 +381,8 @@ Track::dump(int level)
     printf("     Side:   %d\n", side_m);
     printf("     Track:  %d\n", track_m);
 
+    reportSectors();
+
     uint16_t numOfSectors = sectors_m.size();
 
     for(uint16_t j = 0; j < numOfSectors; j++)
@@ -11,6 +11,8 @@
 #include <fstream>
 #include <cstdint>
 
+#include "pool.h"
+
 
 class Sector;
 
@@ -18,9 +20,11 @@ class Track {
 
 public:
 
-    Track(uint8_t  *buf,
-          uint32_t  size,
-          uint32_t &length);
+    Track(uint8_t       *buf,
+          uint32_t       size,
+          uint32_t      &length,
+          bool           copy = true,
+          Pool<Sector>  *pool = nullptr);
 
     Track(uint8_t  side,
           uint8_t  track);
@@ -28,12 +32,13 @@ public:
     ~Track();
 
     bool addSector(Sector          *sector);
-    bool writeToFile(std::ofstream &file);
+    bool writeToFile(std::ostream  &file);
     bool analyze(bool               validTracks[2][80]);
-    bool writeH8D(std::ofstream    &file);
-    bool writeRaw(std::ofstream    &file);
+    bool writeH8D(std::ostream     &file);
+    bool writeRaw(std::ostream     &file);
 
     static const uint8_t headerSize_c = 5;
+    static const uint8_t maxSectors_c = 10;
    
     uint8_t getSideNumber();
     uint8_t getTrackNumber();
@@ -46,7 +51,14 @@ public:
  
 private:
 
+    bool indexSector(Sector *sector);
+    bool reportSectors();
+
     std::vector<Sector *> sectors_m;
+    Sector               *sectorIndex_m[maxSectors_c];
+
+    // false when the sectors belong to a pool
+    bool                  ownsSectors_m;
     uint8_t               side_m;
     uint8_t               track_m;
     uint16_t              size_m;